@@ -0,0 +1,214 @@
+/**
+ * @file hellobench.c
+ * @brief Benchmark of the HELLO handling with a lock per controller.
+ *
+ * Runs the HELLO path of the UDP receivers, from the packet lookup to the
+ * reply sent with sendmmsg, with 1 to 64 threads that each own a share of
+ * the controllers, as the receivers do with SO_REUSEPORT. Each measurement
+ * is repeated with one lock around every packet, as the single server lock
+ * worked, to show how the HELLO throughput scales with the lock per
+ * controller.
+ *
+ * Usage: ./hellobench [controllers]
+ *      - controllers: Subscribed controllers sending HELLOs, 1024 if not given.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "utilities/commons.h"
+
+#define BENCH_TIME 0.5 /* Seconds each measurement runs for. */
+#define BENCH_CONTROLLERS 1024 /* Controllers if not given. */
+#define BENCH_BATCH 32 /* Packets handled between two sendmmsg, as a receiver batch. */
+
+/* Only used by the subscriptions, which the benchmark doesn't start */
+reactor_t *reactor = NULL;
+
+/**
+ * @brief Arguments of a benchmark thread.
+ */
+struct benchThread {
+    int id; /**< Position of the thread, it handles the controllers with this index modulo threads */
+    int threads; /**< Number of threads */
+    bool serialized; /**< Whether every packet takes globalLock, as the single server lock */
+    unsigned long handled; /**< HELLOs handled by the thread */
+    thrd_t thread; /**< The thread */
+};
+
+struct Server srvConf;
+struct Controller *controllers = NULL;
+char *packets = NULL;
+struct sockaddr_in sink;
+double deadline;
+mtx_t globalLock;
+
+/**
+ * @brief Gets a monotonic time.
+ *
+ * @return Seconds since an arbitrary point.
+ */
+double now() {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Subscribes the controllers and encodes a HELLO of each one.
+ *
+ * @param numControllers The number of controllers.
+ */
+void setupControllers(int numControllers) {
+    char data[80];
+    int i;
+
+    if ((controllers = (struct Controller*)calloc(numControllers, sizeof(struct Controller))) == NULL ||
+        (packets = (char*)malloc(numControllers * PDUUDP)) == NULL) {
+        fprintf(stderr, "Failed to allocate memory for controllers.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < numControllers; i++) {
+        controllers[i].index = i;
+        sprintf(controllers[i].name, "C%07d", i % 10000000);
+        sprintf(controllers[i].mac, "%012X", (unsigned int)i + 1);
+        controllers[i].subs.socket = -1;
+        mtx_init(&controllers[i].lock, mtx_plain);
+        controllers[i].data.status = SEND_HELLO;
+        strcpy(controllers[i].data.situation, "B00L01R02A03");
+        sprintf(controllers[i].data.rand, "%08d", 10000000 + i);
+        sprintf(data, "%s,%s", controllers[i].name, controllers[i].data.situation);
+        encodeUdp(packets + i * PDUUDP, HELLO, controllers[i].mac, controllers[i].data.rand, data);
+    }
+    buildIndexes(controllers, numControllers);
+    liveness = timers_create(numControllers);
+
+    memset(&srvConf, 0, sizeof(srvConf));
+    srvConf.numControllers = numControllers;
+    strcpy(srvConf.name, "SERVER-1");
+    strcpy(srvConf.mac, "21AE345FD321");
+}
+
+/**
+ * @brief Handles the HELLOs of the controllers of a thread until the deadline.
+ *
+ * @param arg Pointer to a struct benchThread.
+ */
+int benchWorker(void *arg) {
+    struct benchThread *self = (struct benchThread*)arg;
+    struct subsThreadArgs packetArgs;
+    struct UDPEgress egress;
+    int controller = self->id, i;
+
+    packetArgs.srvConf = &srvConf;
+    packetArgs.controller = controllers;
+    packetArgs.addr = sink;
+    if ((packetArgs.socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        perror("socket");
+        return 0;
+    }
+    while (now() < deadline) {
+        beginUdpEgress(&egress);
+        for (i = 0; i < BENCH_BATCH; i++) {
+            packetArgs.bytes = packets + controller * PDUUDP;
+            if (self->serialized) {
+                mtx_lock(&globalLock);
+                handleUDPConnection(&packetArgs);
+                mtx_unlock(&globalLock);
+            } else {
+                handleUDPConnection(&packetArgs);
+            }
+            if ((controller += self->threads) >= srvConf.numControllers) {
+                controller = self->id;
+            }
+        }
+        endUdpEgress();
+        self->handled += BENCH_BATCH;
+    }
+    close(packetArgs.socket);
+    return 0;
+}
+
+/**
+ * @brief Measures the HELLO throughput.
+ *
+ * @param threads Number of threads.
+ * @param serialized Whether every packet takes globalLock.
+ *
+ * @return HELLOs handled per second.
+ */
+double benchHello(int threads, bool serialized) {
+    struct benchThread *workers;
+    unsigned long handled = 0;
+    double start;
+    int i;
+
+    if ((workers = (struct benchThread*)calloc(threads, sizeof(struct benchThread))) == NULL) {
+        return 0;
+    }
+    start = now();
+    deadline = start + BENCH_TIME;
+    for (i = 0; i < threads; i++) {
+        workers[i].id = i;
+        workers[i].threads = threads;
+        workers[i].serialized = serialized;
+        thrd_create(&workers[i].thread, benchWorker, &workers[i]);
+    }
+    for (i = 0; i < threads; i++) {
+        thrd_join(workers[i].thread, NULL);
+        handled += workers[i].handled;
+    }
+    free(workers);
+    return handled / (now() - start);
+}
+
+/**
+ * @brief Main function of the benchmark.
+ *
+ * The replies go to a socket that is never read, the kernel drops them
+ * once it's full.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ *
+ * @return Returns EXIT_FAILURE if the number of controllers isn't valid, the sockets can't be created
+ * or a HELLO was rejected.
+ */
+int main(int argc, char *argv[]) {
+    int numControllers = argc > 1 ? atoi(argv[1]) : BENCH_CONTROLLERS;
+    socklen_t length = sizeof(sink);
+    double single, perController;
+    int sinkSocket, threads, i;
+
+    if (numControllers < 64 || numControllers > 1000000) {
+        fprintf(stderr, "Usage: %s [controllers], from 64 to 1000000 controllers\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    memset(&sink, 0, sizeof(sink));
+    sink.sin_family = AF_INET;
+    sink.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((sinkSocket = socket(AF_INET, SOCK_DGRAM, 0)) < 0 || bind(sinkSocket, (struct sockaddr*)&sink, sizeof(sink)) < 0 ||
+        getsockname(sinkSocket, (struct sockaddr*)&sink, &length) < 0) {
+        perror("sink socket");
+        return EXIT_FAILURE;
+    }
+    mtx_init(&globalLock, mtx_plain);
+    setupControllers(numControllers);
+
+    printf("%-8s %16s %16s %8s\n", "Threads", "Global HELLO/s", "Per-ctrl HELLO/s", "Speedup");
+    for (threads = 1; threads <= 64; threads *= 2) {
+        single = benchHello(threads, true);
+        perController = benchHello(threads, false);
+        printf("%-8d %16.0f %16.0f %8.2f\n", threads, single, perController, single > 0 ? perController / single : 0);
+    }
+    close(sinkSocket);
+    for (i = 0; i < numControllers; i++) {
+        if (controllers[i].data.status != SEND_HELLO) {
+            fprintf(stderr, "Controller %s was disconnected, its HELLOs were rejected.\n", controllers[i].name);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
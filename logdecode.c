@@ -0,0 +1,198 @@
+/**
+ * @file logdecode.c
+ * @brief Decoder of the binary server log.
+ *
+ * Reads a log written with the Log-binary setting and prints it as the text
+ * the server shows in the terminal: [HH:MM:SS] [Level] message.
+ *
+ * Usage: ./logdecode [-t] [file]
+ *      - -t: Prints the number of the thread that logged each line after its level.
+ *      - file: The binary log, standard input if not given.
+ *
+ * The layout of the entries is described in utilities/logger.h.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-29
+ */
+
+#include "utilities/commons.h"
+
+/* Names of the levels, indexed by logger_level_t */
+const char *levelNames[] = {"Info", "Warning"};
+
+/* Format of every identifier of the current session */
+char *formats[LOGGER_FORMATS];
+
+/**
+ * @brief Reads size bytes from the log.
+ *
+ * @param file The log.
+ * @param out Where the bytes are stored.
+ * @param size Number of bytes.
+ *
+ * @return Returns false if the log ends before.
+ */
+bool readBytes(FILE *file, void *out, size_t size) {
+    return fread(out, 1, size, file) == size;
+}
+
+/**
+ * @brief Prints a message from its format and packed arguments.
+ *
+ * Each conversion is printed with its own flags, width and precision, the
+ * length modifiers are replaced with the size the argument was packed with.
+ * Conversions whose argument didn't fit in the record print nothing.
+ *
+ * @param format The format of the message.
+ * @param args The packed arguments.
+ * @param size Number of bytes of args.
+ */
+void printMessage(const char *format, const char *args, size_t size) {
+    char spec[32], str[LOGGER_TEXT + 1];
+    const char *c;
+    size_t used = 0, flags;
+    int64_t integer;
+    double real;
+    uint16_t length;
+
+    for (c = format; *c != '\0'; c++) {
+        if (*c != '%') {
+            putchar(*c);
+            continue;
+        }
+        if (c[1] == '%') {
+            putchar('%');
+            c++;
+            continue;
+        }
+        /* Keep flags, width and precision, drop the length modifiers */
+        flags = strspn(c + 1, "-+ #0123456789.");
+        if (flags > sizeof(spec) - 4) {
+            flags = sizeof(spec) - 4;
+        }
+        memcpy(spec, c, flags + 1);
+        c += flags + 1;
+        c += strspn(c, "hljzt");
+        if (*c == '\0') {
+            break;
+        }
+
+        if (*c == 's') {
+            if (used + 2 > size) {
+                continue;
+            }
+            memcpy(&length, args + used, 2);
+            if (used + 2 + length > size) {
+                length = (uint16_t)(size - used - 2);
+            }
+            memcpy(str, args + used + 2, length);
+            str[length] = '\0';
+            used += 2 + length;
+            strcpy(spec + flags + 1, "s");
+            printf(spec, str);
+            continue;
+        }
+        if (used + 8 > size) {
+            continue;
+        }
+        memcpy(&integer, args + used, 8);
+        used += 8;
+        if (strchr("di", *c) != NULL) {
+            sprintf(spec + flags + 1, "l%c", *c);
+            printf(spec, (long)integer);
+        } else if (strchr("ouxX", *c) != NULL) {
+            sprintf(spec + flags + 1, "l%c", *c);
+            printf(spec, (unsigned long)integer);
+        } else if (*c == 'c') {
+            strcpy(spec + flags + 1, "c");
+            printf(spec, (int)integer);
+        } else if (*c == 'p') {
+            strcpy(spec + flags + 1, "p");
+            printf(spec, (void*)(uintptr_t)integer);
+        } else {
+            memcpy(&real, &integer, 8);
+            sprintf(spec + flags + 1, "%c", *c);
+            printf(spec, real);
+        }
+    }
+}
+
+/**
+ * @brief Main function of the decoder.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ *
+ * @return Returns EXIT_FAILURE if the log can't be read or is corrupted.
+ */
+int main(int argc, char *argv[]) {
+    FILE *file = stdin;
+    bool threads = false;
+    int i, kind;
+    unsigned char version, level;
+    uint16_t id, length, size;
+    uint32_t thread;
+    uint64_t timestamp;
+    time_t seconds;
+    struct tm local;
+    char time_str[9], args[LOGGER_TEXT];
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0) {
+            threads = true;
+        } else if ((file = fopen(argv[i], "rb")) == NULL) {
+            perror(argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    while ((kind = fgetc(file)) != EOF) {
+        if (kind == LOGGER_SESSION) {
+            if (!readBytes(file, &version, 1) || version != LOGGER_VERSION) {
+                fprintf(stderr, "Unsupported binary log version.\n");
+                return EXIT_FAILURE;
+            }
+            for (i = 0; i < LOGGER_FORMATS; i++) {
+                free(formats[i]);
+                formats[i] = NULL;
+            }
+        } else if (kind == LOGGER_FORMAT) {
+            if (!readBytes(file, &id, 2) || !readBytes(file, &length, 2) || id >= LOGGER_FORMATS) {
+                break;
+            }
+            free(formats[id]);
+            if ((formats[id] = (char*)malloc(length + 1)) == NULL) {
+                fprintf(stderr, "Failed to allocate memory for format.\n");
+                return EXIT_FAILURE;
+            }
+            if (!readBytes(file, formats[id], length)) {
+                break;
+            }
+            formats[id][length] = '\0';
+        } else if (kind == LOGGER_RECORD) {
+            if (!readBytes(file, &level, 1) || !readBytes(file, &id, 2) || !readBytes(file, &thread, 4) ||
+                !readBytes(file, &timestamp, 8) || !readBytes(file, &size, 2) ||
+                id >= LOGGER_FORMATS || level > LOGGER_WARNING || size > LOGGER_TEXT || !readBytes(file, args, size)) {
+                break;
+            }
+            seconds = (time_t)(timestamp / 1000);
+            localtime_r(&seconds, &local);
+            strftime(time_str, sizeof(time_str), "%H:%M:%S", &local);
+            printf("[%s] [%s] ", time_str, levelNames[level]);
+            if (threads) {
+                printf("[%u] ", (unsigned int)thread);
+            }
+            printMessage(formats[id] != NULL ? formats[id] : "(unknown format)", args, size);
+            putchar('\n');
+        } else {
+            break;
+        }
+    }
+
+    if (!feof(file)) {
+        fprintf(stderr, "Corrupted binary log.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
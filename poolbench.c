@@ -0,0 +1,249 @@
+/**
+ * @file poolbench.c
+ * @brief Benchmark of the thread pool task queues.
+ *
+ * Submits small tasks from one thread, as the server loop does, and reports
+ * how many are submitted and executed per second by the thread pool and by
+ * the single mutex queue it replaced, from 1 to 64 worker threads.
+ *
+ * Usage: ./poolbench [tasks]
+ *      - tasks: Tasks submitted for each measurement, 200000 if not given.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "utilities/commons.h"
+
+#define BENCH_TASKS 200000 /* Tasks submitted for each measurement if not given. */
+#define MUTEX_QUEUE_SIZE 100 /* Size of the queue of the mutex pool, as it was. */
+
+/**
+ * @brief Represents the thread pool as it was before the lock-free queues.
+ *
+ * Every submit and every worker take the same mutex.
+ */
+struct MutexPool {
+    task_t tasks[MUTEX_QUEUE_SIZE]; /**< Queued tasks */
+    int head; /**< Next task to run */
+    int tail; /**< Where the next task is queued */
+    int count; /**< Queued tasks */
+    mtx_t lock; /**< Protects the queue */
+    cnd_t notEmpty; /**< Signaled when a task is queued */
+    cnd_t notFull; /**< Signaled when a task is taken */
+    thrd_t *threads; /**< Worker threads */
+    int size; /**< Number of worker threads */
+};
+
+/* Tasks run so far, by any pool */
+unsigned long executed = 0;
+
+/**
+ * @brief Gets a monotonic time.
+ *
+ * @return Seconds since an arbitrary point.
+ */
+double now() {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Task of the benchmark, counts itself.
+ *
+ * @param arg Unused.
+ */
+void countTask(void *arg) {
+    __atomic_fetch_add(&executed, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Worker of the mutex pool, runs tasks until it takes a NULL one.
+ *
+ * @param arg Pointer to the pool.
+ */
+int mutexWorker(void *arg) {
+    struct MutexPool *pool = (struct MutexPool*)arg;
+    task_t task;
+
+    while (1) {
+        mtx_lock(&pool->lock);
+        while (pool->count == 0) {
+            cnd_wait(&pool->notEmpty, &pool->lock);
+        }
+        task = pool->tasks[pool->head];
+        if (task.function == NULL) {
+            mtx_unlock(&pool->lock);
+            break;
+        }
+        pool->head = (pool->head + 1) % MUTEX_QUEUE_SIZE;
+        pool->count--;
+        cnd_signal(&pool->notFull);
+        mtx_unlock(&pool->lock);
+
+        (task.function)(task.argument);
+    }
+    return 0;
+}
+
+/**
+ * @brief Queues a task in the mutex pool, waiting while the queue is full.
+ *
+ * @param pool The pool.
+ * @param function The task, NULL stops a worker.
+ * @param argument Argument of the task.
+ */
+void mutexSubmit(struct MutexPool *pool, void (*function)(void*), void *argument) {
+    mtx_lock(&pool->lock);
+    while (pool->count == MUTEX_QUEUE_SIZE) {
+        cnd_wait(&pool->notFull, &pool->lock);
+    }
+    pool->tasks[pool->tail].function = function;
+    pool->tasks[pool->tail].argument = argument;
+    pool->tail = (pool->tail + 1) % MUTEX_QUEUE_SIZE;
+    pool->count++;
+    cnd_signal(&pool->notEmpty);
+    mtx_unlock(&pool->lock);
+}
+
+/**
+ * @brief Creates a mutex pool.
+ *
+ * @param threads Number of worker threads.
+ *
+ * @return The pool, NULL if it can't be allocated.
+ */
+struct MutexPool* mutexCreate(int threads) {
+    struct MutexPool *pool;
+    int i;
+
+    if ((pool = (struct MutexPool*)malloc(sizeof(struct MutexPool))) == NULL ||
+        (pool->threads = (thrd_t*)malloc(threads * sizeof(thrd_t))) == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pool->head = pool->tail = pool->count = 0;
+    pool->size = threads;
+    mtx_init(&pool->lock, mtx_plain);
+    cnd_init(&pool->notEmpty);
+    cnd_init(&pool->notFull);
+    for (i = 0; i < threads; i++) {
+        thrd_create(&pool->threads[i], mutexWorker, pool);
+    }
+    return pool;
+}
+
+/**
+ * @brief Stops the workers of a mutex pool and frees it.
+ *
+ * @param pool The pool.
+ */
+void mutexShutdown(struct MutexPool *pool) {
+    int i;
+
+    for (i = 0; i < pool->size; i++) {
+        mutexSubmit(pool, NULL, NULL);
+    }
+    for (i = 0; i < pool->size; i++) {
+        thrd_join(pool->threads[i], NULL);
+    }
+    cnd_destroy(&pool->notEmpty);
+    cnd_destroy(&pool->notFull);
+    mtx_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+/**
+ * @brief Waits until a number of tasks have run.
+ *
+ * @param tasks The number of tasks.
+ */
+void waitExecuted(unsigned long tasks) {
+    while (__atomic_load_n(&executed, __ATOMIC_RELAXED) < tasks) {
+        thrd_yield();
+    }
+}
+
+/**
+ * @brief Measures the mutex pool.
+ *
+ * @param threads Number of worker threads.
+ * @param tasks Number of tasks.
+ *
+ * @return Tasks submitted and executed per second, 0 if the pool can't be created.
+ */
+double benchMutex(int threads, long tasks) {
+    struct MutexPool *pool;
+    double start, elapsed;
+    long i;
+
+    if ((pool = mutexCreate(threads)) == NULL) {
+        return 0;
+    }
+    executed = 0;
+    start = now();
+    for (i = 0; i < tasks; i++) {
+        mutexSubmit(pool, countTask, NULL);
+    }
+    waitExecuted(tasks);
+    elapsed = now() - start;
+    mutexShutdown(pool);
+    return tasks / elapsed;
+}
+
+/**
+ * @brief Measures the thread pool of the server.
+ *
+ * The tasks carry an 8 byte argument in the task, as the ones the server
+ * submits with thread_pool_submit_inline.
+ *
+ * @param threads Number of worker threads.
+ * @param tasks Number of tasks.
+ *
+ * @return Tasks submitted and executed per second.
+ */
+double benchPool(int threads, long tasks) {
+    thread_pool_t *pool = thread_pool_create(threads);
+    double start, elapsed;
+    long i;
+
+    executed = 0;
+    start = now();
+    for (i = 0; i < tasks; i++) {
+        thread_pool_submit_inline(pool, countTask, &i, sizeof(i));
+    }
+    waitExecuted(tasks);
+    elapsed = now() - start;
+    thread_pool_shutdown(pool);
+    return tasks / elapsed;
+}
+
+/**
+ * @brief Main function of the benchmark.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ *
+ * @return Returns EXIT_FAILURE if the number of tasks isn't valid.
+ */
+int main(int argc, char *argv[]) {
+    long tasks = argc > 1 ? atol(argv[1]) : BENCH_TASKS;
+    double mutex, pool;
+    int threads;
+
+    if (tasks <= 0) {
+        fprintf(stderr, "Usage: %s [tasks]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    printf("%-8s %16s %16s %8s\n", "Threads", "Mutex tasks/s", "Pool tasks/s", "Speedup");
+    for (threads = 1; threads <= 64; threads *= 2) {
+        mutex = benchMutex(threads, tasks);
+        pool = benchPool(threads, tasks);
+        printf("%-8d %16.0f %16.0f %8.2f\n", threads, mutex, pool, mutex > 0 ? pool / mutex : 0);
+    }
+    return EXIT_SUCCESS;
+}
@@ -13,8 +13,8 @@
  * - Socket Initialization: Creates TCP and UDP socket file descriptors for communication with controllers.
  * - Controller Management:
  *      - Loads a list of allowed controllers into memory.
- *      - Monitors and validates incoming connections from controllers using select.
- *      - Handles subscription requests and manages connection status updates.
+ *      - Monitors and validates incoming connections from controllers using an epoll event loop.
+ *      - Handles subscription requests without blocking, the reactor drives each handshake.
  *      - Detects and handles disconnections and inactive controller detection.
  * - Communication Handling:
  *      - Receives and processes UDP packets from controllers.
@@ -31,66 +31,428 @@
  * - `utilities/pdu/udp.c`: Contains functions for UDP packet handling.
  * - `utilities/pdu/tcp.c`: Contains functions for TCP packet handling.
  * - `utilities/logs.c`: Provides logging functionality for the program.
+ * - `utilities/logger.c`: Per-thread log rings written in batches by a flusher thread.
  * - `utilities/server/controllers.c`: Manages controller loading and data.
  * - `utilities/server/conf.c`: Handles server configuration.
  * - `utilities/server/subs.c`: Manages controller subscription requests and periodic communication.
  * - `utilities/server/commands.c`: Executes server management commands.
  * - `utilities/server/data.c`: Handles data transmission, request and storage.
+ * - `utilities/server/storage.c`: Keeps the data files open and buffered in a LRU cache.
+ * - `utilities/server/tsdb.c`: Stores the data records as chunks of binary columns per controller.
+ * - `utilities/server/chunk.c`: Encodes and decodes the time-series chunks.
+ * - `utilities/server/history.c`: Reads a time range of a device from the mapped time-series files.
+ * - `utilities/server/rollup.c`: Count, minimum, maximum and average of each device per time bucket.
+ * - `utilities/server/wal.c`: Write-ahead log of the data records, with group commit and recovery.
  * - `utilities/threadpool.c: Has functions to execute and manage the threadpool.
+ * - `utilities/arena.c`: Per-thread allocator for the thread pool task arguments.
+ * - `utilities/reactor.c`: Epoll event loop that waits for stdin, sockets and timers.
+ * - `utilities/timers.c`: Min-heap of deadlines used for the controllers liveness checks.
+ * - `utilities/clock.c`: Cached date and time strings refreshed every second, and a coarse clock.
+ * - `utilities/stats.c`: Runtime counters shown by the stats command.
+ * - `utilities/gorilla.c`: Delta of deltas and XOR compression of the time-series columns.
  */
 
 #include "utilities/commons.h"
 
-/* Init global mutex between threads */
-mtx_t mutex;
-
 /*Create default server sockets file descriptors*/
 int tcp_socket, udp_socket;
 
+/* UDP receiver threads, each one with its own socket bound to the UDP port */
+struct subsReceiverArgs *udpReceivers = NULL;
+int numUdpReceivers = 0;
+int startedUdpReceivers = 0;
+
 /*Array of structs for allowed clients in memory*/
 struct Controller *controllers = NULL;
 
 /* Struct for thread pool */
 thread_pool_t *threadPool = NULL;
 
+/* The expired buffers of the clock tick are being written by a worker */
+bool flushingExpired = false;
+
+/* Event loop of the main thread */
+reactor_t *reactor = NULL;
+
+/* Preallocated buffers for batched UDP reception */
+struct UDPReceiver *udpReceiver = NULL;
+
+/**
+ * @brief Stops the UDP receiver threads and waits for them.
+ *
+ * Shutting a socket down wakes its thread from recvmmsg, and the thread
+ * returns once it sees its stopping flag, so no packet is being handled
+ * when this returns. The sockets stay open for the replies being sent.
+ */
+void stopUdpReceivers() {
+    int i;
+
+    for (i = 0; i < startedUdpReceivers; i++) {
+        __atomic_store_n(&udpReceivers[i].stopping, true, __ATOMIC_RELEASE);
+        shutdown(udpReceivers[i].socket, SHUT_RD);
+    }
+    for (i = 0; i < startedUdpReceivers; i++) {
+        thrd_join(udpReceivers[i].thread, NULL);
+    }
+    startedUdpReceivers = 0;
+}
+
 /* Closes the server */
 void quit(int signum) {
+    bool written;
+
+    logger_flush();
+    stopUdpReceivers();
     if (signum == SIGINT) {
         printf("\nExiting via SIGINT...\n");
     } else if(signum == 0) {
         printf("Closing server...\n");
     }
     thread_pool_shutdown(threadPool);
+    /* Write the buffered records once no worker can add more, then drop the log */
+    written = storageClose();
+    written = tsdbClose() && written;
+    rollupClose();
+    walClose(written);
+    historyClose();
+    if (numUdpReceivers > 0) {
+        int i;
+        /* The first receiver socket is udp_socket */
+        for (i = 1; i < numUdpReceivers; i++) {
+            close(udpReceivers[i].socket);
+        }
+    }
     close(udp_socket);
     close(tcp_socket);
     /*Free controllers*/
     free(controllers);
     /*Close the socket file descriptors*/
 
+    /* Lines logged by the workers before they stopped */
+    logger_flush();
     exit(EXIT_SUCCESS);
 }
 
+/**
+ * @brief Reactor handler for the UDP socket.
+ *
+ * Drains the pending datagrams with recvmmsg and splits each received batch
+ * by controller MAC, submitting one task per worker to its local queue, so
+ * the packets of a controller are always handled by the same worker.
+ *
+ * @param arg Pointer to the server configuration.
+ * @param events The epoll events that triggered the call.
+ */
+void onUdpReadable(void *arg, uint32_t events) {
+    struct Server *serv_conf = (struct Server *)arg;
+    /* Only used by the reactor thread */
+    static struct subsBatch *batches[MAX_THREADS];
+    static int counts[MAX_THREADS];
+    static int owners[MAX_UDP_BATCH];
+    int i, received;
+
+    do {
+        if ((received = recvUdpBatch(udp_socket, udpReceiver, false)) == 0) {
+            break;
+        }
+
+        /* The MAC follows the packet type */
+        for (i = 0; i < received; i++) {
+            owners[i] = hashKey(udpReceiver->buffers + i * PDUUDP + 1, 12) % threadPool->size;
+            counts[owners[i]]++;
+        }
+        for (i = 0; i < threadPool->size; i++) {
+            if (counts[i] > 0) {
+                /* Batches outlive this call, the worker returns them to the reactor thread arena */
+                batches[i] = arena_alloc(sizeof(struct subsBatch) + (counts[i] - 1) * sizeof(struct subsThreadArgs) + counts[i] * PDUUDP);
+                if (batches[i] == NULL) {
+                    lerror("Failed memory allocation for UDP batch", true);
+                }
+                batches[i]->count = 0;
+                batches[i]->datagrams = (char *)&batches[i]->args[counts[i]];
+            }
+        }
+        for (i = 0; i < received; i++) {
+            struct subsBatch *batch = batches[owners[i]];
+            struct subsThreadArgs *args = &batch->args[batch->count];
+            char *datagram = batch->datagrams + batch->count++ * PDUUDP;
+            /* The receive buffers are reused by the next call, the batch keeps the raw datagram */
+            memcpy(datagram, udpReceiver->buffers + i * PDUUDP, PDUUDP);
+            args->bytes = datagram;
+            args->addr = udpReceiver->addrs[i];
+            args->controller = controllers;
+            args->srvConf = serv_conf;
+            args->socket = udp_socket;
+        }
+        for (i = 0; i < threadPool->size; i++) {
+            if (counts[i] > 0) {
+                STATS_ADD(udpBatches, 1);
+                thread_pool_submit_to(threadPool, i, handleUDPBatch, (void *)batches[i]);
+                counts[i] = 0;
+            }
+        }
+    } while (received == udpReceiver->size);
+}
+
+/**
+ * @brief Reactor handler for the liveness timers.
+ *
+ * Disconnects the controllers whose deadline has expired, meaning they
+ * haven't sent a packet in the last LIVENESS_TIMEOUT milliseconds.
+ *
+ * @param arg Pointer to the server configuration.
+ * @param events The epoll events that triggered the call.
+ */
+void onLivenessTimer(void *arg, uint32_t events) {
+    int expired[64];
+    int i, count;
+
+    do {
+        count = timers_expired(liveness, expired, 64);
+        for (i = 0; i < count; i++) {
+            struct Controller *controller = &controllers[expired[i]];
+            mtx_lock(&controller->lock);
+            /* A packet may have re-armed the deadline after it expired */
+            if (controller->data.lastPacketTime != 0 && timers_now() - controller->data.lastPacketTime >= LIVENESS_TIMEOUT) {
+                mtx_unlock(&controller->lock);
+                linfo("Controller %s hasn't sent 3 consecutive packets. DISCONNECTING...",true,controller->name);
+                disconnectController(controller);
+                continue;
+            }
+            mtx_unlock(&controller->lock);
+        }
+    } while (count == 64);
+}
+
+/**
+ * @brief Thread Function to write the buffers that have been open for too long.
+ *
+ * Runs the expired flushes of the data files, time-series files and rollups
+ * in a worker, so the reactor doesn't wait for their writes.
+ *
+ * @param arg Unused.
+ */
+void flushExpiredTask(void *arg) {
+    storageFlushExpired();
+    tsdbFlushExpired();
+    rollupFlushExpired();
+    __atomic_store_n(&flushingExpired, false, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Reactor handler for the clock timer.
+ *
+ * Refreshes the cached date and time strings once per second, and submits
+ * the writes of the data records that have been buffered for too long and
+ * the sync or checkpoint of the write-ahead log to the pool. A tick is
+ * skipped while the previous writes run.
+ *
+ * @param arg Unused.
+ * @param events The epoll events that triggered the call.
+ */
+void onClockTick(void *arg, uint32_t events) {
+    clock_tick();
+    if (!__atomic_load_n(&flushingExpired, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&flushingExpired, true, __ATOMIC_RELAXED);
+        thread_pool_submit(threadPool, flushExpiredTask, NULL);
+    }
+    walTick(threadPool);
+}
+
+/**
+ * @brief Reactor handler for the TCP listener.
+ *
+ * Accepts the incoming connection and submits it to the thread pool.
+ *
+ * @param arg Pointer to the server configuration.
+ * @param events The epoll events that triggered the call.
+ */
+void onTcpReadable(void *arg, uint32_t events) {
+    /* TCP timeout settings */
+    struct timeval tcpTimeout;
+    struct sockaddr_in clientAddr;
+    socklen_t client_addr_len = sizeof(struct sockaddr_in);
+
+    /* Thread args, copied into the task */
+    struct dataThreadArgs threadArgs;
+    threadArgs.controllers = controllers;
+    threadArgs.servConf = (struct Server *)arg;
+
+    if ((threadArgs.client_socket = accept(tcp_socket, (struct sockaddr *)&clientAddr, &client_addr_len)) == -1) {
+        lerror("Unexpected error while receiving TCP connection",true);
+    }
+
+    /*Set TCP socket max recv time*/
+    tcpTimeout.tv_sec = 3;
+    tcpTimeout.tv_usec = 0;
+    if(setsockopt(threadArgs.client_socket,SOL_SOCKET,SO_RCVTIMEO,(const char*)&tcpTimeout,sizeof(tcpTimeout)) < 0){
+        lerror("Unexpected error when setting TCP socket settings",true);
+    }
+
+    thread_pool_submit_inline(threadPool, dataReception, &threadArgs, sizeof(threadArgs));
+}
+
+/**
+ * @brief Reactor handler for the standard input.
+ *
+ * Reads and executes a server command.
+ *
+ * @param arg Pointer to the server configuration.
+ * @param events The epoll events that triggered the call.
+ */
+void onStdinReadable(void *arg, uint32_t events) {
+    struct Server *serv_conf = (struct Server *)arg;
+    char commandLine[72]; /*72(Worst case scenario) = rollup(6) + controller_name(8) + device(7) + width(6) + from(17) + to(17) + spaces(5) + \n(1) + \0(1)*/
+    char command[72], controller[9], device[8], value[7];
+    /* command can hold a whole line, parseInput copies the first word without a limit */
+    int args;
+
+    /* Queued lines go before the output of the command */
+    logger_flush();
+
+    if (fgets(commandLine, sizeof(commandLine), stdin) == NULL) {
+        lerror("Fgets failed",true);
+    }
+
+    /* Remove trailing newline character if present */
+    commandLine[strcspn(commandLine, "\n")] = '\0';
+    
+    /* Its times don't fit the value of the other commands */
+    if (strncmp(commandLine, "history ", 8) == 0) {
+        commandHistory(commandLine + 8, controllers, serv_conf, threadPool);
+        return;
+    }
+    if (strncmp(commandLine, "rollup ", 7) == 0) {
+        commandRollup(commandLine + 7, controllers, serv_conf, threadPool);
+        return;
+    }
+
+    args = parseInput(commandLine, command, controller, device, value);
+    
+    if (strcmp(command, "list") == 0 && args == 1) {
+        printList(controllers,serv_conf->numControllers);
+    } else if (strcmp(command, "set") == 0 && args == 4) {
+        if (strlen(controller) > 8) {
+            lwarning("Controller name exceeds maximum length. (8)", true);
+        } else if (strlen(device) > 7) {
+            lwarning("Device name exceeds maximum length. (7)", true);
+        } else if (strlen(value) > 6) {
+            lwarning("Value exceeds maximum length. (6)", true);
+        } else {
+            commandDataPetition(controller, device, value, controllers,serv_conf,threadPool);
+        }
+    } else if (strcmp(command, "get") == 0 && args == 4) {
+        if (strlen(controller) > 8) {
+            lwarning("Controller name exceeds maximum length. (8)", true);
+        } else if (strlen(device) > 7) {
+            lwarning("Device name exceeds maximum length. (7)", true);
+        } else if (strspn(value, "0123456789") != strlen(value)) {
+            lwarning("Maximum age must be a number of seconds.", true);
+        } else {
+            commandCachedGet(controller, device, atoi(value), controllers,serv_conf,threadPool);
+        }
+    } else if (strcmp(command, "get") == 0 && args == 3) {
+        if (strlen(controller) > 8) {
+            lwarning("Controller name exceeds maximum length. (8)", true);
+        } else if (strlen(device) > 7) {
+            lwarning("Device name exceeds maximum length. (7)", true);
+        } else {
+            commandDataPetition(controller, device, "", controllers,serv_conf,threadPool);
+        }
+    } else if (strcmp(command, "stats") == 0 && args == 1) {
+        printStats();
+    } else if (strcmp(command, "quit") == 0 && args == 1) {
+        quit(0);
+    } else if (args != -1 ) {
+        linfo("Usage: list | set <controller-name> <device-name> <value> | get <controller-name> <device-name> [max-age] | history <controller-name> <device-name> <from> <to> | rollup <controller-name> <device-name> <width> <from> <to> | stats | quit", 1);
+    }
+}
+
+/**
+ * @brief Creates a UDP socket bound to the server UDP port.
+ *
+ * With reusePort set, the socket is created with SO_REUSEPORT so several of
+ * them can share the port and the kernel spreads the flows between them.
+ *
+ * @param serv_conf Pointer to the server configuration.
+ * @param reusePort Whether to enable SO_REUSEPORT before binding.
+ *
+ * @return Returns the socket file descriptor.
+ */
+int createUdpSocket(struct Server *serv_conf, bool reusePort) {
+    int udpSocket, enable = 1;
+
+    if ((udpSocket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        lerror("Error creating UDP socket",true);
+    }
+    if (reusePort && setsockopt(udpSocket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+        lerror("Unexpected error when setting UDP socket SO_REUSEPORT",true);
+    }
+    if (bind(udpSocket, (struct sockaddr *)&serv_conf->udp_address, sizeof(serv_conf->udp_address)) < 0) {
+        lerror("Error binding UDP socket",true);
+    }
+    return udpSocket;
+}
+
+/**
+ * @brief Starts one receiver thread per SO_REUSEPORT socket.
+ *
+ * Every thread blocks on its own socket and handles the packets itself,
+ * so UDP ingest scales with UDP-receivers instead of the main thread.
+ *
+ * @param serv_conf Pointer to the server configuration.
+ */
+void startUdpReceivers(struct Server *serv_conf) {
+    int i;
+
+    for (i = 0; i < numUdpReceivers; i++) {
+        udpReceivers[i].srvConf = serv_conf;
+        udpReceivers[i].controller = controllers;
+        udpReceivers[i].receiver = createUDPReceiver(serv_conf->udpBatch);
+        if (thrd_create(&udpReceivers[i].thread, handleUDPReceiver, (void*)&udpReceivers[i]) != thrd_success) {
+            lerror("Failed to create UDP receiver thread",true);
+        }
+        startedUdpReceivers++;
+    }
+    linfo("Started %d UDP receiver threads on port %d.",false,numUdpReceivers,serv_conf->udp);
+}
+
 int main(int argc, char *argv[]) {
     /*Struct for server configuration*/
     struct Server serv_conf;
-    int i;
-    /*Initialise file descriptors select*/
-    fd_set readfds;
-    int max_fd;
+    /*Open files limit*/
+    struct rlimit fileLimit;
     /*Get config and controllers file name*/
     char *config_file;
     char *controllers_file;
-    readArgs(argc, argv, &config_file, &controllers_file);
+    /*Worker threads given with -t*/
+    int threads;
+    readArgs(argc, argv, &config_file, &controllers_file, &threads);
 
     /* Ctrl+C quit function */
     signal(SIGINT, quit);
 
-    /* Init thread pool */
-    threadPool = thread_pool_create();
+    /* Every subscription in progress holds a socket, allow as many as possible */
+    if (getrlimit(RLIMIT_NOFILE, &fileLimit) == 0 && fileLimit.rlim_cur < fileLimit.rlim_max) {
+        fileLimit.rlim_cur = fileLimit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &fileLimit);
+    }
 
     /*Initialise server configuration struct*/
     linfo("Reading server configuration files...",false);
     serv_conf = serverConfig(config_file);
+    if (threads != -1) {
+        serv_conf.threads = threads;
+    }
+    logger_start(serv_conf.logOverflow, serv_conf.logBinary[0] != '\0' ? serv_conf.logBinary : NULL);
+
+    /* Init thread pool */
+    threadPool = thread_pool_create(serv_conf.threads);
+    storageInit(serv_conf.storageFiles);
+    tsdbInit(serv_conf.storageFiles);
+    historyInit();
+    walInit(serv_conf.walFile, serv_conf.walSync);
+    linfo("Started %d worker threads.",false,threadPool->size);
 
     /*Initialize Sockets*/
     linfo("Initialising socket creation...",false);
@@ -98,19 +460,25 @@ int main(int argc, char *argv[]) {
         if ((tcp_socket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
             lerror("Error creating TCP socket",true);
         }
-        /* Create UDP socket file descriptor */
-        if ((udp_socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-            lerror("Error creating UDP socket",true);
-        }
 
     linfo("Binding sockets to server address...",false);
         /* Bind TCP socket */
         if (bind(tcp_socket, (struct sockaddr *)&serv_conf.tcp_address, sizeof(serv_conf.tcp_address)) < 0) {
             lerror("Error binding TCP socket",true);
         }
-        /* Bind UDP socket */
-        if (bind(udp_socket, (struct sockaddr *)&serv_conf.udp_address, sizeof(serv_conf.udp_address)) < 0) {
-            lerror("Error binding UDP socket",true);
+        /* Create and bind UDP sockets, one per receiver thread if UDP-receivers is set */
+        if (serv_conf.udpReceivers > 0) {
+            int i;
+            numUdpReceivers = serv_conf.udpReceivers;
+            if ((udpReceivers = calloc(numUdpReceivers, sizeof(struct subsReceiverArgs))) == NULL) {
+                lerror("Failed memory allocation for UDP receivers",true);
+            }
+            for (i = 0; i < numUdpReceivers; i++) {
+                udpReceivers[i].socket = createUdpSocket(&serv_conf, true);
+            }
+            udp_socket = udpReceivers[0].socket;
+        } else {
+            udp_socket = createUdpSocket(&serv_conf, false);
         }
 
         /* Initialize listen for TCP file descriptor. */
@@ -126,135 +494,28 @@ int main(int argc, char *argv[]) {
         } else {
             linfo("%d controllers loaded. Waiting for incoming connections...",true,serv_conf.numControllers);
         }
+        rollupInit(controllers, serv_conf.numControllers, serv_conf.rollupWidths, serv_conf.numRollupWidths);
 
-    /*Initialise mutex (Locks and unlocks)*/
-    mtx_init(&mutex, mtx_plain);
-    
-    while (1+1!=3) {
-        /*Define timeval struct for the select*/
-        struct timeval timeout;
-
-        /* Init file descriptors readers */
-        FD_ZERO(&readfds);
-        FD_SET(STDIN_FILENO, &readfds);
-        FD_SET(tcp_socket, &readfds);
-        FD_SET(udp_socket, &readfds);
-        /* Get max range of file descriptors to check */
-        max_fd = (tcp_socket > udp_socket) ? tcp_socket : udp_socket;
-
-        /* Set timeouts */
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50; /*Number of microseconds the select waits for the file descriptors, 
-                                if set to 0 ms CPU usage increases to ~15%, at 50 ms is less than ~1%.
-                                If set to high values affects timeout accuracy for the HELLO packets*/
-
-        /*Start monitoring file descriptors*/
-        if (select(max_fd + 1, &readfds, NULL, NULL, &timeout) < 0) {
-            lerror("Unexpected error in select",true);
-        }
-        
-        /* Check if UDP file descriptor has received data */
-        
-        if (FD_ISSET(udp_socket, &readfds)) {
-            /* Need to malloc due to possible thread creation overwritting still in use thread args */
-            struct subsThreadArgs *udp_args = malloc(sizeof(struct subsThreadArgs));
-            /*linfo("Received data in file descriptor UDP.", false);*/
-            udp_args->packet = recvUdp(udp_socket, &udp_args->addr);
-
-            mtx_lock(&mutex);
-            udp_args->controller = controllers;
-            mtx_unlock(&mutex);
-            udp_args->srvConf = &serv_conf;
-            udp_args->socket = udp_socket;
-
-            thread_pool_submit(threadPool, handleUDPConnection, (void *)udp_args);
-        }
-
-        /*Update controllers packet timers*/
-        for (i = 0; i < serv_conf.numControllers; i++) {
-            mtx_lock(&mutex);
-            if (controllers[i].data.lastPacketTime != 0) {
-                time_t current_time = time(NULL);
-                /* Check if 6 seconds have passed since the last packet */
-                if (current_time - controllers[i].data.lastPacketTime > 6) {
-                    mtx_unlock(&mutex);
-                    linfo("Controller %s hasn't sent 3 consecutive packets. DISCONNECTING...",true,controllers[i].name);
-                    disconnectController(&controllers[i]);
-                    continue;
-                }
-                mtx_unlock(&mutex);
-                continue;
-            }
-            mtx_unlock(&mutex);
-        }
-
-        /* Check if the TCP file descriptor has received data */   
-        if (FD_ISSET(tcp_socket, &readfds)) {
-            /* TCP timeout settings */
-            struct timeval tcpTimeout;
-            struct sockaddr_in clientAddr;
-            socklen_t client_addr_len = sizeof(struct sockaddr_in);
-
-            /* Thread args */
-            struct dataThreadArgs *threadArgs = malloc(sizeof(struct dataThreadArgs));
-            threadArgs->controllers = controllers;
-            threadArgs->servConf = &serv_conf;
-
-            if ((threadArgs->client_socket = accept(tcp_socket, (struct sockaddr *)&clientAddr, &client_addr_len)) == -1) {
-                lerror("Unexpected error while receiving TCP connection",true);
-            }
-
-            /*Set TCP socket max recv time*/
-            tcpTimeout.tv_sec = 3;
-            tcpTimeout.tv_usec = 0;
-            if(setsockopt(threadArgs->client_socket,SOL_SOCKET,SO_RCVTIMEO,(const char*)&tcpTimeout,sizeof(tcpTimeout)) < 0){
-                lerror("Unexpected error when setting TCP socket settings",true);
-            }
-
-            thread_pool_submit(threadPool, dataReception, (void *)threadArgs);
-
-        }
-
-        /* Server commands */
-        if (FD_ISSET(STDIN_FILENO, &readfds)) {
-            char commandLine[30]; /*30(Worst case scenario) = set(3) + controller_name(8) + device(7) + (value) 7 + \0(1) + spaces(3) + \n(1)*/
-            char command[5], controller[9], device[8], value[7];
-            int args;
+    /* Register every file descriptor in the event loop */
+    reactor = reactor_create();
+    if (reactor_add(reactor, STDIN_FILENO, REACTOR_READ, onStdinReadable, &serv_conf) == NULL) {
+        lwarning("Standard input can't be polled, server commands are disabled.", true);
+    }
+    reactor_add(reactor, tcp_socket, REACTOR_READ, onTcpReadable, &serv_conf);
+    reactor_add(reactor, clock_start(), REACTOR_READ, onClockTick, NULL);
+    liveness = timers_create(serv_conf.numControllers);
+    reactor_add(reactor, liveness->fd, REACTOR_READ, onLivenessTimer, &serv_conf);
+    subscriptions = timers_create(serv_conf.numControllers);
+    reactor_add(reactor, subscriptions->fd, REACTOR_READ, onSubsTimeout, controllers);
+    if (numUdpReceivers > 0) {
+        startUdpReceivers(&serv_conf);
+    } else {
+        udpReceiver = createUDPReceiver(serv_conf.udpBatch);
+        reactor_add(reactor, udp_socket, REACTOR_READ, onUdpReadable, &serv_conf);
+    }
 
-            if (fgets(commandLine, sizeof(commandLine), stdin) == NULL) {
-                lerror("Fgets failed",true);
-            }
+    /* Sleep until there is work to do */
+    reactor_run(reactor);
 
-            /* Remove trailing newline character if present */
-            commandLine[strcspn(commandLine, "\n")] = '\0';
-            
-            args = parseInput(commandLine, command, controller, device, value);
-            
-            if (strcmp(command, "list") == 0 && args == 1) {
-                printList(controllers,serv_conf.numControllers);
-            } else if (strcmp(command, "set") == 0 && args == 4) {
-                if (strlen(controller) > 8) {
-                    lwarning("Controller name exceeds maximum length. (8)", true);
-                } else if (strlen(device) > 7) {
-                    lwarning("Device name exceeds maximum length. (7)", true);
-                } else if (strlen(value) > 6) {
-                    lwarning("Value exceeds maximum length. (6)", true);
-                } else {
-                    commandDataPetition(controller, device, value, controllers,&serv_conf,threadPool);
-                }
-            } else if (strcmp(command, "get") == 0 && args == 3) {
-                if (strlen(controller) > 8) {
-                    lwarning("Controller name exceeds maximum length. (8)", true);
-                } else if (strlen(device) > 7) {
-                    lwarning("Device name exceeds maximum length. (7)", true);
-                } else {
-                    commandDataPetition(controller, device, "", controllers,&serv_conf,threadPool);
-                }
-            } else if (strcmp(command, "quit") == 0 && args == 1) {
-                quit(0);
-            } else if (args != -1 ) {
-                linfo("Usage: list | set <controller-name> <device-name> <value> | get <controller-name> <device-name> | quit", 1);
-            }
-        }
-    }
+    return 0;
 }
@@ -0,0 +1,289 @@
+/**
+ * @file tsdbbench.c
+ * @brief Benchmark of the time-series chunk compression.
+ *
+ * Converts text data files into the chunks the server writes and reports
+ * their compression ratio, how fast they're encoded and decoded, and how
+ * fast the same rows are parsed from the text.
+ *
+ * Usage: ./tsdbbench file...
+ *      - file: Text data files, as written with Data-format csv or the samples in binaris/.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "utilities/commons.h"
+
+#define BENCH_TIME 0.5 /* Seconds each measurement runs for at least. */
+
+/* Device names interned by the benchmark */
+char deviceNames[TSDB_MAX_DEVICES][8];
+int numDeviceNames = 0;
+
+/* Chunks of the files being measured, a file starts a new one as each controller has its own file */
+struct TSDBRows *chunks = NULL;
+int numChunks = 0;
+bool newFile = true;
+
+/**
+ * @brief Gets a monotonic time.
+ *
+ * @return Seconds since an arbitrary point.
+ */
+double now() {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Finds the identifier of a device, adding it if it's new.
+ *
+ * @param name Name of the device.
+ *
+ * @return The identifier.
+ */
+uint16_t benchDevice(const char *name) {
+    int i;
+
+    for (i = 0; i < numDeviceNames; i++) {
+        if (strncmp(deviceNames[i], name, 7) == 0) {
+            return (uint16_t)i;
+        }
+    }
+    if (numDeviceNames == TSDB_MAX_DEVICES) {
+        return 0;
+    }
+    strncpy(deviceNames[numDeviceNames], name, 7);
+    return (uint16_t)numDeviceNames++;
+}
+
+/**
+ * @brief Parses a line of a text data file into a row.
+ *
+ * Accepts both the server format, dd-mm-yy,HH:MM:SS,TYPE,device,value,
+ * and the one of the samples, dd-mm-yyyy,HH:MM:SS;TYPE;device;value.
+ *
+ * @param line The line, modified.
+ * @param rows Where the row is appended.
+ *
+ * @return Returns false if the line isn't a record.
+ */
+bool parseLine(char *line, struct TSDBRows *rows) {
+    char *fields[5], *end, *save = NULL;
+    struct tm date;
+    int i, row = rows->count;
+
+    for (i = 0; i < 5; i++) {
+        if ((fields[i] = strtok_r(i == 0 ? line : NULL, ",;\n", &save)) == NULL) {
+            return false;
+        }
+    }
+    memset(&date, 0, sizeof(date));
+    if (sscanf(fields[0], "%d-%d-%d", &date.tm_mday, &date.tm_mon, &date.tm_year) != 3 ||
+        sscanf(fields[1], "%d:%d:%d", &date.tm_hour, &date.tm_min, &date.tm_sec) != 3) {
+        return false;
+    }
+    date.tm_mon -= 1;
+    date.tm_year += date.tm_year < 100 ? 100 : -1900;
+    rows->time[row] = (uint64_t)timegm(&date) * 1000;
+
+    rows->op[row] = strcmp(fields[2], "SET_DATA") == 0 ? SET_DATA : strcmp(fields[2], "GET_DATA") == 0 ? GET_DATA : SEND_DATA;
+    rows->device[row] = benchDevice(fields[3]);
+    rows->value[row] = strtod(fields[4], &end);
+    rows->text[row][0] = '\0';
+    GORILLA_SET_TEXT(rows->textMap, row, false);
+    if (*end != '\0' || end == fields[4] || !isfinite(rows->value[row])) {
+        rows->value[row] = 0;
+        memset(rows->text[row], 0, 8);
+        strncpy(rows->text[row], fields[4], 7);
+        GORILLA_SET_TEXT(rows->textMap, row, true);
+        rows->hasText = true;
+    }
+    rows->count++;
+    return true;
+}
+
+/**
+ * @brief Parses a whole text data file.
+ *
+ * @param text Contents of the file, modified.
+ * @param store Whether the rows are appended to chunks, or only parsed.
+ *
+ * @return Number of records.
+ */
+int parseText(char *text, bool store) {
+    struct TSDBRows scratch;
+    char *line = text, *next;
+    int records = 0;
+
+    scratch.count = 0;
+    while (line != NULL && *line != '\0') {
+        if ((next = strchr(line, '\n')) != NULL) {
+            *next++ = '\0';
+        }
+        if (!store) {
+            scratch.count = 0;
+            records += parseLine(line, &scratch);
+        } else {
+            if (newFile || chunks[numChunks - 1].count == TSDB_CHUNK_ROWS) {
+                if ((chunks = (struct TSDBRows*)realloc(chunks, (numChunks + 1) * sizeof(struct TSDBRows))) == NULL) {
+                    fprintf(stderr, "Failed to allocate memory for chunks.\n");
+                    exit(EXIT_FAILURE);
+                }
+                chunks[numChunks].count = 0;
+                chunks[numChunks++].hasText = false;
+                newFile = false;
+            }
+            records += parseLine(line, &chunks[numChunks - 1]);
+        }
+        line = next;
+    }
+    return records;
+}
+
+/**
+ * @brief Reads a whole file.
+ *
+ * @param filename The file.
+ * @param size Where its size is stored.
+ *
+ * @return Its contents ending with a null character, NULL if it can't be read.
+ */
+char* readFile(const char *filename, size_t *size) {
+    FILE *file;
+    char *text;
+    long length;
+
+    if ((file = fopen(filename, "rb")) == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if ((text = (char*)malloc(length + 1)) == NULL || fread(text, 1, length, file) != (size_t)length) {
+        fclose(file);
+        free(text);
+        return NULL;
+    }
+    fclose(file);
+    text[length] = '\0';
+    *size = length;
+    return text;
+}
+
+/**
+ * @brief Main function of the benchmark.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ *
+ * @return Returns EXIT_FAILURE if a file can't be read or a chunk doesn't decode back.
+ */
+int main(int argc, char *argv[]) {
+    char **texts, *copy, *encoded;
+    size_t *sizes, csvBytes = 0, rawBytes = 0, compressedBytes = 0, largest = 0, *chunkSizes;
+    struct TSDBRows decoded;
+    double start, elapsed;
+    long rounds;
+    int i, c, rows = 0, firstChunk;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s file...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    texts = (char**)malloc(argc * sizeof(char*));
+    sizes = (size_t*)malloc(argc * sizeof(size_t));
+    if (texts == NULL || sizes == NULL) {
+        fprintf(stderr, "Failed to allocate memory for files.\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-32s %8s %10s %10s %10s %7s\n", "File", "Records", "Text", "Raw", "Gorilla", "Ratio");
+    for (i = 1; i < argc; i++) {
+        size_t fileRaw = 0, fileCompressed = 0;
+        int records;
+
+        if ((texts[i] = readFile(argv[i], &sizes[i])) == NULL || (copy = strdup(texts[i])) == NULL) {
+            perror(argv[i]);
+            return EXIT_FAILURE;
+        }
+        firstChunk = numChunks;
+        newFile = true;
+        records = parseText(copy, true);
+        free(copy);
+        largest = sizes[i] > largest ? sizes[i] : largest;
+        for (c = firstChunk; c < numChunks; c++) {
+            fileRaw += rawChunkSize(chunks[c].count, chunks[c].hasText ? TSDB_TEXT | TSDB_TEXT_MAP : 0);
+        }
+        if ((encoded = (char*)malloc(chunkMaxSize(TSDB_CHUNK_ROWS))) == NULL) {
+            return EXIT_FAILURE;
+        }
+        for (c = firstChunk; c < numChunks; c++) {
+            fileCompressed += encodeChunk(&chunks[c], 0, true, encoded);
+        }
+        free(encoded);
+        printf("%-32s %8d %10lu %10lu %10lu %7.2f\n", argv[i], records, (unsigned long)sizes[i],
+            (unsigned long)fileRaw, (unsigned long)fileCompressed, fileCompressed ? (double)sizes[i] / fileCompressed : 0);
+        rows += records;
+        csvBytes += sizes[i];
+        rawBytes += fileRaw;
+        compressedBytes += fileCompressed;
+    }
+    printf("%-32s %8d %10lu %10lu %10lu %7.2f\n", "Total", rows, (unsigned long)csvBytes,
+        (unsigned long)rawBytes, (unsigned long)compressedBytes, compressedBytes ? (double)csvBytes / compressedBytes : 0);
+    if (rows == 0) {
+        return EXIT_SUCCESS;
+    }
+
+    /* Encode every chunk once and check it decodes back */
+    encoded = (char*)malloc(numChunks * chunkMaxSize(TSDB_CHUNK_ROWS));
+    chunkSizes = (size_t*)malloc(numChunks * sizeof(size_t));
+    if (encoded == NULL || chunkSizes == NULL) {
+        fprintf(stderr, "Failed to allocate memory for chunks.\n");
+        return EXIT_FAILURE;
+    }
+    for (c = 0; c < numChunks; c++) {
+        struct TSDBChunk header;
+
+        chunkSizes[c] = encodeChunk(&chunks[c], 0, true, encoded + c * chunkMaxSize(TSDB_CHUNK_ROWS));
+        memcpy(&header, encoded + c * chunkMaxSize(TSDB_CHUNK_ROWS), sizeof(header));
+        if (!checkChunk(&header, chunkSizes[c]) || !decodeChunk(encoded + c * chunkMaxSize(TSDB_CHUNK_ROWS), &decoded) ||
+            memcmp(decoded.time, chunks[c].time, decoded.count * 8) != 0 ||
+            memcmp(decoded.value, chunks[c].value, decoded.count * 8) != 0 ||
+            memcmp(decoded.device, chunks[c].device, decoded.count * 2) != 0 ||
+            memcmp(decoded.textMap, chunks[c].textMap, GORILLA_MAP_BYTES(decoded.count)) != 0) {
+            fprintf(stderr, "Chunk %d doesn't decode back to its rows.\n", c);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("\n%-32s %14s %10s\n", "Operation", "Records/s", "Text MB/s");
+    for (rounds = 0, start = now(); (elapsed = now() - start) < BENCH_TIME; rounds++) {
+        for (c = 0; c < numChunks; c++) {
+            encodeChunk(&chunks[c], 0, true, encoded + c * chunkMaxSize(TSDB_CHUNK_ROWS));
+        }
+    }
+    printf("%-32s %14.0f %10.1f\n", "Encode chunks", rounds * rows / elapsed, rounds * csvBytes / elapsed / 1e6);
+    for (rounds = 0, start = now(); (elapsed = now() - start) < BENCH_TIME; rounds++) {
+        for (c = 0; c < numChunks; c++) {
+            decodeChunk(encoded + c * chunkMaxSize(TSDB_CHUNK_ROWS), &decoded);
+        }
+    }
+    printf("%-32s %14.0f %10.1f\n", "Decode chunks", rounds * rows / elapsed, rounds * csvBytes / elapsed / 1e6);
+    if ((copy = (char*)malloc(largest + 1)) == NULL) {
+        fprintf(stderr, "Failed to allocate memory for files.\n");
+        return EXIT_FAILURE;
+    }
+    for (rounds = 0, start = now(); (elapsed = now() - start) < BENCH_TIME; rounds++) {
+        for (i = 1; i < argc; i++) {
+            memcpy(copy, texts[i], sizes[i] + 1);
+            parseText(copy, false);
+        }
+    }
+    printf("%-32s %14.0f %10.1f\n", "Parse text", rounds * rows / elapsed, rounds * csvBytes / elapsed / 1e6);
+    return EXIT_SUCCESS;
+}
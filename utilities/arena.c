@@ -0,0 +1,128 @@
+/**
+ * @file arena.c
+ * @brief Methods file for the per-thread task argument allocator.
+ *
+ * The arguments of the thread pool tasks are allocated by one thread (the
+ * reactor, usually) and freed by a worker after the task runs. With malloc
+ * that is a constant ping-pong of memory between threads. Here every thread
+ * owns an arena of fixed size blocks carved from large chunks: a thread
+ * allocates from its own free lists without any synchronization, and a block
+ * freed by another thread is pushed to a lock-free list of its owner with a
+ * compare and swap. The owner takes that whole list at once when its local
+ * list runs empty, so freed blocks are recycled without ever going back to
+ * malloc. Chunks are kept for the lifetime of the process.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-28
+ */
+
+#include "commons.h"
+
+/* Arena of the calling thread, created on its first allocation */
+static __thread arena_t *threadArena = NULL;
+
+/**
+ * @brief Gets the arena of the calling thread, creating it if needed.
+ *
+ * @return Returns a pointer to the arena.
+ */
+arena_t* arena_current() {
+    if (threadArena == NULL) {
+        threadArena = (arena_t*)calloc(1, sizeof(arena_t));
+        if (threadArena == NULL) {
+            lerror("Failed to allocate memory for arena", true);
+        }
+    }
+    return threadArena;
+}
+
+/**
+ * @brief Allocates a block from the arena of the calling thread.
+ *
+ * The block comes from the local free list of its size class, then from
+ * the blocks other threads have returned, and only if both are empty it is
+ * carved from a chunk. Blocks bigger than the largest class are allocated
+ * with malloc.
+ *
+ * @param size Size in bytes of the block.
+ *
+ * @return Returns a pointer to the block, aligned to 16 bytes.
+ */
+void* arena_alloc(size_t size) {
+    arena_t *arena = arena_current();
+    arena_block_t *block;
+    size_t size_class = 0, block_size = ARENA_MIN_BLOCK;
+
+    STATS_ADD(arenaAllocs, 1);
+    while (block_size < size + sizeof(arena_block_t)) {
+        size_class++;
+        block_size <<= 1;
+    }
+
+    if (size_class >= ARENA_CLASSES) {
+        if ((block = (arena_block_t*)malloc(sizeof(arena_block_t) + size)) == NULL) {
+            lerror("Failed to allocate memory for task argument", true);
+        }
+        block->owner = NULL;
+        return block + 1;
+    }
+
+    if ((block = arena->free[size_class]) == NULL) {
+        block = __atomic_exchange_n(&arena->remote[size_class], NULL, __ATOMIC_ACQUIRE);
+    }
+    if (block != NULL) {
+        arena->free[size_class] = block->next;
+        STATS_ADD(arenaHits, 1);
+        return block + 1;
+    }
+
+    /* Carve a new block, the rest of a too small chunk is left unused */
+    if (arena->left < block_size) {
+        if ((arena->chunk = (char*)malloc(ARENA_CHUNK)) == NULL) {
+            lerror("Failed to allocate memory for arena", true);
+        }
+        arena->left = ARENA_CHUNK;
+    }
+    block = (arena_block_t*)arena->chunk;
+    arena->chunk += block_size;
+    arena->left -= block_size;
+    block->owner = arena;
+    block->size_class = size_class;
+    return block + 1;
+}
+
+/**
+ * @brief Returns a block to the arena it was allocated from.
+ *
+ * Blocks of the calling thread go back to its local free list. Blocks of
+ * another thread are pushed to the remote list of their owner.
+ *
+ * @param pointer Pointer returned by arena_alloc, or NULL.
+ */
+void arena_free(void *pointer) {
+    arena_block_t *block, *head;
+    arena_t *owner;
+
+    if (pointer == NULL) {
+        return;
+    }
+    block = (arena_block_t*)pointer - 1;
+    if ((owner = block->owner) == NULL) {
+        free(block);
+        return;
+    }
+
+    if (owner == threadArena) {
+        block->next = owner->free[block->size_class];
+        owner->free[block->size_class] = block;
+        return;
+    }
+
+    /* The owner only takes the whole list, so a plain push is ABA free */
+    head = __atomic_load_n(&owner->remote[block->size_class], __ATOMIC_RELAXED);
+    do {
+        block->next = head;
+    } while (!__atomic_compare_exchange_n(&owner->remote[block->size_class], &head, block, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    STATS_ADD(arenaRemoteFrees, 1);
+}
@@ -0,0 +1,65 @@
+/**
+ * @file arena.h
+ * @brief Header file for the per-thread task argument allocator.
+ *
+ * This header file contains declarations for functions and structures
+ * related to the allocation of the arguments passed to the thread pool.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-28
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include "commons.h"
+
+#define ARENA_MIN_BLOCK 64 /* Size in bytes of the smallest block, header included. */
+#define ARENA_CLASSES 9 /* Number of size classes, from ARENA_MIN_BLOCK to ARENA_MIN_BLOCK << (ARENA_CLASSES - 1). */
+#define ARENA_CHUNK 65536 /* Bytes requested to malloc when a class runs out of blocks. */
+
+struct arena;
+
+/**
+ * @brief Header stored before every allocated block.
+ */
+typedef struct arena_block {
+    struct arena *owner; /* Arena the block returns to, NULL if it was allocated with malloc. */
+    struct arena_block *next; /* Next block of a free list. */
+    size_t size_class; /* Size class of the block. */
+    size_t pad; /* Keeps the payload aligned to 16 bytes. */
+} arena_block_t;
+
+/**
+ * @brief Represents the blocks owned by a thread.
+ */
+typedef struct arena {
+    arena_block_t *free[ARENA_CLASSES]; /* Free lists, only used by the owner thread. */
+    char *chunk; /* Unused part of the last chunk. */
+    size_t left; /* Bytes left in chunk. */
+    char pad[CACHE_LINE];
+    arena_block_t *remote[ARENA_CLASSES]; /* Blocks freed by other threads, taken by the owner all at once. */
+} arena_t;
+
+/* Function declarations */
+
+/**
+ * @brief Allocates a block from the arena of the calling thread.
+ *
+ * @param size Size in bytes of the block.
+ *
+ * @return Returns a pointer to the block, aligned to 16 bytes.
+ */
+void* arena_alloc(size_t size);
+
+/**
+ * @brief Returns a block to the arena it was allocated from.
+ *
+ * Can be called from any thread.
+ *
+ * @param pointer Pointer returned by arena_alloc, or NULL.
+ */
+void arena_free(void *pointer);
+
+#endif /* ARENA_H_ */
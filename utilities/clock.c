@@ -0,0 +1,148 @@
+/**
+ * @file clock.c
+ * @brief Methods file for the cached server clock.
+ *
+ * Every log line and stored record needs the current time as a string.
+ * Instead of calling time, localtime and strftime each time, the strings
+ * are formatted once per second, when a timer aligned to the wall clock
+ * seconds wakes up the reactor. "HH:MM:SS" and "dd-mm-yy" are exactly 8
+ * characters, so each one is published as a single 64 bit word: readers
+ * load it atomically into a buffer of their own thread, without locks and
+ * without ever seeing half a string.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-29
+ */
+
+#include "commons.h"
+
+/* Timer file descriptor, -1 until clock_start */
+static int clockFd = -1;
+
+/* Current time and date, 8 characters each without terminator */
+static uint64_t clockTime = 0;
+static uint64_t clockDate = 0;
+
+/* Copies returned to the calling thread */
+static __thread char threadTime[9];
+static __thread char threadDate[9];
+
+/**
+ * @brief Formats the current date and time into the cached strings.
+ *
+ * Uses localtime_r, so it can be called from any thread.
+ */
+void clock_refresh() {
+    time_t now = time(NULL);
+    struct tm local;
+    char str[9];
+    uint64_t word;
+
+    localtime_r(&now, &local);
+    strftime(str, sizeof(str), "%H:%M:%S", &local);
+    memcpy(&word, str, 8);
+    __atomic_store_n(&clockTime, word, __ATOMIC_RELEASE);
+    strftime(str, sizeof(str), "%d-%m-%y", &local);
+    memcpy(&word, str, 8);
+    __atomic_store_n(&clockDate, word, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Starts refreshing the cached strings at every second boundary.
+ *
+ * The timer uses the real time clock with an absolute first expiration at
+ * the next whole second, so the strings change when the wall clock does.
+ *
+ * @return Returns the timer file descriptor to poll, readable once per second.
+ */
+int clock_start() {
+    struct itimerspec spec;
+    struct timespec now;
+
+    clock_refresh();
+    if ((clockFd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+        lerror("Error creating clock file descriptor", true);
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+    spec.it_value.tv_sec = now.tv_sec + 1;
+    spec.it_value.tv_nsec = 0;
+    spec.it_interval.tv_sec = 1;
+    spec.it_interval.tv_nsec = 0;
+    if (timerfd_settime(clockFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        lerror("Error arming clock file descriptor", true);
+    }
+    return clockFd;
+}
+
+/**
+ * @brief Consumes the timer expiration and refreshes the cached strings.
+ */
+void clock_tick() {
+    uint64_t expirations;
+
+    if (read(clockFd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        lerror("Error reading clock file descriptor", true);
+    }
+    clock_refresh();
+}
+
+/**
+ * @brief Gets the coarse monotonic time.
+ *
+ * @return Returns the milliseconds elapsed since an arbitrary fixed point.
+ */
+uint64_t clock_coarse() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Gets the coarse wall clock time.
+ *
+ * @return Returns the milliseconds elapsed since the epoch.
+ */
+uint64_t clock_wall() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Gets the current time in HH:MM:SS format.
+ *
+ * Before clock_start the time is formatted on every call.
+ *
+ * @return Pointer to a copy owned by the calling thread, valid until its next call.
+ */
+const char* clock_time() {
+    uint64_t word;
+
+    if (clockFd == -1) {
+        clock_refresh();
+    }
+    word = __atomic_load_n(&clockTime, __ATOMIC_ACQUIRE);
+    memcpy(threadTime, &word, 8);
+    threadTime[8] = '\0';
+    return threadTime;
+}
+
+/**
+ * @brief Gets the current date in dd-mm-yy format.
+ *
+ * Before clock_start the date is formatted on every call.
+ *
+ * @return Pointer to a copy owned by the calling thread, valid until its next call.
+ */
+const char* clock_date() {
+    uint64_t word;
+
+    if (clockFd == -1) {
+        clock_refresh();
+    }
+    word = __atomic_load_n(&clockDate, __ATOMIC_ACQUIRE);
+    memcpy(threadDate, &word, 8);
+    threadDate[8] = '\0';
+    return threadDate;
+}
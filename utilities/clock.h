@@ -0,0 +1,69 @@
+/**
+ * @file clock.h
+ * @brief Header file for the cached server clock.
+ *
+ * This header file contains declarations for functions that give the
+ * current date and time as preformatted strings, refreshed once per second
+ * by the reactor, and a cheap coarse monotonic timestamp.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-29
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include "commons.h"
+
+/* Function declarations */
+
+/**
+ * @brief Formats the current date and time into the cached strings.
+ */
+void clock_refresh();
+
+/**
+ * @brief Starts refreshing the cached strings at every second boundary.
+ *
+ * @return Returns the timer file descriptor to poll, readable once per second.
+ */
+int clock_start();
+
+/**
+ * @brief Consumes the timer expiration and refreshes the cached strings.
+ */
+void clock_tick();
+
+/**
+ * @brief Gets the coarse monotonic time.
+ *
+ * Lags timers_now by at most a scheduler tick, but doesn't need to read the
+ * hardware clock.
+ *
+ * @return Returns the milliseconds elapsed since an arbitrary fixed point.
+ */
+uint64_t clock_coarse();
+
+/**
+ * @brief Gets the coarse wall clock time.
+ *
+ * @return Returns the milliseconds elapsed since the epoch.
+ */
+uint64_t clock_wall();
+
+/**
+ * @brief Gets the current time in HH:MM:SS format.
+ *
+ * @return Pointer to a copy owned by the calling thread, valid until its next call.
+ */
+const char* clock_time();
+
+/**
+ * @brief Gets the current date in dd-mm-yy format.
+ *
+ * @return Pointer to a copy owned by the calling thread, valid until its next call.
+ */
+const char* clock_date();
+
+#endif /* CLOCK_H_ */
@@ -13,36 +13,63 @@
 #ifndef COMMONS_H
 #define COMMONS_H
 
+/* Expose Linux specific interfaces (epoll, timerfd...) */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 /*System Standard Libraries*/
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <signal.h>
 
 #include <string.h>
 #include <stdbool.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <stdint.h>
 
 #include <time.h>
+#include <math.h>
 
 #include <threads.h>
 
 #include <arpa/inet.h>
+#include <sys/socket.h>
 #include <sys/select.h>
-
-/* Define global mutex between threads */
-extern mtx_t mutex;
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <glob.h>
+#include <sys/random.h>
 
 /*Own Libraries*/
 #include "threadpool.h"
+#include "arena.h"
+#include "reactor.h"
+#include "timers.h"
+#include "clock.h"
+#include "logger.h"
+#include "stats.h"
+#include "gorilla.h"
 #include "pdu/udp.h"
 #include "pdu/tcp.h"
+#include "pdu/validate.h"
 #include "server/controllers.h"
+#include "server/wal.h"
+#include "server/rollup.h"
+#include "server/chunk.h"
+#include "server/tsdb.h"
+#include "server/history.h"
 #include "server/conf.h"
 #include "server/subs.h"
 #include "server/commands.h"
 #include "server/data.h"
+#include "server/storage.h"
 #include "logs.h"
 
 
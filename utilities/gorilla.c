@@ -0,0 +1,295 @@
+/**
+ * @file gorilla.c
+ * @brief Methods file for the time and value compression of the time-series chunks.
+ *
+ * Readings arrive at a fairly regular interval and their values change
+ * slowly, so most of the bytes of a column repeat the previous row. The
+ * timestamps are stored as the difference between consecutive deltas with a
+ * variable length prefix, and the numbers as the XOR with the previous one,
+ * keeping only the bits between its leading and trailing zeros. That is the
+ * scheme of Facebook's Gorilla, with buckets sized for milliseconds.
+ *
+ * Timestamp, after the first one stored in 64 bits:
+ *      - 0: Same delta as the previous row.
+ *      - 10 + 7 bits, 110 + 9 bits, 1110 + 12 bits, 11110 + 32 bits: Delta of deltas in two's complement.
+ *      - 11111 + 64 bits: Any other delta of deltas.
+ *
+ * Value:
+ *      - 0 0: Same number as the previous one.
+ *      - 0 10 + bits: XOR with the previous number, inside the previous window of meaningful bits.
+ *      - 0 11 + 5 bits leading zeros + 6 bits length - 1 + bits: XOR with a new window.
+ *      - 1 0: Same text as the previous value that wasn't a number.
+ *      - 1 1 + 3 bits length + characters: A value that isn't a number.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "commons.h"
+
+/**
+ * @brief Starts a stream.
+ *
+ * @param stream The stream.
+ * @param bytes The bytes of the stream.
+ * @param length Size in bytes, zeroed if it's going to be written.
+ * @param write Whether the stream is written.
+ */
+void gorilla_open(gorilla_stream_t *stream, const void *bytes, size_t length, bool write) {
+    stream->bytes = (unsigned char*)bytes;
+    stream->length = length;
+    stream->bits = 0;
+    stream->overflow = false;
+    if (write) {
+        memset(stream->bytes, 0, length);
+    }
+}
+
+/**
+ * @brief Appends the low bits of a value to a stream.
+ *
+ * @param stream The stream, with room for them.
+ * @param value The value.
+ * @param count Number of bits, 1-64.
+ */
+void gorilla_put(gorilla_stream_t *stream, uint64_t value, int count) {
+    int room, n;
+
+    while (count > 0) {
+        room = 8 - (int)(stream->bits & 7);
+        n = count < room ? count : room;
+        stream->bytes[stream->bits >> 3] |= (unsigned char)(((value >> (count - n)) & ((1u << n) - 1)) << (room - n));
+        stream->bits += n;
+        count -= n;
+    }
+}
+
+/**
+ * @brief Reads bits from a stream.
+ *
+ * @param stream The stream, overflow is set if it has less bits left.
+ * @param count Number of bits, 1-64.
+ *
+ * @return Returns the bits as the low bits of the value, 0 on overflow.
+ */
+uint64_t gorilla_get(gorilla_stream_t *stream, int count) {
+    uint64_t value = 0;
+    int room, n;
+
+    if (stream->bits + count > stream->length * 8) {
+        stream->overflow = true;
+        return 0;
+    }
+    while (count > 0) {
+        room = 8 - (int)(stream->bits & 7);
+        n = count < room ? count : room;
+        value = (value << n) | ((stream->bytes[stream->bits >> 3] >> (room - n)) & ((1u << n) - 1));
+        stream->bits += n;
+        count -= n;
+    }
+    return value;
+}
+
+/**
+ * @brief Sign extends the low bits of a value.
+ *
+ * @param value The value.
+ * @param count Number of bits of the value, 1-63.
+ *
+ * @return Returns the value as a signed integer.
+ */
+int64_t gorilla_signed(uint64_t value, int count) {
+    uint64_t sign = (uint64_t)1 << (count - 1);
+
+    return (int64_t)((value ^ sign) - sign);
+}
+
+/**
+ * @brief Encodes a column of timestamps.
+ *
+ * @param times The timestamps.
+ * @param count Number of timestamps.
+ * @param out Where the stream is written, at least GORILLA_TIME_BYTES(count) bytes.
+ *
+ * @return Returns the size in bytes of the stream.
+ */
+size_t gorilla_encode_times(const uint64_t *times, int count, void *out) {
+    gorilla_stream_t stream;
+    int64_t delta = 0, dod;
+    int i;
+
+    gorilla_open(&stream, out, GORILLA_TIME_BYTES(count), true);
+    if (count == 0) {
+        return 0;
+    }
+    gorilla_put(&stream, times[0], 64);
+    for (i = 1; i < count; i++) {
+        dod = (int64_t)(times[i] - times[i - 1]) - delta;
+        delta = (int64_t)(times[i] - times[i - 1]);
+        if (dod == 0) {
+            gorilla_put(&stream, 0, 1);
+        } else if (dod >= -64 && dod < 64) {
+            gorilla_put(&stream, 2, 2);
+            gorilla_put(&stream, (uint64_t)dod, 7);
+        } else if (dod >= -256 && dod < 256) {
+            gorilla_put(&stream, 6, 3);
+            gorilla_put(&stream, (uint64_t)dod, 9);
+        } else if (dod >= -2048 && dod < 2048) {
+            gorilla_put(&stream, 14, 4);
+            gorilla_put(&stream, (uint64_t)dod, 12);
+        } else if (dod >= -((int64_t)1 << 31) && dod < ((int64_t)1 << 31)) {
+            gorilla_put(&stream, 30, 5);
+            gorilla_put(&stream, (uint64_t)dod, 32);
+        } else {
+            gorilla_put(&stream, 31, 5);
+            gorilla_put(&stream, (uint64_t)dod, 64);
+        }
+    }
+    return (stream.bits + 7) / 8;
+}
+
+/**
+ * @brief Decodes a column of timestamps.
+ *
+ * @param in The stream.
+ * @param length Size in bytes of the stream.
+ * @param times Where the timestamps are stored.
+ * @param count Number of timestamps.
+ *
+ * @return Returns false if the stream ends before count timestamps.
+ */
+bool gorilla_decode_times(const void *in, size_t length, uint64_t *times, int count) {
+    /* Bits of the delta of deltas after a prefix of 1 to 5 ones */
+    static const int widths[] = {7, 9, 12, 32, 64};
+    gorilla_stream_t stream;
+    int64_t delta = 0;
+    int i, ones;
+
+    gorilla_open(&stream, in, length, false);
+    if (count == 0) {
+        return true;
+    }
+    times[0] = gorilla_get(&stream, 64);
+    for (i = 1; i < count && !stream.overflow; i++) {
+        ones = 0;
+        while (ones < 5 && gorilla_get(&stream, 1) == 1) {
+            ones++;
+        }
+        if (ones > 0) {
+            delta += ones == 5 ? (int64_t)gorilla_get(&stream, 64) : gorilla_signed(gorilla_get(&stream, widths[ones - 1]), widths[ones - 1]);
+        }
+        times[i] = times[i - 1] + (uint64_t)delta;
+    }
+    return !stream.overflow;
+}
+
+/**
+ * @brief Encodes a column of values.
+ *
+ * @param values The numbers.
+ * @param textMap Bitmap of the values that aren't numbers, or NULL if all of them are.
+ * @param text The values that aren't numbers, they can be empty.
+ * @param count Number of values.
+ * @param out Where the stream is written, at least GORILLA_VALUE_BYTES(count) bytes.
+ *
+ * @return Returns the size in bytes of the stream.
+ */
+size_t gorilla_encode_values(const double *values, const unsigned char *textMap, const char (*text)[8], int count, void *out) {
+    gorilla_stream_t stream;
+    uint64_t previous = 0, current, difference;
+    const char *lastText = NULL;
+    int i, leading, trailing, windowLeading = -1, windowTrailing = 0, length, c;
+
+    gorilla_open(&stream, out, GORILLA_VALUE_BYTES(count), true);
+    for (i = 0; i < count; i++) {
+        if (textMap != NULL && GORILLA_IS_TEXT(textMap, i)) {
+            if (lastText != NULL && strncmp(lastText, text[i], 8) == 0) {
+                gorilla_put(&stream, 2, 2);
+                continue;
+            }
+            length = (int)strnlen(text[i], 7);
+            gorilla_put(&stream, 3, 2);
+            gorilla_put(&stream, (uint64_t)length, 3);
+            for (c = 0; c < length; c++) {
+                gorilla_put(&stream, (unsigned char)text[i][c], 8);
+            }
+            lastText = text[i];
+            continue;
+        }
+
+        memcpy(&current, &values[i], 8);
+        difference = current ^ previous;
+        previous = current;
+        if (difference == 0) {
+            gorilla_put(&stream, 0, 2);
+            continue;
+        }
+        leading = __builtin_clzll(difference);
+        trailing = __builtin_ctzll(difference);
+        leading = leading > 31 ? 31 : leading;
+        if (windowLeading >= 0 && leading >= windowLeading && trailing >= windowTrailing) {
+            gorilla_put(&stream, 2, 3);
+            gorilla_put(&stream, difference >> windowTrailing, 64 - windowLeading - windowTrailing);
+        } else {
+            windowLeading = leading;
+            windowTrailing = trailing;
+            gorilla_put(&stream, 3, 3);
+            gorilla_put(&stream, (uint64_t)leading, 5);
+            gorilla_put(&stream, (uint64_t)(63 - leading - trailing), 6);
+            gorilla_put(&stream, difference >> trailing, 64 - leading - trailing);
+        }
+    }
+    return (stream.bits + 7) / 8;
+}
+
+/**
+ * @brief Decodes a column of values.
+ *
+ * @param in The stream.
+ * @param length Size in bytes of the stream.
+ * @param values Where the numbers are stored, 0 for the values that aren't.
+ * @param textMap Where the bitmap of the values that aren't numbers is stored.
+ * @param text Where the values that aren't numbers are stored, empty for numbers.
+ * @param count Number of values.
+ *
+ * @return Returns false if the stream ends before count values.
+ */
+bool gorilla_decode_values(const void *in, size_t length, double *values, unsigned char *textMap, char (*text)[8], int count) {
+    gorilla_stream_t stream;
+    uint64_t previous = 0;
+    char lastText[8] = "";
+    int i, c, size, windowLeading = 0, windowTrailing = 0;
+
+    gorilla_open(&stream, in, length, false);
+    for (i = 0; i < count && !stream.overflow; i++) {
+        if (gorilla_get(&stream, 1) == 1) {
+            if (gorilla_get(&stream, 1) == 1) {
+                memset(lastText, 0, sizeof(lastText));
+                size = (int)gorilla_get(&stream, 3);
+                for (c = 0; c < size; c++) {
+                    lastText[c] = (char)gorilla_get(&stream, 8);
+                }
+            }
+            memcpy(text[i], lastText, 8);
+            GORILLA_SET_TEXT(textMap, i, true);
+            values[i] = 0;
+            continue;
+        }
+
+        text[i][0] = '\0';
+        GORILLA_SET_TEXT(textMap, i, false);
+        if (gorilla_get(&stream, 1) == 1) {
+            if (gorilla_get(&stream, 1) == 1) {
+                windowLeading = (int)gorilla_get(&stream, 5);
+                windowTrailing = 63 - windowLeading - (int)gorilla_get(&stream, 6);
+                if (windowTrailing < 0) {
+                    return false;
+                }
+            }
+            previous ^= gorilla_get(&stream, 64 - windowLeading - windowTrailing) << windowTrailing;
+        }
+        memcpy(&values[i], &previous, 8);
+    }
+    return !stream.overflow;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file gorilla.h
+ * @brief Header file for the time and value compression of the time-series chunks.
+ *
+ * This header file contains declarations for the bit stream codecs of a
+ * column of timestamps (delta of deltas) and a column of values (XOR of
+ * consecutive floats, with raw strings for the values that aren't numbers).
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#ifndef GORILLA_H_
+#define GORILLA_H_
+
+#include "commons.h"
+
+/* Worst case bytes of count encoded timestamps: 64 bits each plus a 5 bit prefix. */
+#define GORILLA_TIME_BYTES(count) (((size_t)(count) * 69 + 7) / 8)
+/* Worst case bytes of count encoded values: 64 meaningful bits plus 14 bits of prefix and window. */
+#define GORILLA_VALUE_BYTES(count) (((size_t)(count) * 78 + 7) / 8)
+/* Bytes of a bitmap with a bit for each of count values, set for the values that aren't numbers. */
+#define GORILLA_MAP_BYTES(count) (((size_t)(count) + 7) / 8)
+/* Whether value i of a bitmap isn't a number. */
+#define GORILLA_IS_TEXT(map, i) (((map)[(i) / 8] >> ((i) % 8)) & 1)
+/* Marks value i of a bitmap as a number or not. */
+#define GORILLA_SET_TEXT(map, i, isText) \
+    ((map)[(i) / 8] = (unsigned char)(((map)[(i) / 8] & ~(1 << ((i) % 8))) | ((isText) ? 1 << ((i) % 8) : 0)))
+
+/**
+ * @brief Represents a bit stream being written or read, most significant bit first.
+ */
+typedef struct gorilla_stream {
+    unsigned char *bytes; /* The stream, zeroed before writing. */
+    size_t length; /* Size in bytes of the stream. */
+    size_t bits; /* Bits written or read so far. */
+    bool overflow; /* A read went past the end of the stream. */
+} gorilla_stream_t;
+
+/* Function declarations */
+
+/**
+ * @brief Encodes a column of timestamps.
+ *
+ * The first timestamp is stored as is and the others as the difference
+ * between their delta and the previous one, a single bit when they arrive
+ * at a regular interval.
+ *
+ * @param times The timestamps.
+ * @param count Number of timestamps.
+ * @param out Where the stream is written, at least GORILLA_TIME_BYTES(count) bytes.
+ *
+ * @return Returns the size in bytes of the stream.
+ */
+size_t gorilla_encode_times(const uint64_t *times, int count, void *out);
+
+/**
+ * @brief Decodes a column of timestamps.
+ *
+ * @param in The stream.
+ * @param length Size in bytes of the stream.
+ * @param times Where the timestamps are stored.
+ * @param count Number of timestamps.
+ *
+ * @return Returns false if the stream ends before count timestamps.
+ */
+bool gorilla_decode_times(const void *in, size_t length, uint64_t *times, int count);
+
+/**
+ * @brief Encodes a column of values.
+ *
+ * A number is stored as the XOR with the previous number, a single bit when
+ * it's repeated and only its meaningful bits otherwise. A value that isn't a
+ * number is stored as its raw characters, or a single bit when it's the same
+ * as the previous one.
+ *
+ * @param values The numbers.
+ * @param textMap Bitmap of the values that aren't numbers, or NULL if all of them are.
+ * @param text The values that aren't numbers, they can be empty.
+ * @param count Number of values.
+ * @param out Where the stream is written, at least GORILLA_VALUE_BYTES(count) bytes.
+ *
+ * @return Returns the size in bytes of the stream.
+ */
+size_t gorilla_encode_values(const double *values, const unsigned char *textMap, const char (*text)[8], int count, void *out);
+
+/**
+ * @brief Decodes a column of values.
+ *
+ * @param in The stream.
+ * @param length Size in bytes of the stream.
+ * @param values Where the numbers are stored, 0 for the values that aren't.
+ * @param textMap Where the bitmap of the values that aren't numbers is stored.
+ * @param text Where the values that aren't numbers are stored, empty for numbers.
+ * @param count Number of values.
+ *
+ * @return Returns false if the stream ends before count values.
+ */
+bool gorilla_decode_values(const void *in, size_t length, double *values, unsigned char *textMap, char (*text)[8], int count);
+
+#endif /* GORILLA_H_ */
@@ -0,0 +1,484 @@
+/**
+ * @file logger.c
+ * @brief Methods file for the asynchronous log backend.
+ *
+ * Writing a log line to a slow terminal or file used to stall the thread
+ * that logged it, often while it held a controller lock. Here every thread
+ * formats its message into a record of its own ring, which takes no lock,
+ * and a flusher thread takes the records of all the rings in their global
+ * order and writes them in large batches. The flusher sleeps until a thread
+ * logs after a quiet period, and then gives the rings LOGGER_INTERVAL
+ * milliseconds to fill up before each batch. When a ring is full the record
+ * is dropped and counted, or the thread waits for room, as configured.
+ *
+ * In binary mode the message isn't formatted at all: the record keeps an
+ * identifier of the format string, given by its address, and the raw
+ * arguments, and the flusher appends them to the binary log with the format
+ * string the first time it's used. logdecode turns the file back into text.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.2
+ * @date 2024-4-29
+ */
+
+#include "commons.h"
+
+/* Longest line written for a record */
+#define LOGGER_LINE (LOGGER_TEXT + 32)
+
+/* Rings of every thread that has logged, kept for the lifetime of the process */
+static log_ring_t *rings = NULL;
+
+/* Ring of the calling thread, created on its first record */
+static __thread log_ring_t *threadRing = NULL;
+
+/* Next sequence number of a record */
+static uint64_t sequence = 0;
+
+/* Set once the flusher thread runs, until then lines are written synchronously */
+static bool started = false;
+
+/* Set while the flusher waits for a record without timeout */
+static bool idle = false;
+
+static logger_policy_t overflow = LOGGER_DROP;
+
+/* Binary log, NULL in text mode */
+static FILE *binary = NULL;
+
+/* Format of every identifier, found by open addressing on its address */
+static const char *formats[LOGGER_FORMATS] = {"%s"};
+
+/* Identifiers whose format is already in the binary log, used by the flusher */
+static bool defined[LOGGER_FORMATS];
+
+/* Number of the next ring */
+static unsigned int ringsCreated = 0;
+
+static const char *levels[] = {"Info", "Warning"};
+
+static thrd_t flusherThread;
+static mtx_t logLock; /* Held while the rings are drained, so there's a single consumer. */
+static cnd_t wake; /* Condition variable where the flusher waits. */
+static cnd_t space; /* Condition variable where blocked threads wait for room. */
+
+/**
+ * @brief Writes a log line directly to its stream.
+ *
+ * @param stream Stream the line goes to.
+ * @param level Level of the line.
+ * @param format The format of the message.
+ * @param args Arguments of the format.
+ */
+void writeSync(FILE *stream, logger_level_t level, const char *format, va_list args) {
+    flockfile(stream); /* Keep the line together without any server lock */
+    fprintf(stream, "[%s] [%s] ", clock_time(), levels[level]);
+    vfprintf(stream, format, args);
+    fprintf(stream, "\n");
+    funlockfile(stream);
+}
+
+/**
+ * @brief Gets the ring of the calling thread, creating it if needed.
+ *
+ * @return Returns a pointer to the ring.
+ */
+log_ring_t* logger_ring() {
+    log_ring_t *head;
+
+    if (threadRing == NULL) {
+        if ((threadRing = (log_ring_t*)calloc(1, sizeof(log_ring_t))) == NULL) {
+            lerror("Failed to allocate memory for log ring", true);
+        }
+        threadRing->id = __atomic_fetch_add(&ringsCreated, 1, __ATOMIC_RELAXED);
+        head = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        do {
+            threadRing->next = head;
+        } while (!__atomic_compare_exchange_n(&rings, &head, threadRing, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    return threadRing;
+}
+
+/**
+ * @brief Gets the identifier of a format string.
+ *
+ * The first thread that uses a format claims a free slot with a compare and
+ * swap, the next lookups find it probing from the same hash of the address.
+ *
+ * @param format The format, a string literal.
+ *
+ * @return Returns the identifier, or LOGGER_FORMATS if every slot is taken.
+ */
+unsigned int logger_format(const char *format) {
+    unsigned int i = (unsigned int)((uintptr_t)format >> 3) & (LOGGER_FORMATS - 1);
+    unsigned int probes;
+    const char *seen;
+
+    for (probes = 0; probes < LOGGER_FORMATS; probes++, i = (i + 1) & (LOGGER_FORMATS - 1)) {
+        seen = __atomic_load_n(&formats[i], __ATOMIC_ACQUIRE);
+        if (seen == NULL && __atomic_compare_exchange_n(&formats[i], &seen, format, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            return i;
+        }
+        /* On a failed swap, seen holds the format of the thread that won the slot */
+        if (seen == format) {
+            return i;
+        }
+    }
+    return LOGGER_FORMATS;
+}
+
+/**
+ * @brief Packs the arguments of a format into a record, without formatting them.
+ *
+ * Every conversion is checked before any argument is read. Formats with
+ * conversions that can't be packed, like a '*' width, are formatted as text
+ * and stored as the single argument of "%s". Arguments that don't fit in
+ * the record are left out.
+ *
+ * @param record The record.
+ * @param format The format, a string literal.
+ * @param args Arguments of the format.
+ */
+void packArgs(log_record_t *record, const char *format, va_list args) {
+    char kinds[LOGGER_ARGS];
+    int count = 0, i;
+    const char *c, *str;
+    int64_t integer;
+    double real;
+    uint16_t length;
+    size_t modifiers, m;
+    bool isLong;
+
+    record->format = logger_format(format);
+    for (c = format; record->format != LOGGER_FORMATS && *c != '\0'; c++) {
+        if (*c != '%') {
+            continue;
+        }
+        modifiers = strspn(c + 1, "-+ #0123456789.hljzt");
+        if (c[modifiers + 1] == '%' && modifiers == 0) {
+            c++;
+            continue;
+        }
+        if (count == LOGGER_ARGS || c[modifiers + 1] == '\0' || strchr("diouxXcsfeEgGp", c[modifiers + 1]) == NULL) {
+            record->format = LOGGER_FORMATS;
+            break;
+        }
+        /* Integers are read with their own size, longs when a long modifier is present */
+        isLong = false;
+        for (m = 1; m <= modifiers; m++) {
+            if (strchr("ljzt", c[m]) != NULL) {
+                isLong = true;
+            }
+        }
+        c += modifiers + 1;
+        if (*c == 'd' || *c == 'i' || *c == 'c') {
+            kinds[count++] = isLong ? 'D' : 'd';
+        } else if (*c == 's' || *c == 'p') {
+            kinds[count++] = *c;
+        } else if (strchr("ouxX", *c) != NULL) {
+            kinds[count++] = isLong ? 'U' : 'u';
+        } else {
+            kinds[count++] = 'f';
+        }
+    }
+
+    if (record->format == LOGGER_FORMATS) {
+        record->format = LOGGER_TEXT_FORMAT;
+        vsnprintf(record->text + 2, LOGGER_TEXT - 2, format, args);
+        length = (uint16_t)strlen(record->text + 2);
+        memcpy(record->text, &length, 2);
+        record->size = 2 + length;
+        return;
+    }
+
+    record->size = 0;
+    for (i = 0; i < count; i++) {
+        if (kinds[i] == 's') {
+            if ((str = va_arg(args, const char*)) == NULL) {
+                str = "(null)";
+            }
+            if (record->size + 2 > LOGGER_TEXT) {
+                break;
+            }
+            length = (uint16_t)strnlen(str, LOGGER_TEXT - record->size - 2);
+            memcpy(record->text + record->size, &length, 2);
+            memcpy(record->text + record->size + 2, str, length);
+            record->size += 2 + length;
+            continue;
+        }
+        if (record->size + 8 > LOGGER_TEXT) {
+            break;
+        }
+        switch (kinds[i]) {
+            case 'd': integer = va_arg(args, int); break;
+            case 'D': integer = va_arg(args, long); break;
+            case 'u': integer = va_arg(args, unsigned int); break;
+            case 'U': integer = (int64_t)va_arg(args, unsigned long); break;
+            case 'p': integer = (int64_t)(uintptr_t)va_arg(args, void*); break;
+            default:
+                real = va_arg(args, double);
+                memcpy(&integer, &real, 8);
+        }
+        memcpy(record->text + record->size, &integer, 8);
+        record->size += 8;
+    }
+}
+
+/**
+ * @brief Formats a record as a text line.
+ *
+ * @param out Buffer with room for LOGGER_TEXT + 32 bytes.
+ * @param record The record.
+ *
+ * @return Returns the length of the line.
+ */
+size_t textLine(char *out, const log_record_t *record) {
+    return sprintf(out, "[%s] [%s] %s\n", record->time, levels[record->level], record->text);
+}
+
+/**
+ * @brief Encodes a record as a binary log entry, preceded by its format if it's new.
+ *
+ * @param out Buffer with room for the entry and the format.
+ * @param ring The ring of the record.
+ * @param record The record.
+ *
+ * @return Returns the length of the entries.
+ */
+size_t binaryLine(char *out, const log_ring_t *ring, const log_record_t *record) {
+    uint16_t id = (uint16_t)record->format, size = (uint16_t)record->size, length;
+    uint32_t thread = ring->id;
+    size_t used = 0;
+
+    if (!defined[id]) {
+        length = (uint16_t)strlen(formats[id]);
+        out[used++] = LOGGER_FORMAT;
+        memcpy(out + used, &id, 2);
+        memcpy(out + used + 2, &length, 2);
+        memcpy(out + used + 4, formats[id], length);
+        used += 4 + length;
+        defined[id] = true;
+    }
+    out[used++] = LOGGER_RECORD;
+    out[used++] = (char)record->level;
+    memcpy(out + used, &id, 2);
+    memcpy(out + used + 2, &thread, 4);
+    memcpy(out + used + 6, &record->timestamp, 8);
+    memcpy(out + used + 14, &size, 2);
+    memcpy(out + used + 16, record->text, size);
+    return used + 16 + size;
+}
+
+/**
+ * @brief Writes the buffered lines to their stream.
+ *
+ * Nothing can be logged from here, a failed write is ignored.
+ *
+ * @param stream Stream the lines go to.
+ * @param buffer The lines.
+ * @param length Number of bytes in buffer.
+ */
+void writeBuffer(FILE *stream, const char *buffer, size_t length) {
+    if (length > 0) {
+        fwrite(buffer, 1, length, stream);
+        fflush(stream);
+    }
+}
+
+/**
+ * @brief Writes the records queued in every ring, in sequence order.
+ *
+ * The heads are read once at the start, records written after that are left
+ * for the next drain. Must be called with logLock held.
+ *
+ * @return Returns the number of records written.
+ */
+size_t drain() {
+    static char buffer[LOGGER_BUFFER];
+    log_ring_t *ring, *oldest, *first = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    log_record_t *record;
+    FILE *stream = NULL, *target;
+    size_t count = 0, length = 0, reserve;
+
+    for (ring = first; ring != NULL; ring = ring->next) {
+        ring->end = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    }
+
+    for (;;) {
+        /* Oldest record at the tail of any ring, a ring holds them in order */
+        oldest = NULL;
+        for (ring = first; ring != NULL; ring = ring->next) {
+            if (ring->tail != ring->end && (oldest == NULL ||
+                ring->records[ring->tail & (LOGGER_SLOTS - 1)].sequence < oldest->records[oldest->tail & (LOGGER_SLOTS - 1)].sequence)) {
+                oldest = ring;
+            }
+        }
+        if (oldest == NULL) {
+            break;
+        }
+
+        record = &oldest->records[oldest->tail & (LOGGER_SLOTS - 1)];
+        target = binary != NULL ? binary : record->stream;
+        reserve = LOGGER_LINE;
+        if (binary != NULL && !defined[record->format]) {
+            reserve += 5 + strlen(formats[record->format]);
+        }
+        if (target != stream || length + reserve > LOGGER_BUFFER) {
+            writeBuffer(stream, buffer, length);
+            stream = target;
+            length = 0;
+        }
+        if (binary != NULL) {
+            length += binaryLine(buffer + length, oldest, record);
+        } else {
+            length += textLine(buffer + length, record);
+        }
+        /* The record is copied, its slot can be reused */
+        __atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);
+        count++;
+    }
+    writeBuffer(stream, buffer, length);
+
+    if (count > 0) {
+        cnd_broadcast(&space);
+    }
+    return count;
+}
+
+/**
+ * @brief Flusher thread function.
+ *
+ * @param arg Unused.
+ *
+ * @return Never returns, the thread ends with the process.
+ */
+int flusher(void *arg) {
+    struct timespec deadline;
+
+    mtx_lock(&logLock);
+    for (;;) {
+        if (drain() > 0) {
+            /* Let the rings fill up before the next batch, a half full ring cuts the wait */
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LOGGER_INTERVAL * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            cnd_timedwait(&wake, &logLock, &deadline);
+            continue;
+        }
+        /* Announce the wait before the last check, a record published meanwhile is either drained here or signaled */
+        __atomic_store_n(&idle, true, __ATOMIC_SEQ_CST);
+        if (drain() == 0) {
+            cnd_wait(&wake, &logLock);
+        }
+        __atomic_store_n(&idle, false, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+/**
+ * @brief Starts the flusher thread, until then lines are written synchronously.
+ *
+ * A binary log starts every run with a session entry, so the file can be
+ * appended to and the decoder knows when the identifiers change.
+ *
+ * @param policy What a thread does when its ring is full.
+ * @param binaryPath File the lines are appended to in binary, or NULL to write them as text.
+ */
+void logger_start(logger_policy_t policy, const char *binaryPath) {
+    overflow = policy;
+    if (binaryPath != NULL) {
+        if ((binary = fopen(binaryPath, "ab")) == NULL) {
+            lerror("Error opening binary log %s", true, binaryPath);
+        }
+        fputc(LOGGER_SESSION, binary);
+        fputc(LOGGER_VERSION, binary);
+        fflush(binary);
+    }
+    mtx_init(&logLock, mtx_plain);
+    cnd_init(&wake);
+    cnd_init(&space);
+    if (thrd_create(&flusherThread, flusher, NULL) != thrd_success) {
+        lerror("Unexpected error while creating log flusher thread", true);
+    }
+    __atomic_store_n(&started, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Queues a log line in the ring of the calling thread.
+ *
+ * Doesn't take any lock unless the flusher is idle or the ring is full. In
+ * binary mode the format must be a string literal.
+ *
+ * @param stream Stream the line goes to in text mode.
+ * @param level Level of the line.
+ * @param format The format of the message.
+ * @param args Arguments of the format.
+ */
+void logger_write(FILE *stream, logger_level_t level, const char *format, va_list args) {
+    log_ring_t *ring;
+    log_record_t *record;
+    size_t head, used;
+
+    if (!__atomic_load_n(&started, __ATOMIC_ACQUIRE)) {
+        writeSync(stream, level, format, args);
+        return;
+    }
+
+    ring = logger_ring();
+    head = ring->head;
+    used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (used == LOGGER_SLOTS) {
+        if (overflow == LOGGER_DROP) {
+            STATS_ADD(logDropped, 1);
+            cnd_signal(&wake);
+            return;
+        }
+        STATS_ADD(logStalls, 1);
+        mtx_lock(&logLock);
+        while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == LOGGER_SLOTS) {
+            cnd_signal(&wake);
+            cnd_wait(&space, &logLock);
+        }
+        mtx_unlock(&logLock);
+    }
+
+    record = &ring->records[head & (LOGGER_SLOTS - 1)];
+    record->sequence = __atomic_fetch_add(&sequence, 1, __ATOMIC_RELAXED);
+    record->stream = stream;
+    record->level = level;
+    if (binary != NULL) {
+        record->timestamp = clock_wall();
+        packArgs(record, format, args);
+    } else {
+        memcpy(record->time, clock_time(), sizeof(record->time));
+        vsnprintf(record->text, LOGGER_TEXT, format, args);
+    }
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&idle, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&idle, false, __ATOMIC_SEQ_CST)) {
+        /* Under the lock, so the signal can't arrive before the flusher waits */
+        mtx_lock(&logLock);
+        cnd_signal(&wake);
+        mtx_unlock(&logLock);
+    } else if (used + 1 == LOGGER_SLOTS / 2) {
+        cnd_signal(&wake);
+    }
+}
+
+/**
+ * @brief Writes every queued line before returning.
+ *
+ * Lines queued by other threads while this runs may be left for the flusher.
+ */
+void logger_flush() {
+    if (!__atomic_load_n(&started, __ATOMIC_ACQUIRE)) {
+        fflush(stdout);
+        return;
+    }
+    mtx_lock(&logLock);
+    drain();
+    mtx_unlock(&logLock);
+}
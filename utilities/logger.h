@@ -0,0 +1,113 @@
+/**
+ * @file logger.h
+ * @brief Header file for the asynchronous log backend.
+ *
+ * This header file contains declarations for functions and structures
+ * related to the per-thread log rings and the thread that flushes them,
+ * and the layout of the binary log decoded by logdecode.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.2
+ * @date 2024-4-29
+ */
+
+#ifndef LOGGER_H_
+#define LOGGER_H_
+
+#include "commons.h"
+
+#define LOGGER_SLOTS 256 /* Records in the ring of each thread, must be a power of two. */
+#define LOGGER_TEXT 224 /* Size in bytes of the message or packed arguments of a record, longer ones are truncated. */
+#define LOGGER_INTERVAL 10 /* Milliseconds the flusher sleeps when no ring asks for a flush. */
+#define LOGGER_BUFFER 16384 /* Size in bytes of the buffer the flusher writes at once. */
+#define LOGGER_FORMATS 512 /* Distinct format strings the binary log can identify, must be a power of two. */
+#define LOGGER_ARGS 16 /* Maximum conversions of a format packed in binary, more are formatted as text. */
+
+/*
+Binary log entries, fields in host byte order:
+- 'S' u8 version: Start of a session, format identifiers are reset.
+- 'F' u16 id, u16 length, length bytes: Format string of an identifier.
+- 'R' u8 level, u16 id, u32 thread, u64 milliseconds since the epoch, u16 size, size bytes of arguments.
+Each argument is an 8 byte integer or double, or a u16 length followed by the bytes of a string.
+*/
+#define LOGGER_VERSION 1
+#define LOGGER_SESSION 'S'
+#define LOGGER_FORMAT 'F'
+#define LOGGER_RECORD 'R'
+#define LOGGER_TEXT_FORMAT 0 /* Identifier of "%s", used for messages whose format can't be packed. */
+
+/**
+ * @brief What a thread does when its ring is full.
+ */
+typedef enum {
+    LOGGER_DROP, /* Discard the record and count it. */
+    LOGGER_BLOCK /* Wait until the flusher makes room. */
+} logger_policy_t;
+
+/**
+ * @brief Level of a log line.
+ */
+typedef enum {
+    LOGGER_INFO,
+    LOGGER_WARNING
+} logger_level_t;
+
+/**
+ * @brief Represents a log line waiting to be written.
+ */
+typedef struct {
+    uint64_t sequence; /* Global order of the record, lines are written in this order. */
+    FILE *stream; /* Stream the line goes to in text mode. */
+    logger_level_t level; /* Level of the line. */
+    unsigned int format; /* Identifier of the format, binary mode only. */
+    uint64_t timestamp; /* Milliseconds since the epoch, binary mode only. */
+    size_t size; /* Bytes of packed arguments, binary mode only. */
+    char time[9]; /* Time the record was written, HH:MM:SS, text mode only. */
+    char text[LOGGER_TEXT]; /* Formatted message, or the packed arguments in binary mode. */
+} log_record_t;
+
+/**
+ * @brief Represents the bounded single-producer single-consumer ring of a thread.
+ */
+typedef struct log_ring {
+    log_record_t records[LOGGER_SLOTS]; /* Records, indexed by position modulo LOGGER_SLOTS. */
+    size_t head; /* Next position to write, updated by the owner thread. */
+    char pad0[CACHE_LINE - sizeof(size_t)];
+    size_t tail; /* Next position to flush, updated by the flusher. */
+    size_t end; /* Head seen by the flusher when the current drain started. */
+    char pad1[CACHE_LINE - 2 * sizeof(size_t)];
+    unsigned int id; /* Number of the owner thread in the binary log. */
+    struct log_ring *next; /* Next ring of the global list. */
+} log_ring_t;
+
+/* Function declarations */
+
+/**
+ * @brief Starts the flusher thread, until then lines are written synchronously.
+ *
+ * @param policy What a thread does when its ring is full.
+ * @param binaryPath File the lines are appended to in binary, or NULL to write them as text.
+ */
+void logger_start(logger_policy_t policy, const char *binaryPath);
+
+/**
+ * @brief Queues a log line in the ring of the calling thread.
+ *
+ * In binary mode the format is identified by its address, so it must be a
+ * string literal.
+ *
+ * @param stream Stream the line goes to in text mode.
+ * @param level Level of the line.
+ * @param format The format of the message.
+ * @param args Arguments of the format.
+ */
+void logger_write(FILE *stream, logger_level_t level, const char *format, va_list args);
+
+/**
+ * @brief Writes every queued line before returning.
+ *
+ * Can be called from any thread.
+ */
+void logger_flush();
+
+#endif /* LOGGER_H_ */
@@ -3,7 +3,8 @@
  * @brief Functions for logging error, warning, and info messages.
  * 
  * This file contains functions for logging error, warning, and info messages
- * with optional debug mode.
+ * with optional debug mode. Warnings and info messages are queued to the
+ * asynchronous logger, errors are written right away since they end the program.
  * 
  * @author Eric Bitria Ribes
  * @version 0.2
@@ -25,18 +26,12 @@ void enableDebug(){
 /**
  * @brief Function to get the current time in [Hour:Minute:Second] format.
  *
- * @return The current time in string format [Hour:Minute:Second]
+ * The string comes from the cached clock, formatted once per second.
+ *
+ * @return The current time in string format [Hour:Minute:Second], owned by the calling thread.
  */
-char* get_current_time() {
-    time_t rawtime;
-    struct tm * timeinfo;
-    static char time_str[9]; /*HH:MM:SS\0*/ 
-
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-
-    strftime(time_str, sizeof(time_str), "%H:%M:%S", timeinfo);
-    return time_str;
+const char* get_current_time() {
+    return clock_time();
 }
 
 /**
@@ -50,6 +45,8 @@ void lerror(const char *str, bool override, ...) {
     if (DEBUG || override) {
         va_list args;
         va_start(args, override);
+        /* Earlier lines first */
+        logger_flush();
         fprintf(stderr, "[%s] [Error] ", get_current_time());
         vfprintf(stderr, str, args);
         fprintf(stderr, ": ");
@@ -70,9 +67,7 @@ void lwarning(const char *str, bool override, ...) {
     if (DEBUG || override) {
         va_list args;
         va_start(args, override);
-        printf("[%s] [Warning] ", get_current_time());
-        vprintf(str, args);
-        printf("\n");
+        logger_write(stdout, LOGGER_WARNING, str, args);
         va_end(args);
     }
 }
@@ -88,9 +83,7 @@ void linfo(const char *str, bool override, ...) {
     if (DEBUG || override) {
         va_list args;
         va_start(args, override);
-        printf("[%s] [Info] ", get_current_time());
-        vprintf(str, args);
-        printf("\n");
+        logger_write(stdout, LOGGER_INFO, str, args);
         va_end(args);
     }
 }
\ No newline at end of file
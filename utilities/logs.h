@@ -26,9 +26,9 @@ void enableDebug();
 /**
  * @brief Function to get the current time in [Hour:Minute:Second] format.
  *
- * @return The current time in string format [Hour:Minute:Second]
+ * @return The current time in string format [Hour:Minute:Second], owned by the calling thread.
  */
-char* get_current_time();
+const char* get_current_time();
 
 /**
  * @brief Function to show error messages.
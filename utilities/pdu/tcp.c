@@ -12,166 +12,162 @@
 
 #include "../commons.h"
 
-#define PDUTCP 118
-
 /**
- * @brief Creates a TCPPacket structure with the provided information.
+ * @brief Encodes a TCP packet straight into a byte array.
  *
- * This function constructs and returns a TCPPacket structure with the specified
- * 'type', 'mac' address, 'rnd' data, and 'data' payload. It copies the provided
- * 'mac', 'rnd', and 'data' strings into the corresponding fields of the TCPPacket
- * structure.
+ * This function writes the 'type', 'mac' address, 'rnd' data, 'device', 'value'
+ * and 'data' payload into the caller's buffer with the PDU layout.
  * 
+ * @param bytes Pointer to a byte array of at least PDUTCP bytes.
  * @param type The type of the packet.
  * @param mac The MAC address string.
  * @param rnd The random data string.
  * @param device The device of the controller.
  * @param value The value associated to the device.
  * @param data The data payload string.
+ */
+void encodeTcp(char *bytes, const unsigned char type, const char *mac, const char *rnd, const char *device, const char *value, const char *data) {
+    bytes[0] = type;
+    encodeField(bytes + 1, mac, 13);
+    encodeField(bytes + 14, rnd, 9);
+    encodeField(bytes + 23, device, 8);
+    encodeField(bytes + 31, value, 7);
+    encodeField(bytes + 38, data, 80);
+}
+
+/**
+ * @brief Points a view to an encoded TCP packet and validates it in place.
+ *
+ * This function checks that the 'mac', 'rnd', 'device', 'value' and 'data' fields
+ * of the encoded packet are null terminated within their sizes, so the accessors can
+ * return pointers into 'bytes' that are safe to use as strings. Nothing is copied.
+ * 
+ * @param view Pointer to the view to initialize.
+ * @param bytes Pointer to PDUTCP bytes containing the encoded packet.
  * 
- * @return Returns a TCPPacket structure initialized with the provided information.
+ * @return Returns false if a string field isn't null terminated within its size.
  */
-struct TCPPacket* createTCPPacket(const unsigned char type, const char *mac, const char *rnd, const char *device, const char *value, const char *data){
-    struct TCPPacket* packet = malloc(sizeof(struct TCPPacket));
-    if (packet == NULL) {
-        return NULL;
-    }
-    packet->type = type;
-    strncpy(packet->mac, mac, sizeof(packet->mac) - 1);
-    packet->mac[sizeof(packet->mac) - 1] = '\0';
-    strncpy(packet->rnd, rnd, sizeof(packet->rnd) - 1);
-    packet->rnd[sizeof(packet->rnd) - 1] = '\0';
-    strncpy(packet->device, device, sizeof(packet->device) - 1);
-    packet->device[sizeof(packet->device) - 1] = '\0';
-    strncpy(packet->value, value, sizeof(packet->value) - 1);
-    packet->value[sizeof(packet->value) - 1] = '\0';
-    strncpy(packet->data, data, sizeof(packet->data) - 1);
-    packet->data[sizeof(packet->data) - 1] = '\0';
+bool tcpView(struct TCPView *view, const char *bytes) {
+    view->bytes = bytes;
+    return memchr(bytes + 1, '\0', 13) != NULL &&
+           memchr(bytes + 14, '\0', 9) != NULL &&
+           memchr(bytes + 23, '\0', 8) != NULL &&
+           memchr(bytes + 31, '\0', 7) != NULL &&
+           memchr(bytes + 38, '\0', 80) != NULL;
+}
 
-    return packet;
+/**
+ * @brief Gets the type of the viewed packet.
+ * 
+ * @param view Pointer to the view.
+ * @return The packet type.
+ */
+unsigned char tcpType(const struct TCPView *view) {
+    return (unsigned char)view->bytes[0];
 }
 
 /**
- * @brief Converts a TCPPacket struct to a byte array.
+ * @brief Gets the MAC address of the viewed packet.
  * 
- * @param packet Pointer to the TCPPacket struct to be converted.
- * @param bytes Pointer to the byte array where the TCPPacket struct will be converted.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
  */
-void tcpToBytes(struct TCPPacket *packet, char *bytes){
-    int offset = 0;
-    bytes[offset] = packet->type;
-    offset += sizeof(packet->type);
-    memcpy(bytes + offset, packet->mac, sizeof(packet->mac));
-    offset += sizeof(packet->mac);
-    memcpy(bytes + offset, packet->rnd, sizeof(packet->rnd));
-    offset += sizeof(packet->rnd);
-    memcpy(bytes + offset, packet->device, sizeof(packet->device));
-    offset += sizeof(packet->device);
-    memcpy(bytes + offset, packet->value, sizeof(packet->value));
-    offset += sizeof(packet->value);
-    memcpy(bytes + offset, packet->data, sizeof(packet->data));
+const char *tcpMac(const struct TCPView *view) {
+    return view->bytes + 1;
 }
 
 /**
- * @brief Converts a byte array to a TCPPacket struct.
- *
- * This function takes a byte array 'bytes' containing data representing
- * a TCPPacket struct. It decodes the byte array and populates the fields
- * of a TCPPacket struct accordingly. The byte array is expected to contain
- * serialized data in a specific format, and this function parses it to
- * reconstruct the original TCPPacket struct.
+ * @brief Gets the random identifier of the viewed packet.
  * 
- * @param bytes Pointer to the byte array containing the data to be converted.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
+ */
+const char *tcpRnd(const struct TCPView *view) {
+    return view->bytes + 14;
+}
+
+/**
+ * @brief Gets the device of the viewed packet.
  * 
- * @return Returns a TCPPacket struct with the data decoded from the byte array.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
  */
-struct TCPPacket* bytesToTcp(const char *bytes) {
-    int offset = 0;
-    struct TCPPacket* packet = malloc(sizeof(struct TCPPacket));
-    if (packet == NULL) {
-        return NULL;
-    }
-    packet->type = bytes[offset];
-    offset += sizeof(packet->type);
-    memcpy(packet->mac, bytes + offset, sizeof(packet->mac));
-    offset += sizeof(packet->mac);
-    memcpy(packet->rnd, bytes + offset, sizeof(packet->rnd));
-    offset += sizeof(packet->rnd);
-    memcpy(packet->device, bytes + offset, sizeof(packet->device));
-    offset += sizeof(packet->device);
-    memcpy(packet->value, bytes + offset, sizeof(packet->value));
-    offset += sizeof(packet->value);
-    memcpy(packet->data, bytes + offset, sizeof(packet->data));
-    return packet;
+const char *tcpDevice(const struct TCPView *view) {
+    return view->bytes + 23;
+}
+
+/**
+ * @brief Gets the value of the viewed packet.
+ * 
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
+ */
+const char *tcpValue(const struct TCPView *view) {
+    return view->bytes + 31;
+}
+
+/**
+ * @brief Gets the data payload of the viewed packet.
+ * 
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
+ */
+const char *tcpData(const struct TCPView *view) {
+    return view->bytes + 38;
 }
 
 /**
  * @brief Sends a TCP packet over the specified socket.
  *
- * This function converts the given TCPPacket struct to bytes using the tcpToBytes function,
- * then sends the resulting data over the specified socket. It ensures that the entire data
- * is sent by looping until all bytes are sent. If sending fails, it logs an error using the
- * lerror function and terminates the program if specified.
+ * This function encodes the packet into a stack buffer with encodeTcp, then
+ * sends the resulting data over the specified socket. If sending fails, it
+ * logs a warning.
  * 
  * @param socketFd The file descriptor of the socket to send data over.
- * @param packet The TCPPacket struct containing the data to send.
+ * @param type The type of the packet.
+ * @param mac The MAC address string.
+ * @param rnd The random data string.
+ * @param device The device of the controller.
+ * @param value The value associated to the device.
+ * @param data The data payload string.
  */
-void sendTcp(const int socketFd, struct TCPPacket* packet) {
-    char data[PDUTCP];
+void sendTcp(const int socketFd, const unsigned char type, const char *mac, const char *rnd, const char *device, const char *value, const char *data) {
+    char bytes[PDUTCP];
 
-    if (packet == NULL) {
-        lerror("Error: NULL packet provided to sendUdp", true);
-        return;
-    }
-
-    tcpToBytes(packet,data);
+    encodeTcp(bytes, type, mac, rnd, device, value, data);
 
-    if (send(socketFd, data, sizeof(data), 0) < 0) {
+    if (send(socketFd, bytes, sizeof(bytes), 0) < 0) {
         lwarning("send failed", true);
     }
-
-    free(packet);
 }
 
 /**
- * @brief Receives a TCP packet from a socket and converts it to a TCPPacket struct.
+ * @brief Receives a TCP packet from a socket into the caller's buffer.
  *
- * This function receives a TCP packet from the specified socket 'socketFd'.
- * The received packet is expected to be in byte array format, representing
- * a TCPPacket struct. It decodes the byte array and populates the fields
- * of a TCPPacket struct accordingly. The received byte array is decoded
- * using the bytesToTcp() function.
+ * This function receives a TCP packet from the specified socket 'socketFd'
+ * straight into 'bytes', where it can be read through a TCPView without
+ * decoding it. Short packets are padded with zeros.
  * 
  * @param socketFd The file descriptor of the socket from which to receive the packet.
+ * @param bytes Pointer to a byte array of PDUTCP bytes.
  * 
- * @return Returns a TCPPacket struct with the data decoded from the received byte array.
+ * @return Returns false if no packet was received (timeout or disconnection).
  */
-struct TCPPacket* recvTcp(const int *socketFd){
+bool recvTcp(const int *socketFd, char *bytes){
     int val;
-    char buffer[PDUTCP]; /* Init buffer */
 
     /* Execute packet reception */
-    val = recv(*socketFd, buffer, PDUTCP,0);
+    val = recv(*socketFd, bytes, PDUTCP,0);
     if ( val == 0 ) {
         lwarning("Host disconnected.",false);
-        return NULL;
+        return false;
     } else if ( val < 0 ) {
         if (errno == EAGAIN || errno == EWOULDBLOCK){
-            return NULL;
+            return false;
         } else {
             lerror("TCP recv failed", true);
         }
     }
-    /* Decode  and return bytes into PDU_UDP packet */
-    return bytesToTcp(buffer);
+    memset(bytes + val, 0, PDUTCP - val);
+    return true;
 }
-
-/* Debug */
-void printTCPPacket(struct TCPPacket packet) {
-    printf("Type: %u\n", packet.type);
-    printf("MAC: %s\n", packet.mac);
-    printf("RND: %s\n", packet.rnd);
-    printf("Device: %s\n", packet.device);
-    printf("Value: %s\n", packet.value);
-    printf("Data: %s\n", packet.data);
-}
\ No newline at end of file
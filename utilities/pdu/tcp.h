@@ -6,8 +6,8 @@
  * into byte arrays and sending data over TCP sockets.
  *  
  * @author Eric Bitria Ribes
- * @version 0.3
- * @date 2024-3-14
+ * @version 0.4
+ * @date 2024-4-26
  */
 
 #ifndef PDUTCP_H
@@ -15,7 +15,9 @@
 
 #include "../commons.h"
 
-/* Define struct for TCP packet:
+#define PDUTCP 118 /* Size in bytes of an encoded TCP packet. */
+
+/* Layout of an encoded TCP packet, PDUTCP bytes:
    - type (1 byte)           : Represents the type of TCP packet.
    - mac (13 byte)           : Represents the MAC address.
    - rnd (9 byte)            : Represents random data.
@@ -23,14 +25,6 @@
    - char value[7];          : Repesentes the value associated to the device.
    - data (80 byte)          : Represents the data payload.
 */
-struct TCPPacket {
-    unsigned char type;
-    char mac[13];
-    char rnd[9];
-    char device[8];
-    char value[7];
-    char data[80];
-};
 
 /* Enum to represent different types of TCP packets:
     - SEND_DATA = 0x20,
@@ -50,60 +44,106 @@ enum TCPType{
 };
 
 /**
- * @brief Creates a TCPPacket structure with the provided information.
- *
- * This function constructs and returns a TCPPacket structure with the specified
- * 'type', 'mac' address, 'rnd' data, and 'data' payload. It copies the provided
- * 'mac', 'rnd', and 'data' strings into the corresponding fields of the TCPPacket
- * structure.
+ * @brief Encodes a TCP packet straight into a byte array.
  * 
+ * @param bytes Pointer to a byte array of at least PDUTCP bytes.
  * @param type The type of the packet.
  * @param mac The MAC address string.
  * @param rnd The random data string.
  * @param device The device of the controller.
  * @param value The value associated to the device.
  * @param data The data payload string.
+ */
+void encodeTcp(char *bytes, const unsigned char type, const char *mac, const char *rnd, const char *device, const char *value, const char *data);
+
+/*
+Define struct for a read-only view of an encoded TCP packet, its fields are read
+straight from the PDUTCP bytes it points to, which must outlive the view:
+- const char *bytes;     : Encoded packet, usually a receive buffer.
+*/
+struct TCPView {
+    const char *bytes;
+};
+
+/**
+ * @brief Points a view to an encoded TCP packet and validates it in place.
+ * 
+ * @param view Pointer to the view to initialize.
+ * @param bytes Pointer to PDUTCP bytes containing the encoded packet.
+ * 
+ * @return Returns false if a string field isn't null terminated within its size.
+ */
+bool tcpView(struct TCPView *view, const char *bytes);
+
+/**
+ * @brief Gets the type of the viewed packet.
+ * 
+ * @param view Pointer to the view.
+ * @return The packet type.
+ */
+unsigned char tcpType(const struct TCPView *view);
+
+/**
+ * @brief Gets the MAC address of the viewed packet.
  * 
- * @return Returns a TCPPacket structure initialized with the provided information.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
  */
-struct TCPPacket* createTCPPacket(const unsigned char type, const char *mac, const char *rnd, const char *device, const char *value, const char *data);
+const char *tcpMac(const struct TCPView *view);
 
 /**
- * @brief Converts a TCPPacket struct to a byte array.
+ * @brief Gets the random identifier of the viewed packet.
  * 
- * @param packet Pointer to the TCPPacket struct to be converted.
- * @param bytes Pointer to the byte array where the TCPPacket struct will be converted.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
  */
-void tcpToBytes(struct TCPPacket *packet, char *bytes);
+const char *tcpRnd(const struct TCPView *view);
 
 /**
- * @brief Converts a byte array to a TCPPacket struct.
+ * @brief Gets the device of the viewed packet.
  * 
- * @param bytes Pointer to the byte array containing the data to be converted.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
+ */
+const char *tcpDevice(const struct TCPView *view);
+
+/**
+ * @brief Gets the value of the viewed packet.
  * 
- * @return Returns a TCPPacket struct with the data decoded from the byte array.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
  */
+const char *tcpValue(const struct TCPView *view);
 
-struct TCPPacket* bytesToTcp(const char *bytes);
+/**
+ * @brief Gets the data payload of the viewed packet.
+ * 
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
+ */
+const char *tcpData(const struct TCPView *view);
 
 /**
  * @brief Sends a TCP packet over the specified socket.
  * 
  * @param socketFd The file descriptor of the socket to send data over.
- * @param packet The TCPPacket struct containing the data to send.
+ * @param type The type of the packet.
+ * @param mac The MAC address string.
+ * @param rnd The random data string.
+ * @param device The device of the controller.
+ * @param value The value associated to the device.
+ * @param data The data payload string.
  */
-void sendTcp(const int socketFd, struct TCPPacket* packet);
+void sendTcp(const int socketFd, const unsigned char type, const char *mac, const char *rnd, const char *device, const char *value, const char *data);
 
 /**
- * @brief Receives a TCP packet from a socket and converts it to a TCPPacket struct.
+ * @brief Receives a TCP packet from a socket into the caller's buffer.
  * 
  * @param socketFd The file descriptor of the socket from which to receive the packet.
+ * @param bytes Pointer to a byte array of PDUTCP bytes, short packets are padded with zeros.
  * 
- * @return Returns a TCPPacket struct with the data decoded from the received byte array.
+ * @return Returns false if no packet was received (timeout or disconnection).
  */
-struct TCPPacket* recvTcp(const int *socketFd);
-
-/* Debug */
-void printTCPPacket(struct TCPPacket packet);
+bool recvTcp(const int *socketFd, char *bytes);
 
 #endif /* PDUTCP_H */
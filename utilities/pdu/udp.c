@@ -12,165 +12,378 @@
 
 #include "../commons.h"
 
-#define PDUUDP 103
+/* Egress queue of the calling thread, NULL if packets are sent right away */
+static __thread struct UDPEgress *threadEgress = NULL;
+
+/* Random generator state of the calling thread, seeded on first use */
+static __thread uint64_t randomState[4];
+static __thread bool randomSeeded = false;
+
+/* Identifiers generated in advance by the calling thread */
+static __thread char identifiers[IDENTIFIER_POOL][9];
+static __thread int identifiersLeft = 0;
 
 /**
- * @brief Creates a UDPPacket structure with the provided information.
+ * @brief Copies a string into a fixed size PDU field.
  *
- * This function constructs and returns a UDPPacket structure with the specified
- * 'type', 'mac' address, 'rnd' data, and 'data' payload. It copies the provided
- * 'mac', 'rnd', and 'data' strings into the corresponding fields of the UDPPacket
- * structure.
+ * The string is truncated to size - 1 characters and the rest of the field,
+ * including the terminator, is filled with zeros.
  * 
+ * @param field Pointer to the field inside the byte array.
+ * @param str The string to copy.
+ * @param size Size of the field in bytes.
+ */
+void encodeField(char *field, const char *str, size_t size) {
+    strncpy(field, str, size - 1);
+    field[size - 1] = '\0';
+}
+
+/**
+ * @brief Encodes a UDP packet straight into a byte array.
+ *
+ * This function writes the 'type', 'mac' address, 'rnd' data, and 'data' payload
+ * into the caller's buffer with the PDU layout.
+ * 
+ * @param bytes Pointer to a byte array of at least PDUUDP bytes.
  * @param type The type of the packet.
  * @param mac The MAC address string.
  * @param rnd The random data string.
  * @param data The data payload string.
- * 
- * @return Returns a UDPPacket structure initialized with the provided information.
  */
-struct UDPPacket* createUDPPacket(const unsigned char type, const char *mac, const char *rnd, const char *data) {
-    struct UDPPacket* packet = malloc(sizeof(struct UDPPacket));
-    if (packet == NULL) {
-        return NULL;
-    }
-    packet->type = type;
-    strncpy(packet->mac, mac, sizeof(packet->mac) - 1);
-    packet->mac[sizeof(packet->mac) - 1] = '\0';
-    strncpy(packet->rnd, rnd, sizeof(packet->rnd) - 1);
-    packet->rnd[sizeof(packet->rnd) - 1] = '\0';
-    strncpy(packet->data, data, sizeof(packet->data) - 1);
-    packet->data[sizeof(packet->data) - 1] = '\0';
-
-    return packet;
+void encodeUdp(char *bytes, const unsigned char type, const char *mac, const char *rnd, const char *data) {
+    bytes[0] = type;
+    encodeField(bytes + 1, mac, 13);
+    encodeField(bytes + 14, rnd, 9);
+    encodeField(bytes + 23, data, 80);
 }
 
 
 /**
- * @brief Converts a UDPPacket struct to a byte array.
+ * @brief Points a view to an encoded UDP packet and validates it in place.
  *
- * This function converts the provided UDPPacket struct 'packet' into a byte array 'bytes'.
- * It starts by copying the type field of the packet to the beginning of the byte array,
- * then copies the mac, rnd, and data fields subsequently. It updates the 'offset' to
- * keep track of the current position in the byte array.
+ * This function checks that the 'mac', 'rnd' and 'data' fields of the encoded packet
+ * are null terminated within their sizes, so the accessors can return pointers into
+ * 'bytes' that are safe to use as strings. Nothing is copied or modified.
+ * 
+ * @param view Pointer to the view to initialize.
+ * @param bytes Pointer to PDUUDP bytes containing the encoded packet.
  * 
- * @param packet Pointer to the UDPPacket struct to be converted.
- * @param bytes Pointer to the byte array where the UDPPacket struct will be converted.
+ * @return Returns false if a string field isn't null terminated within its size.
  */
-void udpToBytes(const struct UDPPacket *packet, char *bytes) {
-    int offset = 0;
-    bytes[offset] = packet->type;
-    offset += sizeof(packet->type);
-    memcpy(bytes + offset, packet->mac, sizeof(packet->mac));
-    offset += sizeof(packet->mac);
-    memcpy(bytes + offset, packet->rnd, sizeof(packet->rnd));
-    offset += sizeof(packet->rnd);
-    memcpy(bytes + offset, packet->data, sizeof(packet->data));
+bool udpView(struct UDPView *view, const char *bytes) {
+    view->bytes = bytes;
+    return memchr(bytes + 1, '\0', 13) != NULL &&
+           memchr(bytes + 14, '\0', 9) != NULL &&
+           memchr(bytes + 23, '\0', 80) != NULL;
 }
 
 /**
- * @brief Converts a byte array to a UDPPacket struct.
- *
- * This function converts the provided byte array 'bytes' into a UDPPacket struct.
- * It begins by copying the type field from the byte array to the packet struct,
- * then proceeds to copy the mac, rnd, and data fields subsequently. It updates the
- * 'offset' to keep track of the current position in the byte array.
+ * @brief Gets the type of the viewed packet.
  * 
- * @param bytes Pointer to the byte array containing the data to be converted.
+ * @param view Pointer to the view.
+ * @return The packet type.
+ */
+unsigned char udpType(const struct UDPView *view) {
+    return (unsigned char)view->bytes[0];
+}
+
+/**
+ * @brief Gets the MAC address of the viewed packet.
  * 
- * @return Returns a UDPPacket struct containing the data decoded from the byte array.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
  */
-struct UDPPacket bytesToUdp(const char *bytes) {
-    struct UDPPacket packet;
-    int offset = 0;
-    packet.type = bytes[offset];
-    offset += sizeof(packet.type);
-    memcpy(packet.mac, bytes + offset, sizeof(packet.mac));
-    offset += sizeof(packet.mac);
-    memcpy(packet.rnd, bytes + offset, sizeof(packet.rnd));
-    offset += sizeof(packet.rnd);
-    memcpy(packet.data, bytes + offset, sizeof(packet.data));
-    return packet;
+const char *udpMac(const struct UDPView *view) {
+    return view->bytes + 1;
 }
 
+/**
+ * @brief Gets the random identifier of the viewed packet.
+ * 
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
+ */
+const char *udpRnd(const struct UDPView *view) {
+    return view->bytes + 14;
+}
+
+/**
+ * @brief Gets the data payload of the viewed packet.
+ * 
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
+ */
+const char *udpData(const struct UDPView *view) {
+    return view->bytes + 23;
+}
 
 /**
- * @brief Sends data over a UDP socket to a specified address.
+ * @brief Sends a UDP packet over a UDP socket to a specified address.
  *
- * This function sends the data contained in the provided UDPPacket structure 'packet'
- * over a UDP socket represented by the file descriptor 'socketFd' to the destination
+ * This function encodes the packet into a stack buffer and sends it over a UDP
+ * socket represented by the file descriptor 'socketFd' to the destination
  * address specified in the 'address' parameter using the sendto() function.
  * 
  * @param socketFd The file descriptor of the UDP socket.
- * @param packet The UDPPacket structure containing the data to be sent.
+ * @param type The type of the packet.
+ * @param mac The MAC address string.
+ * @param rnd The random data string.
+ * @param data The data payload string.
  * @param address Pointer to a sockaddr_in struct representing the destination address.
  */
-void sendUdp(const int socketFd, struct UDPPacket* packet, const struct sockaddr_in *address) {
-    char data[PDUUDP];
+void sendUdp(const int socketFd, const unsigned char type, const char *mac, const char *rnd, const char *data, const struct sockaddr_in *address) {
+    char bytes[PDUUDP];
     socklen_t address_len = sizeof(struct sockaddr_in);
 
-    if (packet == NULL) {
-        lerror("Error: NULL packet provided to sendUdp", true);
+    encodeUdp(bytes, type, mac, rnd, data);
+
+    if (sendto(socketFd, bytes, sizeof(bytes), 0, (struct sockaddr *) address, address_len) < 0) {
+        lerror("Sendto failed", true);
+    }
+    STATS_ADD(udpSendCalls, 1);
+    STATS_ADD(udpSendPackets, 1);
+}
+
+/**
+ * @brief Sets the egress queue used by queueUdp in the calling thread.
+ *
+ * @param egress Pointer to the queue, it must stay valid until endUdpEgress.
+ */
+void beginUdpEgress(struct UDPEgress *egress) {
+    egress->count = 0;
+    threadEgress = egress;
+}
+
+/**
+ * @brief Sends every packet queued in the calling thread egress queue.
+ *
+ * This function sends the queued packets with as few sendmmsg calls as possible,
+ * retrying with the remaining ones when the kernel only accepts part of them.
+ */
+void flushUdpEgress() {
+    struct UDPEgress *egress = threadEgress;
+    int sent = 0, result;
+
+    if (egress == NULL) {
+        return;
+    }
+    while (sent < egress->count) {
+        if ((result = sendmmsg(egress->socket, egress->msgs + sent, egress->count - sent, 0)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            lerror("Sendmmsg failed", true);
+        }
+        sent += result;
+        STATS_ADD(udpSendCalls, 1);
+    }
+    STATS_ADD(udpSendPackets, egress->count);
+    egress->count = 0;
+}
+
+/**
+ * @brief Queues a packet in the calling thread egress queue.
+ *
+ * This function encodes the packet straight into the next free slot of the queue. The
+ * queue is flushed first if it is full or holds packets for another socket, and after
+ * queueing if its oldest packet has waited more than UDP_EGRESS_DEADLINE milliseconds.
+ * Without an egress queue the packet is sent right away with sendUdp.
+ * 
+ * @param socketFd The file descriptor of the UDP socket.
+ * @param type The type of the packet.
+ * @param mac The MAC address string.
+ * @param rnd The random data string.
+ * @param data The data payload string.
+ * @param address Pointer to a sockaddr_in struct representing the destination address.
+ */
+void queueUdp(const int socketFd, const unsigned char type, const char *mac, const char *rnd, const char *data, const struct sockaddr_in *address) {
+    struct UDPEgress *egress = threadEgress;
+    int slot;
+
+    if (egress == NULL) {
+        sendUdp(socketFd, type, mac, rnd, data, address);
         return;
     }
 
-    udpToBytes(packet, data);
+    if (egress->count == UDP_EGRESS_SIZE || (egress->count > 0 && egress->socket != socketFd)) {
+        flushUdpEgress();
+    }
+    if (egress->count == 0) {
+        egress->socket = socketFd;
+        egress->oldest = timers_now();
+    }
+
+    slot = egress->count++;
+    encodeUdp(egress->buffers[slot], type, mac, rnd, data);
+    egress->addrs[slot] = *address;
+    egress->iovecs[slot].iov_base = egress->buffers[slot];
+    egress->iovecs[slot].iov_len = PDUUDP;
+    memset(&egress->msgs[slot], 0, sizeof(struct mmsghdr));
+    egress->msgs[slot].msg_hdr.msg_iov = &egress->iovecs[slot];
+    egress->msgs[slot].msg_hdr.msg_iovlen = 1;
+    egress->msgs[slot].msg_hdr.msg_name = &egress->addrs[slot];
+    egress->msgs[slot].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
 
-    if (sendto(socketFd, data, sizeof(data), 0, (struct sockaddr *) address, address_len) < 0) {
-        lerror("Sendto failed", true);
+    if (timers_now() - egress->oldest >= UDP_EGRESS_DEADLINE) {
+        flushUdpEgress();
     }
+}
 
-    free(packet);
+/**
+ * @brief Flushes and detaches the egress queue of the calling thread.
+ */
+void endUdpEgress() {
+    flushUdpEgress();
+    threadEgress = NULL;
 }
 
 
 /**
- * @brief Receives a UDP packet from a specified socket.
+ * @brief Allocates the buffers for batched UDP reception.
  *
- * This function receives a UDP packet from the given 'socketFd' and stores it
- * in a UDPPacket struct. It uses the recvfrom() function to retrieve the packet
- * into a buffer, then decodes the buffer contents into a UDPPacket struct using
- * the bytesToUdp() function.
+ * This function allocates the message headers, buffer descriptors, buffers and
+ * addresses needed by recvmmsg and links them together, so receiving a batch
+ * doesn't require any further allocation.
+ * 
+ * @param size Maximum number of datagrams received per call.
+ * 
+ * @return Returns a pointer to the new receiver.
+ */
+struct UDPReceiver* createUDPReceiver(int size) {
+    int i;
+    struct UDPReceiver *receiver = malloc(sizeof(struct UDPReceiver));
+    if (receiver == NULL) {
+        lerror("Failed to allocate memory for UDP receiver", true);
+    }
+    receiver->size = size;
+    receiver->msgs = calloc(size, sizeof(struct mmsghdr));
+    receiver->iovecs = calloc(size, sizeof(struct iovec));
+    receiver->buffers = calloc(size, PDUUDP);
+    receiver->addrs = calloc(size, sizeof(struct sockaddr_in));
+    if (receiver->msgs == NULL || receiver->iovecs == NULL || receiver->buffers == NULL || receiver->addrs == NULL) {
+        lerror("Failed to allocate memory for UDP receiver", true);
+    }
+    for (i = 0; i < size; i++) {
+        receiver->iovecs[i].iov_base = receiver->buffers + i * PDUUDP;
+        receiver->iovecs[i].iov_len = PDUUDP;
+        receiver->msgs[i].msg_hdr.msg_iov = &receiver->iovecs[i];
+        receiver->msgs[i].msg_hdr.msg_iovlen = 1;
+        receiver->msgs[i].msg_hdr.msg_name = &receiver->addrs[i];
+    }
+    return receiver;
+}
+
+/**
+ * @brief Receives every pending datagram (up to the receiver size) with a single syscall.
+ *
+ * This function calls recvmmsg without blocking, or blocking until the first
+ * datagram arrives if wait is set. Datagrams shorter than a PDU are padded
+ * with zeros so views never read bytes of a previous datagram.
  * 
  * @param socketFd The file descriptor of the UDP socket.
- * @param address Pointer to a sockaddr_in struct where the source address of
- *                the received packet will be stored.
+ * @param receiver Pointer to the receiver where datagrams and addresses will be stored.
+ * @param wait Whether to sleep until at least one datagram is received.
  * 
- * @return Returns a UDPPacket struct containing the received UDP packet.
+ * @return Returns the number of datagrams received, 0 if none was pending.
  */
-struct UDPPacket recvUdp(const int socketFd, struct sockaddr_in *address){
-    socklen_t address_len = sizeof(struct sockaddr_in); /* Get size of the address */
-    char buffer[PDUUDP]; /* Init buffer */
+int recvUdpBatch(const int socketFd, struct UDPReceiver *receiver, bool wait) {
+    int i, received;
+
+    for (i = 0; i < receiver->size; i++) {
+        receiver->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+
+    if ((received = recvmmsg(socketFd, receiver->msgs, receiver->size, wait ? MSG_WAITFORONE : MSG_DONTWAIT, NULL)) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        lerror("recvmmsg failed", true);
+    }
+
+    for (i = 0; i < received; i++) {
+        if (receiver->msgs[i].msg_len < PDUUDP) {
+            memset(receiver->buffers + i * PDUUDP + receiver->msgs[i].msg_len, 0, PDUUDP - receiver->msgs[i].msg_len);
+        }
+    }
 
-    /* Execute packet reception */
-    if (recvfrom(socketFd, buffer, PDUUDP, 0, (struct sockaddr *) address, &address_len) < 0) {
-        lerror("recvfrom failed", true);
+    if (received > 0) {
+        STATS_ADD(udpRecvCalls, 1);
+        STATS_ADD(udpRecvPackets, received);
     }
-    /* Decode  and return bytes into PDU_UDP packet */
-    return bytesToUdp(buffer);
+    return received;
+}
+
+/**
+ * @brief Rotates a 64 bit number to the left.
+ *
+ * @param x The number to rotate.
+ * @param k Number of bits, between 1 and 63.
+ * @return The rotated number.
+ */
+uint64_t rotateLeft(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief Gets the next number of the calling thread random generator.
+ *
+ * The generator is xoshiro256**, its state is local to the thread so no
+ * lock is taken. It is seeded from getrandom on its first use, threads
+ * starting in the same second get unrelated sequences.
+ *
+ * @return Returns 64 random bits.
+ */
+uint64_t randomNext() {
+    uint64_t result, t;
+
+    if (!randomSeeded) {
+        if (getrandom(randomState, sizeof(randomState), 0) != sizeof(randomState)) {
+            /* Only without getrandom support, the state just has to differ between threads */
+            lwarning("getrandom failed, seeding identifiers from the clock", true);
+            randomState[0] = (uint64_t)time(NULL);
+            randomState[1] = (uint64_t)(uintptr_t)&randomState;
+            randomState[2] = timers_now();
+            randomState[3] = (uint64_t)0x9E3779B9 << 32 | 0x7F4A7C15;
+        }
+        randomSeeded = true;
+    }
+
+    result = rotateLeft(randomState[1] * 5, 7) * 9;
+    t = randomState[1] << 17;
+    randomState[2] ^= randomState[0];
+    randomState[3] ^= randomState[1];
+    randomState[1] ^= randomState[2];
+    randomState[0] ^= randomState[3];
+    randomState[2] ^= t;
+    randomState[3] = rotateLeft(randomState[3], 45);
+    return result;
 }
 
 /**
  * @brief Generates a random 8-digit number as a string.
  *
- * This function generates a random 8-digit number between 00000000 and
- * 99999999 and stores it as a string in the provided character array 
- * 'str'. The result is formatted with leading zeros if necessary.
+ * This function takes a random 8-digit number between 00000000 and
+ * 99999999, formatted with leading zeros, and stores it as a string in
+ * the provided character array 'str'. Identifiers are formatted
+ * IDENTIFIER_POOL at a time into a pool of the calling thread, so a
+ * subscription storm mostly copies 9 bytes.
  * 
  * @param str A char array where the random number will be stored as string.
  */
 void generateIdentifier(char str[9]) {
-    int random_num;
-    int quotient;
-    int i;
-    /* Set Seed */
-    srand(time(NULL));
-    /* Number between 0 and 99999999 */
-    random_num = rand() % 100000000;
-    quotient = random_num;
-    for (i = 7; i >= 0; i--) {
-        str[i] = '0' + quotient % 10;
-        quotient /= 10;
-    }
-    str[8] = '\0'; /*Null-terminate the string*/
-}
\ No newline at end of file
+    int i, j;
+
+    if (identifiersLeft == 0) {
+        for (j = 0; j < IDENTIFIER_POOL; j++) {
+            /* The modulo bias of 2^64 over 10^8 is negligible */
+            uint64_t quotient = randomNext() % 100000000;
+            for (i = 7; i >= 0; i--) {
+                identifiers[j][i] = '0' + quotient % 10;
+                quotient /= 10;
+            }
+            identifiers[j][8] = '\0'; /*Null-terminate the string*/
+        }
+        identifiersLeft = IDENTIFIER_POOL;
+    }
+    memcpy(str, identifiers[--identifiersLeft], 9);
+}
@@ -15,18 +15,14 @@
 
 #include "../commons.h"
 
-/* Define struct for pdu_udp packet:
+#define PDUUDP 103 /* Size in bytes of an encoded UDP packet. */
+
+/* Layout of an encoded UDP packet, PDUUDP bytes:
    - type (1 byte)           : Represents the type of UDP packet.
    - mac (13 byte)           : Represents the MAC address.
    - rnd (9 byte)            : Represents random data.
    - data (80 byte)          : Represents the data payload.
 */
-struct UDPPacket {
-    unsigned char type;
-    char mac[13];
-    char rnd[9];
-    char data[80];
-};
 
 /* Enum to represent different types of UDP packets:
    - SUBS_REQ (0x00):
@@ -48,67 +44,192 @@ enum UDPType{
 };
 
 /**
- * @brief Creates a UDPPacket structure with the provided information.
- *
- * This function constructs and returns a UDPPacket structure with the specified
- * 'type', 'mac' address, 'rnd' data, and 'data' payload. It copies the provided
- * 'mac', 'rnd', and 'data' strings into the corresponding fields of the UDPPacket
- * structure.
+ * @brief Copies a string into a fixed size PDU field, truncating and zero padding it.
+ * 
+ * @param field Pointer to the field inside the byte array.
+ * @param str The string to copy.
+ * @param size Size of the field in bytes.
+ */
+void encodeField(char *field, const char *str, size_t size);
+
+/**
+ * @brief Encodes a UDP packet straight into a byte array.
  * 
+ * @param bytes Pointer to a byte array of at least PDUUDP bytes.
  * @param type The type of the packet.
  * @param mac The MAC address string.
  * @param rnd The random data string.
  * @param data The data payload string.
+ */
+void encodeUdp(char *bytes, const unsigned char type, const char *mac, const char *rnd, const char *data);
+
+/*
+Define struct for a read-only view of an encoded UDP packet, its fields are read
+straight from the PDUUDP bytes it points to, which must outlive the view:
+- const char *bytes;     : Encoded packet, usually a receive buffer.
+*/
+struct UDPView {
+    const char *bytes;
+};
+
+/**
+ * @brief Points a view to an encoded UDP packet and validates it in place.
+ * 
+ * @param view Pointer to the view to initialize.
+ * @param bytes Pointer to PDUUDP bytes containing the encoded packet.
+ * 
+ * @return Returns false if a string field isn't null terminated within its size.
+ */
+bool udpView(struct UDPView *view, const char *bytes);
+
+/**
+ * @brief Gets the type of the viewed packet.
  * 
- * @return Returns a UDPPacket structure initialized with the provided information.
+ * @param view Pointer to the view.
+ * @return The packet type.
  */
-struct UDPPacket* createUDPPacket(const unsigned char type, const char *mac, const char *rnd, const char *data);
+unsigned char udpType(const struct UDPView *view);
 
 /**
- * @brief Converts a UDPPacket struct to a byte array.
+ * @brief Gets the MAC address of the viewed packet.
  * 
- * @param packet Pointer to the UDPPacket struct to be converted.
- * @param bytes Pointer to the byte array where the UDPPacket struct will be converted.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
  */
-void udpToBytes(const struct UDPPacket *packet, char *bytes);
+const char *udpMac(const struct UDPView *view);
 
 /**
- * @brief Converts a byte array to a UDPPacket struct.
- *
- * This function converts the provided byte array 'bytes' into a UDPPacket struct.
- * It begins by copying the type field from the byte array to the packet struct,
- * then proceeds to copy the mac, rnd, and data fields subsequently. It updates the
- * 'offset' to keep track of the current position in the byte array.
+ * @brief Gets the random identifier of the viewed packet.
  * 
- * @param bytes Pointer to the byte array containing the data to be converted.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
+ */
+const char *udpRnd(const struct UDPView *view);
+
+/**
+ * @brief Gets the data payload of the viewed packet.
  * 
- * @return Returns a UDPPacket struct containing the data decoded from the byte array.
+ * @param view Pointer to a validated view.
+ * @return Pointer to the null terminated field inside the packet bytes.
  */
-struct UDPPacket bytesToUdp(const char *bytes);
+const char *udpData(const struct UDPView *view);
 
 /**
- * @brief Sends data over a UDP socket to a specified address.
+ * @brief Sends a UDP packet over a UDP socket to a specified address.
  * 
  * @param socketFd The file descriptor of the UDP socket.
- * @param packet The UDPPacket structure containing the data to be sent.
+ * @param type The type of the packet.
+ * @param mac The MAC address string.
+ * @param rnd The random data string.
+ * @param data The data payload string.
  * @param address Pointer to a sockaddr_in struct representing the destination address.
  */
-void sendUdp(const int socketFd, struct UDPPacket *packet, const struct sockaddr_in *address);
+void sendUdp(const int socketFd, const unsigned char type, const char *mac, const char *rnd, const char *data, const struct sockaddr_in *address);
+
+/*
+Define struct for batched UDP reception, preallocated once and reused by every recvmmsg call:
+- int size;                  : Maximum number of datagrams per batch.
+- struct mmsghdr *msgs;      : Message headers passed to recvmmsg.
+- struct iovec *iovecs;      : One buffer descriptor per message.
+- char *buffers;             : size * PDUUDP bytes of receive buffers.
+- struct sockaddr_in *addrs; : Source address of each message.
+*/
+struct UDPReceiver {
+    int size;
+    struct mmsghdr *msgs;
+    struct iovec *iovecs;
+    char *buffers;
+    struct sockaddr_in *addrs;
+};
+
+/**
+ * @brief Allocates the buffers for batched UDP reception.
+ * 
+ * @param size Maximum number of datagrams received per call.
+ * 
+ * @return Returns a pointer to the new receiver.
+ */
+struct UDPReceiver* createUDPReceiver(int size);
 
 /**
- * @brief Receives a UDP packet from a specified socket.
+ * @brief Receives every pending datagram (up to the receiver size) with a single syscall.
  * 
  * @param socketFd The file descriptor of the UDP socket.
- * @param address Pointer to a sockaddr_in struct where the source address of
- * the received packet will be stored.
+ * @param receiver Pointer to the receiver where datagrams and addresses will be stored.
+ * @param wait Whether to sleep until at least one datagram is received.
  * 
- * @return Returns a UDPPacket struct containing the received UDP packet.
+ * @return Returns the number of datagrams received, 0 if none was pending.
  */
-struct UDPPacket recvUdp(const int socketFd, struct sockaddr_in *address);
+int recvUdpBatch(const int socketFd, struct UDPReceiver *receiver, bool wait);
+
+#define UDP_EGRESS_SIZE 64 /* Maximum number of packets queued before a sendmmsg flush. */
+#define UDP_EGRESS_DEADLINE 2 /* Milliseconds a queued packet may wait before being flushed. */
+
+/*
+Define struct for batched UDP sending, a queue of encoded packets sent with sendmmsg:
+- int socket;                  : Socket of the queued packets, all of them share it.
+- int count;                   : Number of queued packets.
+- uint64_t oldest;             : Time (timers_now) when the first queued packet was added.
+- struct mmsghdr msgs[];       : Message headers passed to sendmmsg.
+- struct iovec iovecs[];       : One buffer descriptor per message.
+- char buffers[][PDUUDP];      : Encoded packets.
+- struct sockaddr_in addrs[];  : Destination address of each message.
+*/
+struct UDPEgress {
+    int socket;
+    int count;
+    uint64_t oldest;
+    struct mmsghdr msgs[UDP_EGRESS_SIZE];
+    struct iovec iovecs[UDP_EGRESS_SIZE];
+    char buffers[UDP_EGRESS_SIZE][PDUUDP];
+    struct sockaddr_in addrs[UDP_EGRESS_SIZE];
+};
+
+/**
+ * @brief Sets the egress queue used by queueUdp in the calling thread.
+ * 
+ * @param egress Pointer to the queue, it must stay valid until endUdpEgress.
+ */
+void beginUdpEgress(struct UDPEgress *egress);
+
+/**
+ * @brief Queues a packet in the calling thread egress queue.
+ * 
+ * Sends it right away if the thread has no egress queue.
+ * 
+ * @param socketFd The file descriptor of the UDP socket.
+ * @param type The type of the packet.
+ * @param mac The MAC address string.
+ * @param rnd The random data string.
+ * @param data The data payload string.
+ * @param address Pointer to a sockaddr_in struct representing the destination address.
+ */
+void queueUdp(const int socketFd, const unsigned char type, const char *mac, const char *rnd, const char *data, const struct sockaddr_in *address);
+
+/**
+ * @brief Sends every packet queued in the calling thread egress queue.
+ */
+void flushUdpEgress();
+
+/**
+ * @brief Flushes and detaches the egress queue of the calling thread.
+ */
+void endUdpEgress();
+
+#define IDENTIFIER_POOL 32 /* Identifiers generated at once by each thread, 1 to generate them one by one. */
+
+/**
+ * @brief Gets the next number of the calling thread random generator.
+ * 
+ * @return Returns 64 random bits.
+ */
+uint64_t randomNext();
 
 /**
  * @brief Generates a random 8-digit number as a string.
  * 
+ * Thread safe and lock free, every thread has its own generator.
+ * 
  * @param str A char array where the random number will be stored as string.
  */
 void generateIdentifier(char str[9]);
@@ -0,0 +1,90 @@
+/**
+ * @file validate.c
+ * @brief Functions for validating the format of fixed width PDU fields.
+ *
+ * This file contains the kernels used by the packet handlers to check that a
+ * field only holds decimal or hexadecimal digits. Every PDU string field sits in a buffer with room for
+ * a whole vector after it, so a field is classified with one load and a few
+ * vector compares. SSE2 is used on every x86-64 build, other targets use the
+ * scalar code. Equality and containment are left to strcmp/strncmp/strstr,
+ * which the kernels didn't beat.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-27
+ */
+
+#include "../commons.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Checks that a field holds exactly length decimal digits followed by its terminator.
+ *
+ * With SSE2 the whole field is classified with one load: a bitmask of the digit
+ * bytes must cover the first length bytes and the terminator must follow them.
+ *
+ * @param field Pointer to a field inside a PDU, FIELD_READABLE bytes are read.
+ * @param length Number of digits, less than FIELD_READABLE.
+ *
+ * @return Returns true if the field is well formed.
+ */
+bool fieldIsDigits(const char *field, size_t length) {
+#if defined(__SSE2__)
+    __m128i bytes = _mm_loadu_si128((const __m128i *)field);
+    unsigned int digits = _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)),
+                                                          _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1))));
+    unsigned int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_setzero_si128()));
+    unsigned int want = (1u << length) - 1;
+
+    return (digits & want) == want && ((zeros >> length) & 1) != 0;
+#else
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        if (field[i] < '0' || field[i] > '9') {
+            return false;
+        }
+    }
+    return field[length] == '\0';
+#endif
+}
+
+/**
+ * @brief Checks that a field holds exactly length hexadecimal digits followed by its terminator.
+ *
+ * Same as fieldIsDigits, letters are folded to lowercase before checking the
+ * 'a' to 'f' range. Bytes above 0x7F compare as negative and are rejected.
+ *
+ * @param field Pointer to a field inside a PDU, FIELD_READABLE bytes are read.
+ * @param length Number of digits, less than FIELD_READABLE.
+ *
+ * @return Returns true if the field is well formed.
+ */
+bool fieldIsHex(const char *field, size_t length) {
+#if defined(__SSE2__)
+    __m128i bytes = _mm_loadu_si128((const __m128i *)field);
+    __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)),
+                                   _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                    _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    unsigned int hex = _mm_movemask_epi8(_mm_or_si128(digits, letters));
+    unsigned int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_setzero_si128()));
+    unsigned int want = (1u << length) - 1;
+
+    return (hex & want) == want && ((zeros >> length) & 1) != 0;
+#else
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        char lower = field[i] | 0x20;
+        if ((field[i] < '0' || field[i] > '9') && (lower < 'a' || lower > 'f')) {
+            return false;
+        }
+    }
+    return field[length] == '\0';
+#endif
+}
@@ -0,0 +1,40 @@
+/**
+ * @file validate.h
+ * @brief Functions definitions for validating the format of fixed width PDU fields.
+ *
+ * This file contains the kernels used by the packet handlers to check the format
+ * of the received fields, vectorized with SSE2 and with a scalar fallback otherwise.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-27
+ */
+
+#ifndef PDUVALIDATE_H
+#define PDUVALIDATE_H
+
+#include "../commons.h"
+
+#define FIELD_READABLE 16 /* Bytes that can be read from the start of any PDU string field but data. */
+
+/**
+ * @brief Checks that a field holds exactly length decimal digits followed by its terminator.
+ *
+ * @param field Pointer to a field inside a PDU, FIELD_READABLE bytes are read.
+ * @param length Number of digits, less than FIELD_READABLE.
+ *
+ * @return Returns true if the field is well formed.
+ */
+bool fieldIsDigits(const char *field, size_t length);
+
+/**
+ * @brief Checks that a field holds exactly length hexadecimal digits followed by its terminator.
+ *
+ * @param field Pointer to a field inside a PDU, FIELD_READABLE bytes are read.
+ * @param length Number of digits, less than FIELD_READABLE.
+ *
+ * @return Returns true if the field is well formed.
+ */
+bool fieldIsHex(const char *field, size_t length);
+
+#endif /* PDUVALIDATE_H */
@@ -0,0 +1,202 @@
+/**
+ * @file reactor.c
+ * @brief Methods file for the epoll based event loop.
+ *
+ * This c file contains functions implementations related to the reactor
+ * that waits on every file descriptor owned by the main thread and
+ * dispatches them to their handlers, sleeping while there is no work.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-20
+ */
+
+#include "commons.h"
+
+/**
+ * @brief Releases the sources removed during the last dispatch.
+ *
+ * @param reactor Pointer to the reactor.
+ */
+void reactor_collect(reactor_t *reactor) {
+    while (reactor->removed != NULL) {
+        reactor_source_t *next = reactor->removed->next;
+        free(reactor->removed);
+        reactor->removed = next;
+    }
+}
+
+/**
+ * @brief Creates a new reactor.
+ *
+ * This function allocates memory for the reactor structure and creates
+ * the epoll instance used to wait for events.
+ *
+ * @return Returns a pointer to the newly created reactor.
+ */
+reactor_t* reactor_create() {
+    reactor_t *reactor = (reactor_t*)malloc(sizeof(reactor_t));
+    if (reactor == NULL) {
+        lerror("Failed to allocate memory for reactor", true);
+    }
+    if ((reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        lerror("Error creating epoll instance", true);
+    }
+    reactor->running = 0;
+    reactor->removed = NULL;
+    return reactor;
+}
+
+/**
+ * @brief Registers a file descriptor in the reactor.
+ *
+ * This function allocates a new source for the file descriptor and adds it
+ * to the epoll interest list. Descriptors that can't be polled (regular files
+ * redirected to stdin, for example) are rejected returning NULL.
+ *
+ * @param reactor Pointer to the reactor.
+ * @param fd The file descriptor to watch.
+ * @param events Events to watch (REACTOR_READ, optionally REACTOR_EDGE).
+ * @param handler Function called when the descriptor is ready.
+ * @param arg Argument for the handler function.
+ *
+ * @return Returns the registered source, or NULL if the descriptor can't be polled.
+ */
+reactor_source_t* reactor_add(reactor_t *reactor, int fd, uint32_t events, reactor_handler_t handler, void *arg) {
+    struct epoll_event ev;
+    reactor_source_t *source = (reactor_source_t*)malloc(sizeof(reactor_source_t));
+    if (source == NULL) {
+        lerror("Failed to allocate memory for reactor source", true);
+    }
+    source->fd = fd;
+    source->handler = handler;
+    source->arg = arg;
+    source->next = NULL;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = source;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        if (errno == EPERM) {
+            free(source);
+            return NULL;
+        }
+        lerror("Error adding file descriptor %d to epoll", true, fd);
+    }
+    return source;
+}
+
+/**
+ * @brief Unregisters a source from the reactor.
+ *
+ * The descriptor is removed from the interest list immediately, but the
+ * source memory is kept until the current dispatch finishes, so events
+ * already returned by epoll_wait for it are skipped instead of reading
+ * freed memory.
+ *
+ * @param reactor Pointer to the reactor.
+ * @param source The source to remove.
+ */
+void reactor_remove(reactor_t *reactor, reactor_source_t *source) {
+    if (source == NULL || source->fd < 0) {
+        return;
+    }
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+    source->fd = -1;
+    source->next = reactor->removed;
+    reactor->removed = source;
+}
+
+/**
+ * @brief Creates a periodic timer file descriptor.
+ *
+ * @param interval_ms Interval between expirations in milliseconds.
+ *
+ * @return Returns the timer file descriptor.
+ */
+int reactor_timer(long interval_ms) {
+    struct itimerspec spec;
+    int timer_fd;
+
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+        lerror("Error creating timer file descriptor", true);
+    }
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(timer_fd, 0, &spec, NULL) < 0) {
+        lerror("Error arming timer file descriptor", true);
+    }
+    return timer_fd;
+}
+
+/**
+ * @brief Consumes the pending expirations of a timer file descriptor.
+ *
+ * @param timer_fd The timer file descriptor.
+ *
+ * @return Returns the number of expirations since the last read, 0 if none.
+ */
+uint64_t reactor_timer_read(int timer_fd) {
+    uint64_t expirations = 0;
+    if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return 0;
+    }
+    return expirations;
+}
+
+/**
+ * @brief Runs the event loop until reactor_stop is called.
+ *
+ * This function blocks in epoll_wait without timeout, so the thread sleeps
+ * until a registered descriptor has work. Every ready source is dispatched
+ * to its handler in order.
+ *
+ * @param reactor Pointer to the reactor.
+ */
+void reactor_run(reactor_t *reactor) {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    reactor->running = 1;
+
+    while (reactor->running) {
+        int i, ready;
+
+        if ((ready = epoll_wait(reactor->epoll_fd, events, REACTOR_MAX_EVENTS, -1)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            lerror("Unexpected error in epoll_wait", true);
+        }
+
+        for (i = 0; i < ready; i++) {
+            reactor_source_t *source = (reactor_source_t*)events[i].data.ptr;
+            /* Skip sources removed by a previous handler in this dispatch */
+            if (source->fd < 0) {
+                continue;
+            }
+            source->handler(source->arg, events[i].events);
+        }
+
+        reactor_collect(reactor);
+    }
+}
+
+/**
+ * @brief Stops the event loop after the current dispatch.
+ *
+ * @param reactor Pointer to the reactor.
+ */
+void reactor_stop(reactor_t *reactor) {
+    reactor->running = 0;
+}
+
+/**
+ * @brief Destroys the reactor.
+ *
+ * @param reactor Pointer to the reactor.
+ */
+void reactor_destroy(reactor_t *reactor) {
+    reactor_collect(reactor);
+    close(reactor->epoll_fd);
+    free(reactor);
+}
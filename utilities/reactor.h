@@ -0,0 +1,124 @@
+/**
+ * @file reactor.h
+ * @brief Header file for the epoll based event loop.
+ *
+ * This header file contains declarations for functions and structures
+ * related to the reactor that multiplexes every file descriptor owned
+ * by the main thread (stdin, listeners, timers...).
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-20
+ */
+
+#ifndef REACTOR_H_
+#define REACTOR_H_
+
+#include "commons.h"
+
+#define REACTOR_MAX_EVENTS 64 /* Maximum number of events returned by a single epoll_wait call. */
+
+#define REACTOR_READ EPOLLIN /* Notify when the file descriptor is readable. */
+#define REACTOR_EDGE EPOLLET /* Use edge-triggered notification, handler must drain the descriptor. */
+
+/**
+ * @brief Function called by the reactor when a source becomes ready.
+ *
+ * @param arg The argument registered along with the source.
+ * @param events The epoll events that triggered the call.
+ */
+typedef void (*reactor_handler_t)(void *arg, uint32_t events);
+
+/**
+ * @brief Represents a file descriptor registered in the reactor.
+ */
+typedef struct reactor_source {
+    int fd; /* Watched file descriptor, -1 once removed. */
+    reactor_handler_t handler; /* Function called when the descriptor is ready. */
+    void *arg; /* Argument for the handler function. */
+    struct reactor_source *next; /* Next removed source pending to be freed. */
+} reactor_source_t;
+
+/**
+ * @brief Represents the event loop.
+ */
+typedef struct {
+    int epoll_fd; /* Epoll instance file descriptor. */
+    int running; /* Flag to keep the loop running. */
+    reactor_source_t *removed; /* Sources removed during the current dispatch. */
+} reactor_t;
+
+/**
+ * @brief Creates a new reactor.
+ *
+ * @return Returns a pointer to the newly created reactor.
+ */
+reactor_t* reactor_create();
+
+/**
+ * @brief Registers a file descriptor in the reactor.
+ *
+ * @param reactor Pointer to the reactor.
+ * @param fd The file descriptor to watch.
+ * @param events Events to watch (REACTOR_READ, optionally REACTOR_EDGE).
+ * @param handler Function called when the descriptor is ready.
+ * @param arg Argument for the handler function.
+ *
+ * @return Returns the registered source, or NULL if the descriptor can't be polled.
+ */
+reactor_source_t* reactor_add(reactor_t *reactor, int fd, uint32_t events, reactor_handler_t handler, void *arg);
+
+/**
+ * @brief Unregisters a source from the reactor.
+ *
+ * Must be called from the reactor thread. The source is released once the
+ * current dispatch finishes, so pending events for it are safely skipped.
+ *
+ * @param reactor Pointer to the reactor.
+ * @param source The source to remove.
+ */
+void reactor_remove(reactor_t *reactor, reactor_source_t *source);
+
+/**
+ * @brief Creates a periodic timer file descriptor.
+ *
+ * @param interval_ms Interval between expirations in milliseconds.
+ *
+ * @return Returns the timer file descriptor.
+ */
+int reactor_timer(long interval_ms);
+
+/**
+ * @brief Consumes the pending expirations of a timer file descriptor.
+ *
+ * @param timer_fd The timer file descriptor.
+ *
+ * @return Returns the number of expirations since the last read.
+ */
+uint64_t reactor_timer_read(int timer_fd);
+
+/**
+ * @brief Runs the event loop until reactor_stop is called.
+ *
+ * @param reactor Pointer to the reactor.
+ */
+void reactor_run(reactor_t *reactor);
+
+/**
+ * @brief Stops the event loop after the current dispatch.
+ *
+ * @param reactor Pointer to the reactor.
+ */
+void reactor_stop(reactor_t *reactor);
+
+/**
+ * @brief Destroys the reactor.
+ *
+ * Sources still registered are owned by whoever added them and must be
+ * removed beforehand.
+ *
+ * @param reactor Pointer to the reactor.
+ */
+void reactor_destroy(reactor_t *reactor);
+
+#endif /* REACTOR_H_ */
@@ -0,0 +1,220 @@
+/**
+ * @file chunk.c
+ * @brief Function implementations for the chunks of the time-series files.
+ *
+ * The server writes every chunk compressed: the device and packet type
+ * columns keep their fixed width, and the time and value columns become the
+ * bit streams of gorilla.c, which turn a regular reading into a couple of
+ * bits. Raw chunks, the ones written before compression, are still decoded.
+ * Both the server and tsdbbench encode and decode through here, so the
+ * benchmark measures the same code.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "../commons.h"
+
+/**
+ * @brief Rounds a size up to a multiple of 8.
+ *
+ * @param size The size.
+ *
+ * @return The rounded size.
+ */
+size_t alignChunk(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+/**
+ * @brief Computes the size of a raw chunk.
+ *
+ * @param rows Rows of the chunk.
+ * @param flags Flags of the chunk.
+ *
+ * @return Bytes of the chunk, header and footer included.
+ */
+size_t rawChunkSize(int rows, unsigned char flags) {
+    size_t size = sizeof(struct TSDBChunk) + (size_t)rows * (8 + 8 + 2 + 1);
+
+    if (flags & TSDB_TEXT) {
+        size += (size_t)rows * 8;
+    }
+    if (flags & TSDB_TEXT_MAP) {
+        size += GORILLA_MAP_BYTES(rows);
+    }
+    return alignChunk(size) + 8;
+}
+
+/**
+ * @brief Computes the largest size a chunk can have with any encoding.
+ *
+ * @param rows Rows of the chunk.
+ *
+ * @return Bytes of the chunk, header and footer included.
+ */
+size_t chunkMaxSize(int rows) {
+    size_t raw = rawChunkSize(rows, TSDB_TEXT | TSDB_TEXT_MAP);
+    size_t compressed = alignChunk(sizeof(struct TSDBChunk) + (size_t)rows * 3 + 8 +
+        GORILLA_TIME_BYTES(rows) + GORILLA_VALUE_BYTES(rows)) + 8;
+
+    return raw > compressed ? raw : compressed;
+}
+
+/**
+ * @brief Encodes rows as a chunk, leaving its checksum to the caller.
+ *
+ * @param rows The rows, at least one.
+ * @param firstSeq Sequence number of the first row.
+ * @param compress Whether the time and value columns are compressed.
+ * @param chunk Where the chunk is written, at least chunkMaxSize(rows->count) bytes.
+ *
+ * @return Size of the chunk.
+ */
+size_t encodeChunk(const struct TSDBRows *rows, uint64_t firstSeq, bool compress, char *chunk) {
+    struct TSDBChunk header;
+    uint32_t footer[2], streams[2];
+    size_t position = sizeof(header);
+    bool numbers = false;
+    int count = rows->count, i;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = TSDB_MAGIC;
+    header.version = TSDB_VERSION;
+    header.flags = compress ? TSDB_GORILLA : rows->hasText ? TSDB_TEXT | TSDB_TEXT_MAP : 0;
+    header.rows = (uint16_t)count;
+    header.firstSeq = firstSeq;
+    header.minTime = header.maxTime = rows->time[0];
+    for (i = 0; i < count; i++) {
+        header.minTime = rows->time[i] < header.minTime ? rows->time[i] : header.minTime;
+        header.maxTime = rows->time[i] > header.maxTime ? rows->time[i] : header.maxTime;
+        if (rows->hasText && GORILLA_IS_TEXT(rows->textMap, i)) {
+            continue;
+        }
+        if (!numbers || rows->value[i] < header.minValue) {
+            header.minValue = rows->value[i];
+        }
+        if (!numbers || rows->value[i] > header.maxValue) {
+            header.maxValue = rows->value[i];
+        }
+        numbers = true;
+    }
+
+    if (compress) {
+        memcpy(chunk + position, rows->device, count * 2);
+        position += count * 2;
+        memcpy(chunk + position, rows->op, count);
+        position += count + 8;
+        streams[0] = gorilla_encode_times(rows->time, count, chunk + position);
+        position += streams[0];
+        streams[1] = gorilla_encode_values(rows->value, rows->hasText ? rows->textMap : NULL, rows->text, count, chunk + position);
+        position += streams[1];
+        memcpy(chunk + sizeof(header) + count * 3, streams, 8);
+    } else {
+        memcpy(chunk + position, rows->time, count * 8);
+        position += count * 8;
+        memcpy(chunk + position, rows->value, count * 8);
+        position += count * 8;
+        memcpy(chunk + position, rows->device, count * 2);
+        position += count * 2;
+        memcpy(chunk + position, rows->op, count);
+        position += count;
+        if (header.flags & TSDB_TEXT) {
+            memcpy(chunk + position, rows->text, count * 8);
+            position += count * 8;
+            memcpy(chunk + position, rows->textMap, GORILLA_MAP_BYTES(count));
+            position += GORILLA_MAP_BYTES(count);
+        }
+    }
+
+    /* Padding and footer */
+    header.size = alignChunk(position) + 8;
+    memset(chunk + position, 0, header.size - 8 - position);
+    footer[0] = header.size;
+    footer[1] = TSDB_MAGIC;
+    memcpy(chunk + header.size - 8, footer, 8);
+    memcpy(chunk, &header, sizeof(header));
+    return header.size;
+}
+
+/**
+ * @brief Checks that a header describes a chunk that fits.
+ *
+ * @param header The header.
+ * @param available Bytes from the start of the chunk to the end of its file.
+ *
+ * @return Returns true if the header is valid.
+ */
+bool checkChunk(const struct TSDBChunk *header, uint64_t available) {
+    if (header->magic != TSDB_MAGIC || header->version != TSDB_VERSION ||
+        header->rows == 0 || header->rows > TSDB_CHUNK_ROWS || header->size > available || header->size % 8 != 0) {
+        return false;
+    }
+    if (header->flags & TSDB_GORILLA) {
+        return header->size >= alignChunk(sizeof(*header) + header->rows * 3 + 8) + 8 && header->size <= chunkMaxSize(header->rows);
+    }
+    return header->size == rawChunkSize(header->rows, header->flags);
+}
+
+/**
+ * @brief Decodes the rows of a chunk whose header passed checkChunk.
+ *
+ * @param chunk The chunk.
+ * @param rows Where the rows are stored.
+ *
+ * @return Returns false if the columns are corrupted.
+ */
+bool decodeChunk(const char *chunk, struct TSDBRows *rows) {
+    struct TSDBChunk header;
+    uint32_t streams[2];
+    size_t position = sizeof(header);
+    int count, i;
+
+    memcpy(&header, chunk, sizeof(header));
+    count = rows->count = header.rows;
+    rows->hasText = false;
+
+    if (header.flags & TSDB_GORILLA) {
+        memcpy(rows->device, chunk + position, count * 2);
+        position += count * 2;
+        memcpy(rows->op, chunk + position, count);
+        position += count;
+        memcpy(streams, chunk + position, 8);
+        position += 8;
+        if ((uint64_t)streams[0] + streams[1] > header.size - 8 - position ||
+            !gorilla_decode_times(chunk + position, streams[0], rows->time, count) ||
+            !gorilla_decode_values(chunk + position + streams[0], streams[1], rows->value, rows->textMap, rows->text, count)) {
+            return false;
+        }
+        for (i = 0; i < count && !rows->hasText; i++) {
+            rows->hasText = GORILLA_IS_TEXT(rows->textMap, i);
+        }
+        return true;
+    }
+
+    memcpy(rows->time, chunk + position, count * 8);
+    position += count * 8;
+    memcpy(rows->value, chunk + position, count * 8);
+    position += count * 8;
+    memcpy(rows->device, chunk + position, count * 2);
+    position += count * 2;
+    memcpy(rows->op, chunk + position, count);
+    position += count;
+    if (header.flags & TSDB_TEXT) {
+        memcpy(rows->text, chunk + position, count * 8);
+        position += count * 8;
+        rows->hasText = true;
+    }
+    if (header.flags & TSDB_TEXT_MAP) {
+        memcpy(rows->textMap, chunk + position, GORILLA_MAP_BYTES(count));
+        return true;
+    }
+    for (i = 0; i < count; i++) {
+        if (!rows->hasText) {
+            rows->text[i][0] = '\0';
+        }
+        GORILLA_SET_TEXT(rows->textMap, i, rows->text[i][0] != '\0');
+    }
+    return true;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file chunk.h
+ * @brief Function definitions for the chunks of the time-series files.
+ *
+ * This file contains the layout of a chunk and the definitions of the
+ * functions that encode a set of rows as a chunk and decode it back.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include "../commons.h"
+
+#define TSDB_CHUNK_ROWS 256 /* Rows of a full chunk. */
+#define TSDB_MAGIC 0x42445354 /* "TSDB" read as a little-endian u32. */
+#define TSDB_VERSION 1
+#define TSDB_TEXT 0x01 /* Chunk flag, the raw chunk has the text column. */
+#define TSDB_GORILLA 0x02 /* Chunk flag, the time and value columns are compressed. */
+#define TSDB_TEXT_MAP 0x04 /* Chunk flag, the raw chunk has the bitmap of the text rows. */
+
+/*
+Chunk, fields in host byte order:
+- struct TSDBChunk, the header.
+- Raw columns:
+    - u64 time[rows]: Milliseconds since the epoch.
+    - f64 value[rows]: Numeric value, 0 for text values.
+    - u16 device[rows]: Interned device, its index in TSDB_DEVICES.
+    - u8 op[rows]: Packet type that carried the value, SEND_DATA, SET_DATA or GET_DATA.
+    - char text[rows][8]: Only with TSDB_TEXT, the value of the rows that aren't a number, empty for numbers.
+    - u8 textMap[(rows + 7) / 8]: Only with TSDB_TEXT_MAP, bit i (of byte i / 8, from the least significant)
+      set if row i isn't a number. Without it a row is text if its text isn't empty.
+- Or with TSDB_GORILLA:
+    - u16 device[rows], u8 op[rows]: As the raw columns.
+    - u32 time bytes, u32 value bytes: Size of the streams.
+    - The time and value streams of gorilla.h, text values included, empty ones too.
+- Zeros up to a multiple of 8 bytes, and the footer: u32 size and u32 TSDB_MAGIC.
+*/
+
+/**
+ * @brief Header of a chunk of a time-series file.
+ */
+struct TSDBChunk {
+    uint32_t magic; /**< TSDB_MAGIC */
+    unsigned char version; /**< TSDB_VERSION */
+    unsigned char flags; /**< TSDB_TEXT, TSDB_GORILLA */
+    uint16_t rows; /**< Rows of the chunk, 1-TSDB_CHUNK_ROWS */
+    uint32_t size; /**< Bytes of the chunk, header and footer included */
+    uint32_t checksum; /**< walChecksum of the bytes from firstSeq to the footer */
+    uint64_t firstSeq; /**< Sequence number of the first row in its file */
+    uint64_t minTime; /**< Time of the oldest row */
+    uint64_t maxTime; /**< Time of the newest row */
+    double minValue; /**< Smallest numeric value, 0 if there's none */
+    double maxValue; /**< Largest numeric value, 0 if there's none */
+};
+
+/**
+ * @brief Represents the columns of the rows of a chunk.
+ */
+struct TSDBRows {
+    int count; /**< Rows, 0-TSDB_CHUNK_ROWS */
+    bool hasText; /**< Some row isn't a number */
+    unsigned char textMap[GORILLA_MAP_BYTES(TSDB_CHUNK_ROWS)]; /**< Bitmap of the rows that aren't a number, GORILLA_IS_TEXT */
+    uint64_t time[TSDB_CHUNK_ROWS];
+    double value[TSDB_CHUNK_ROWS];
+    uint16_t device[TSDB_CHUNK_ROWS];
+    unsigned char op[TSDB_CHUNK_ROWS];
+    char text[TSDB_CHUNK_ROWS][8];
+};
+
+/**
+ * @brief Computes the size of a raw chunk.
+ *
+ * @param rows Rows of the chunk.
+ * @param flags Flags of the chunk.
+ *
+ * @return Bytes of the chunk, header and footer included.
+ */
+size_t rawChunkSize(int rows, unsigned char flags);
+
+/**
+ * @brief Computes the largest size a chunk can have with any encoding.
+ *
+ * @param rows Rows of the chunk.
+ *
+ * @return Bytes of the chunk, header and footer included.
+ */
+size_t chunkMaxSize(int rows);
+
+/**
+ * @brief Encodes rows as a chunk, leaving its checksum to the caller.
+ *
+ * @param rows The rows, at least one.
+ * @param firstSeq Sequence number of the first row.
+ * @param compress Whether the time and value columns are compressed.
+ * @param chunk Where the chunk is written, at least chunkMaxSize(rows->count) bytes.
+ *
+ * @return Size of the chunk.
+ */
+size_t encodeChunk(const struct TSDBRows *rows, uint64_t firstSeq, bool compress, char *chunk);
+
+/**
+ * @brief Checks that a header describes a chunk that fits.
+ *
+ * @param header The header.
+ * @param available Bytes from the start of the chunk to the end of its file.
+ *
+ * @return Returns true if the header is valid.
+ */
+bool checkChunk(const struct TSDBChunk *header, uint64_t available);
+
+/**
+ * @brief Decodes the rows of a chunk whose header passed checkChunk.
+ *
+ * @param chunk The chunk.
+ * @param rows Where the rows are stored.
+ *
+ * @return Returns false if the columns are corrupted.
+ */
+bool decodeChunk(const char *chunk, struct TSDBRows *rows);
+
+#endif /* CHUNK_H */
@@ -146,6 +146,7 @@ void printList(struct Controller *controllers, int maxControllers) {
     int i, j;
     printf("--NOM--- ------IP------- -----MAC---- --RNDM-- ----ESTAT--- --SITUACIÓ-- --ELEMENTS-------------------------------------------\n");
     for (i = 0; i < maxControllers; i++) {
+        mtx_lock(&controllers[i].lock);
         printf("%s ", controllers[i].name);
         printInfoOrSpaces(controllers[i].data.ip, sizeof(controllers[i].data.ip) - 1);
         printf("%s ", controllers[i].mac);
@@ -156,6 +157,7 @@ void printList(struct Controller *controllers, int maxControllers) {
             printf("%s ", controllers[i].data.devices[j]);
         }
         printf("\n");
+        mtx_unlock(&controllers[i].lock);
     }
 }
 
@@ -165,9 +167,8 @@ void printList(struct Controller *controllers, int maxControllers) {
  *
  * This function initiates a data petition to a controller identified by the provided controller name,
  * device name, and value. It checks if the controller exists and is not disconnected, and if the 
- * device exists in the controller. If all conditions are met, it allocates memory for the arguments
- * of the independent thread, assigns values to the arguments, and creates a new thread to handle 
- * the data petition.
+ * device exists in the controller. If all conditions are met, it fills the arguments of the data
+ * petition and submits them to the thread pool, copied inline into the task.
  * 
  * @param controller Pointer to a string containing the controller name.
  * @param device Pointer to a string containing the device name.
@@ -180,30 +181,174 @@ void commandDataPetition(char *controller, char *device, char *value, struct Con
     int controllerNum;
     int deviceNum;
     
-    /* Check if the controller exists and is not disconnected */
-    mtx_lock(&mutex);
-    if ((controllerNum = hasController(controller, controllers,srvConf->numControllers)) != -1 && controllers[controllerNum].data.status != DISCONNECTED) {
+    /* Check if the controller exists */
+    if ((controllerNum = hasController(controller, controllers,srvConf->numControllers)) == -1) {
+        lwarning("Controller not found or disconnected", true);
+        return;
+    }
+
+    /* Check the controller is not disconnected */
+    mtx_lock(&controllers[controllerNum].lock);
+    if (controllers[controllerNum].data.status != DISCONNECTED) {
         /* Check if the device exists */
         if ((deviceNum = hasDevice(device, &controllers[controllerNum])) != -1) {
-            /* Allocate memory to hold the arguments for the independent thread */
-            struct dataPetition *args = malloc(sizeof(struct dataPetition));
-            if (args == NULL) {
-                mtx_unlock(&mutex);
-                lerror("Failed memory allocation for commandData Thread", true);
-            }
-            /* Assign values to the arguments */
-            args->controller = &controllers[controllerNum];
-            args->device = device;
-            args->value = value;
-            args->servConf = srvConf;
-            mtx_unlock(&mutex);
-            thread_pool_submit(threadpool,dataPetition,(void *)args);
+            /* Arguments for the worker, copied into the task */
+            struct dataPetition args;
+            args.controller = &controllers[controllerNum];
+            /* Copy the strings, the command line buffers don't outlive the command handler */
+            strcpy(args.device, device);
+            strcpy(args.value, value);
+            args.servConf = srvConf;
+            mtx_unlock(&controllers[controllerNum].lock);
+            /* Same worker as the controller UDP packets */
+            thread_pool_submit_inline_to(threadpool,hashKey(controllers[controllerNum].mac,12),dataPetition,&args,sizeof(args));
         } else {
+            mtx_unlock(&controllers[controllerNum].lock);
             lwarning("Device in controller %s not found", true, controllers[controllerNum].mac);
-            mtx_unlock(&mutex);
         }
     } else {
-        mtx_unlock(&mutex);
+        mtx_unlock(&controllers[controllerNum].lock);
         lwarning("Controller not found or disconnected", true);
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Prints the cached value of a device, or initiates a data petition if it's too old.
+ *
+ * This function looks up the last value stored of the device, received with SEND_DATA or a
+ * previous data petition. If there is one at most maxAge seconds old it's printed without
+ * contacting the controller, otherwise it falls back to commandDataPetition, which checks
+ * the controller and the device again.
+ * 
+ * @param controller Pointer to a string containing the controller name.
+ * @param device Pointer to a string containing the device name.
+ * @param maxAge Maximum age in seconds of the cached value.
+ * @param controllers Pointer to an array of Controller structures.
+ * @param srvConf Pointer to a Server structure.
+ * @param threadpool Pointer to thread pool
+ */ 
+void commandCachedGet(char *controller, char *device, int maxAge, struct Controller *controllers, struct Server *srvConf, thread_pool_t *threadpool) {
+    int controllerNum;
+    int deviceNum;
+    uint64_t age;
+
+    if ((controllerNum = hasController(controller, controllers,srvConf->numControllers)) != -1) {
+        mtx_lock(&controllers[controllerNum].lock);
+        if (controllers[controllerNum].data.status != DISCONNECTED &&
+            (deviceNum = hasDevice(device, &controllers[controllerNum])) != -1 &&
+            controllers[controllerNum].data.lastValueTimes[deviceNum] != 0 &&
+            (age = clock_coarse() - controllers[controllerNum].data.lastValueTimes[deviceNum]) <= (uint64_t)maxAge * 1000) {
+            STATS_ADD(cacheHits, 1);
+            linfo("Device %s of controller %s: %s (cached %lu ms ago)", true, device, controller,
+                controllers[controllerNum].data.lastValues[deviceNum], (unsigned long)age);
+            mtx_unlock(&controllers[controllerNum].lock);
+            return;
+        }
+        mtx_unlock(&controllers[controllerNum].lock);
+    }
+    STATS_ADD(cacheMisses, 1);
+    commandDataPetition(controller, device, "", controllers,srvConf,threadpool);
+}
+
+/**
+ * @brief Starts a history query of a device of a controller.
+ *
+ * This function checks the arguments of a history command, the controller must exist but doesn't
+ * need to be connected, and the times are local times as dd-mm-yy,HH:MM:SS or dd-mm-yy. The query
+ * reads the time-series files, so it's submitted to the thread pool to keep the server loop free.
+ * 
+ * @param arguments The arguments of the command line: controller, device, from and to.
+ * @param controllers Pointer to an array of Controller structures.
+ * @param srvConf Pointer to a Server structure.
+ * @param threadpool Pointer to thread pool
+ */ 
+void commandHistory(char *arguments, struct Controller *controllers, struct Server *srvConf, thread_pool_t *threadpool) {
+    char controller[64], device[64], from[64], to[64], extra;
+    struct historyQuery query;
+
+    if (sscanf(arguments, "%63s %63s %63s %63s %c", controller, device, from, to, &extra) != 4) {
+        linfo("Usage: history <controller-name> <device-name> <from> <to>, times as dd-mm-yy,HH:MM:SS or dd-mm-yy", true);
+        return;
+    }
+    if (strlen(controller) > 8) {
+        lwarning("Controller name exceeds maximum length. (8)", true);
+        return;
+    }
+    if (strlen(device) > 7) {
+        lwarning("Device name exceeds maximum length. (7)", true);
+        return;
+    }
+    if (!parseHistoryTime(from, false, &query.from) || !parseHistoryTime(to, true, &query.to)) {
+        lwarning("Invalid time, expected dd-mm-yy,HH:MM:SS or dd-mm-yy", true);
+        return;
+    }
+    if (query.from > query.to) {
+        lwarning("The start of the range is after its end", true);
+        return;
+    }
+    if (hasController(controller, controllers, srvConf->numControllers) == -1) {
+        lwarning("Controller not found", true);
+        return;
+    }
+    if (!(srvConf->dataFormat & DATA_TSDB)) {
+        lwarning("History only reads the time-series files, the records are stored with Data-format csv", true);
+    }
+    strcpy(query.controller, controller);
+    strcpy(query.device, device);
+    thread_pool_submit_inline(threadpool, historyQuery, &query, sizeof(query));
+}
+
+
+/**
+ * @brief Starts a rollup query of a device of a controller.
+ *
+ * This function checks the arguments of a rollup command like commandHistory, and the width, which
+ * must be one of the bucket widths in seconds of Rollup-buckets. The query reads the rollup file of
+ * the controller and width, so it's submitted to the thread pool.
+ * 
+ * @param arguments The arguments of the command line: controller, device, width, from and to.
+ * @param controllers Pointer to an array of Controller structures.
+ * @param srvConf Pointer to a Server structure.
+ * @param threadpool Pointer to thread pool
+ */ 
+void commandRollup(char *arguments, struct Controller *controllers, struct Server *srvConf, thread_pool_t *threadpool) {
+    char controller[64], device[64], width[64], from[64], to[64], extra;
+    struct rollupQuery query;
+    int i;
+
+    if (sscanf(arguments, "%63s %63s %63s %63s %63s %c", controller, device, width, from, to, &extra) != 5) {
+        linfo("Usage: rollup <controller-name> <device-name> <width> <from> <to>, times as dd-mm-yy,HH:MM:SS or dd-mm-yy", true);
+        return;
+    }
+    if (strlen(controller) > 8) {
+        lwarning("Controller name exceeds maximum length. (8)", true);
+        return;
+    }
+    if (strlen(device) > 7) {
+        lwarning("Device name exceeds maximum length. (7)", true);
+        return;
+    }
+    for (query.width = -1, i = 0; i < srvConf->numRollupWidths; i++) {
+        if (strspn(width, "0123456789") == strlen(width) && atoi(width) == srvConf->rollupWidths[i]) {
+            query.width = i;
+        }
+    }
+    if (query.width == -1) {
+        lwarning("Width must be one of the bucket widths of Rollup-buckets", true);
+        return;
+    }
+    if (!parseHistoryTime(from, false, &query.from) || !parseHistoryTime(to, true, &query.to)) {
+        lwarning("Invalid time, expected dd-mm-yy,HH:MM:SS or dd-mm-yy", true);
+        return;
+    }
+    if (query.from > query.to) {
+        lwarning("The start of the range is after its end", true);
+        return;
+    }
+    if ((query.controller = hasController(controller, controllers, srvConf->numControllers)) == -1) {
+        lwarning("Controller not found", true);
+        return;
+    }
+    strcpy(query.device, device);
+    thread_pool_submit_inline(threadpool, rollupQuery, &query, sizeof(query));
+}
@@ -54,3 +54,35 @@ void printList(struct Controller *controllers, int maxControllers);
  * @param threadpool Pointer to thread pool
  */ 
 void commandDataPetition(char *controller, char *device, char *value, struct Controller *controllers, struct Server *srvConf, thread_pool_t *threadpool);
+
+/**
+ * @brief Starts a history query of a device of a controller.
+ * 
+ * @param arguments The arguments of the command line: controller, device, from and to.
+ * @param controllers Pointer to an array of Controller structures.
+ * @param srvConf Pointer to a Server structure.
+ * @param threadpool Pointer to thread pool
+ */ 
+void commandHistory(char *arguments, struct Controller *controllers, struct Server *srvConf, thread_pool_t *threadpool);
+
+/**
+ * @brief Prints the cached value of a device, or initiates a data petition if it's too old.
+ * 
+ * @param controller Pointer to a string containing the controller name.
+ * @param device Pointer to a string containing the device name.
+ * @param maxAge Maximum age in seconds of the cached value.
+ * @param controllers Pointer to an array of Controller structures.
+ * @param srvConf Pointer to a Server structure.
+ * @param threadpool Pointer to thread pool
+ */ 
+void commandCachedGet(char *controller, char *device, int maxAge, struct Controller *controllers, struct Server *srvConf, thread_pool_t *threadpool);
+
+/**
+ * @brief Starts a rollup query of a device of a controller.
+ * 
+ * @param arguments The arguments of the command line: controller, device, width, from and to.
+ * @param controllers Pointer to an array of Controller structures.
+ * @param srvConf Pointer to a Server structure.
+ * @param threadpool Pointer to thread pool
+ */ 
+void commandRollup(char *arguments, struct Controller *controllers, struct Server *srvConf, thread_pool_t *threadpool);
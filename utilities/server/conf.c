@@ -20,6 +20,36 @@ void remove_spaces(char *str) {
     str[count] = '\0';
 }
 
+/**
+ * @brief Parses the bucket widths of Rollup-buckets.
+ *
+ * The widths are seconds separated by commas, in increasing order, or none
+ * to disable the rollups. An invalid list keeps the default ones.
+ * 
+ * @param value The value of the setting.
+ * @param widths Where the widths are stored, ROLLUP_MAX_WIDTHS of them.
+ * @return The number of widths.
+ */
+int parseRollupWidths(char *value, int *widths) {
+    char *token, *save = NULL;
+    int count = 0, width;
+
+    if (strcmp(value, "none") == 0) {
+        return 0;
+    }
+    for (token = strtok_r(value, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+        width = atoi(token);
+        if (count == ROLLUP_MAX_WIDTHS || width < 1 || width > MAX_ROLLUP_WIDTH || (count > 0 && width <= widths[count - 1])) {
+            lwarning("Rollup-buckets must be none or up to %d increasing widths of 1 to %d seconds, using 60,3600.", true, ROLLUP_MAX_WIDTHS, MAX_ROLLUP_WIDTH);
+            widths[0] = 60;
+            widths[1] = 3600;
+            return 2;
+        }
+        widths[count++] = width;
+    }
+    return count;
+}
+
 /**
  * @brief Returns a struct with the server configuration.
  * 
@@ -30,22 +60,44 @@ struct Server serverConfig(const char *filename) {
     /*Create new struct*/
     struct Server srv;
     /*Initialise buffer*/
-    char buffer[20];
+    char buffer[40];
 
     /*Open file descriptor*/
     FILE *file = fopen(filename, "r");
     if (file == NULL) {
         lerror("Error opening file",true);
     }
+
+    /*Optional settings*/
+    srv.udpBatch = DEFAULT_UDP_BATCH;
+    srv.udpReceivers = 0;
+    srv.threads = 0;
+    srv.logOverflow = LOGGER_DROP;
+    srv.logBinary[0] = '\0';
+    srv.storageFiles = STORAGE_FILES;
+    srv.dataFormat = DATA_TSDB;
+    strcpy(srv.walFile, WAL_FILE);
+    srv.walSync = WAL_INTERVAL;
+    srv.rollupWidths[0] = 60;
+    srv.rollupWidths[1] = 3600;
+    srv.numRollupWidths = 2;
+
     while (fgets(buffer, sizeof(buffer), file) != NULL) {
         char *key;
         char *value;
         /* Remove all spaces from the line */
         remove_spaces(buffer);
         /*String tokenizer (Split key/value)*/
-        key = strtok(buffer, "=");
+        key = strtok(buffer, "=\n");
         value = strtok(NULL, "\n");
-        
+
+        /* Blank lines, and keys without a value like Log-binary= */
+        if (key == NULL || value == NULL) {
+            if (key != NULL) {
+                lwarning("Setting %s has no value, ignoring it.", true, key);
+            }
+            continue;
+        }
         if (strcmp(key, "Name") == 0) {
             strncpy(srv.name, value, sizeof(srv.name) - 1); 
             srv.name[sizeof(srv.name) - 1] = '\0';
@@ -56,6 +108,60 @@ struct Server serverConfig(const char *filename) {
             srv.tcp = atoi(value);
         } else if (strcmp(key, "UDP-port") == 0) {
             srv.udp = atoi(value);
+        } else if (strcmp(key, "UDP-batch") == 0) {
+            srv.udpBatch = atoi(value);
+            if (srv.udpBatch < 1 || srv.udpBatch > MAX_UDP_BATCH) {
+                lwarning("UDP-batch must be between 1 and %d, using %d.", true, MAX_UDP_BATCH, DEFAULT_UDP_BATCH);
+                srv.udpBatch = DEFAULT_UDP_BATCH;
+            }
+        } else if (strcmp(key, "Threads") == 0) {
+            srv.threads = atoi(value);
+            if (srv.threads < 0 || srv.threads > MAX_THREADS) {
+                lwarning("Threads must be between 0 and %d, using 0.", true, MAX_THREADS);
+                srv.threads = 0;
+            }
+        } else if (strcmp(key, "UDP-receivers") == 0) {
+            srv.udpReceivers = atoi(value);
+            if (srv.udpReceivers < 0 || srv.udpReceivers > MAX_UDP_RECEIVERS) {
+                lwarning("UDP-receivers must be between 0 and %d, using 0.", true, MAX_UDP_RECEIVERS);
+                srv.udpReceivers = 0;
+            }
+        } else if (strcmp(key, "Log-overflow") == 0) {
+            if (strcmp(value, "block") == 0) {
+                srv.logOverflow = LOGGER_BLOCK;
+            } else if (strcmp(value, "drop") != 0) {
+                lwarning("Log-overflow must be drop or block, using drop.", true);
+            }
+        } else if (strcmp(key, "Storage-files") == 0) {
+            srv.storageFiles = atoi(value);
+            if (srv.storageFiles < 1 || srv.storageFiles > MAX_STORAGE_FILES) {
+                lwarning("Storage-files must be between 1 and %d, using %d.", true, MAX_STORAGE_FILES, STORAGE_FILES);
+                srv.storageFiles = STORAGE_FILES;
+            }
+        } else if (strcmp(key, "Data-format") == 0) {
+            if (strcmp(value, "csv") == 0) {
+                srv.dataFormat = DATA_CSV;
+            } else if (strcmp(value, "both") == 0) {
+                srv.dataFormat = DATA_TSDB | DATA_CSV;
+            } else if (strcmp(value, "tsdb") != 0) {
+                lwarning("Data-format must be tsdb, csv or both, using tsdb.", true);
+            }
+        } else if (strcmp(key, "WAL-file") == 0) {
+            strncpy(srv.walFile, value, sizeof(srv.walFile) - 1);
+            srv.walFile[sizeof(srv.walFile) - 1] = '\0';
+        } else if (strcmp(key, "WAL-sync") == 0) {
+            if (strcmp(value, "none") == 0) {
+                srv.walSync = WAL_NONE;
+            } else if (strcmp(value, "batch") == 0) {
+                srv.walSync = WAL_BATCH;
+            } else if (strcmp(value, "interval") != 0) {
+                lwarning("WAL-sync must be none, interval or batch, using interval.", true);
+            }
+        } else if (strcmp(key, "Rollup-buckets") == 0) {
+            srv.numRollupWidths = parseRollupWidths(value, srv.rollupWidths);
+        } else if (strcmp(key, "Log-binary") == 0) {
+            strncpy(srv.logBinary, value, sizeof(srv.logBinary) - 1);
+            srv.logBinary[sizeof(srv.logBinary) - 1] = '\0';
         }
     }
     /* Configure UDP server address */
@@ -83,12 +189,14 @@ struct Server serverConfig(const char *filename) {
  * @param argv An array containing all the args
  * @param config_file A pointer to the config_file string
  * @param controllers A pointer to the controllers string
+ * @param threads A pointer to the worker threads number, -1 if not given
  */
-void readArgs(int argc, char *argv[], char **config_file, char **controllers) {
+void readArgs(int argc, char *argv[], char **config_file, char **controllers, int *threads) {
     int i = 1;
     /* Default file names */
     *config_file = "server.cfg";
     *controllers = "controllers.dat";
+    *threads = -1;
     /* Loop through command line arguments */
     for (;i < argc; i++) {
         /* Check for -c flag */
@@ -108,6 +216,17 @@ void readArgs(int argc, char *argv[], char **config_file, char **controllers) {
             } else {
                 lerror(" -u argument requires a file name.",true);
             }
+        } else if (strcmp(argv[i], "-t") == 0) {
+            /* If -t flag is found, check if there's a number next */
+            if (i + 1 < argc) {
+                *threads = atoi(argv[i + 1]);
+                if (*threads < 0 || *threads > MAX_THREADS) {
+                    lerror(" -t argument must be between 0 and %d.",true,MAX_THREADS);
+                }
+                i++; /* Ignore next arg */
+            } else {
+                lerror(" -t argument requires a number of threads.",true);
+            }
         } else if (strcmp(argv[i], "-d") == 0) {
             /* If -d flag is found, set debug mode*/
             enableDebug();
@@ -13,12 +13,28 @@
 
 #include "../commons.h"
 
+#define DEFAULT_UDP_BATCH 32 /* Datagrams received per recvmmsg call if UDP-batch is not set. */
+#define MAX_UDP_BATCH 1024 /* Maximum value accepted for UDP-batch. */
+#define MAX_UDP_RECEIVERS 64 /* Maximum value accepted for UDP-receivers. */
+#define MAX_ROLLUP_WIDTH 604800 /* Maximum bucket width accepted in Rollup-buckets, a week in seconds. */
+
 /*
 Define struct for server config
 - char name[9];
 - char mac[13];
 - unsigned short tcp; Range 0-65535
 - unsigned short udp; Range 0-65535
+- int udpBatch; Optional (UDP-batch), datagrams received per syscall
+- int threads; Optional (Threads or -t), worker threads, 0 starts one per online processor
+- int udpReceivers; Optional (UDP-receivers), SO_REUSEPORT sockets with their own thread, 0 reads from the main thread
+- logger_policy_t logOverflow; Optional (Log-overflow), drop or block when a thread log ring is full
+- char logBinary[32]; Optional (Log-binary), binary log file, empty to log text to the terminal
+- int storageFiles; Optional (Storage-files), data files kept open at once
+- int dataFormat; Optional (Data-format), tsdb, csv or both, DATA_TSDB and DATA_CSV bits
+- char walFile[32]; Optional (WAL-file), write-ahead log of the data records
+- enum WALSync walSync; Optional (WAL-sync), none, interval or batch
+- int rollupWidths[ROLLUP_MAX_WIDTHS]; Optional (Rollup-buckets), bucket widths in seconds, none disables the rollups
+- int numRollupWidths; Number of rollupWidths
 - struct sockaddr_in tcp_address;
 - struct sockaddr_in udp_address;
 */
@@ -28,6 +44,17 @@ struct Server{
     char mac[13];
     unsigned short tcp; /*Range 0-65535*/
     unsigned short udp; /*Range 0-65535*/
+    int threads; /*Range 0-MAX_THREADS*/
+    int udpBatch; /*Range 1-MAX_UDP_BATCH*/
+    int udpReceivers; /*Range 0-MAX_UDP_RECEIVERS*/
+    logger_policy_t logOverflow; /*drop or block*/
+    char logBinary[32]; /*Empty for text logs*/
+    int storageFiles; /*Range 1-MAX_STORAGE_FILES*/
+    int dataFormat; /*DATA_TSDB | DATA_CSV*/
+    char walFile[32];
+    enum WALSync walSync; /*none, interval or batch*/
+    int rollupWidths[ROLLUP_MAX_WIDTHS]; /*Seconds, increasing*/
+    int numRollupWidths; /*Range 0-ROLLUP_MAX_WIDTHS*/
     struct sockaddr_in tcp_address;
     struct sockaddr_in udp_address;
 };
@@ -47,7 +74,8 @@ struct Server serverConfig(const char *filename);
  * @param argv An array containing all the args
  * @param config_file A pointer to the config_file string
  * @param controllers A pointer to the controllers string
+ * @param threads A pointer to the worker threads number, -1 if not given
  */
-void readArgs(int argc, char *argv[], char **config_file, char **controllers);
+void readArgs(int argc, char *argv[], char **config_file, char **controllers, int *threads);
 
 #endif /* SERVER_CONF_H */
\ No newline at end of file
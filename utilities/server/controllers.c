@@ -10,6 +10,14 @@
 
 #include "../commons.h"
 
+/* Liveness deadlines of the subscribed controllers */
+timer_heap_t *liveness = NULL;
+
+/* Open addressing hash indexes (linear probing) over the controllers array, -1 marks empty slots */
+static int *macIndex = NULL;
+static int *nameIndex = NULL;
+static unsigned int indexMask = 0; /* Index size - 1, the size is a power of two */
+
 /* Only used to read the controllers */
 typedef struct {
     char name[9];
@@ -51,7 +59,7 @@ ctrl getNextLine(FILE* file) {
  * 
  * This function initializes a 'ControllerInfo' structure pointed to by 'info'.
  * It sets the status to 'DISCONNECTED', empties the 'situation' and 'rand' strings,
- * and initializes each element of the 'devices' array to an empty string.
+ * and initializes each element of the 'devices' array and its cached last value to an empty string.
  * It sets 'tcp' and 'udp' to zero, and empties the 'ip' string.
  * Finally, it sets 'lastPacketTime' to zero.
  * 
@@ -64,6 +72,8 @@ void initializeControllerInfo(struct ControllerInfo *info) {
     info->rand[0] = '\0';
     for (i = 0; i < 10; i++) {
         info->devices[i][0] = '\0';
+        info->lastValues[i][0] = '\0';
+        info->lastValueTimes[i] = 0;
     }
     info->tcp = 0;
     info->udp = 0;
@@ -93,15 +103,78 @@ struct Controller* addController(struct Controller *controllers, int *numControl
         lerror("Memory reallocation failed\n",true);
     }
 
+    controllers[*numControllers - 1].index = *numControllers - 1;
     strncpy(controllers[*numControllers - 1].name, name, 8);
     controllers[*numControllers - 1].name[8] = '\0';
     strncpy(controllers[*numControllers - 1].mac, mac, 12);
     controllers[*numControllers - 1].mac[12] = '\0';
     initializeControllerInfo(&controllers[*numControllers - 1].data);
+    controllers[*numControllers - 1].subs.socket = -1;
+    controllers[*numControllers - 1].subs.source = NULL;
 
     return controllers;
 }
 
+/**
+ * @brief Hashes a string of at most maxLen characters (FNV-1a).
+ *
+ * @param str The string to hash, doesn't need to be null-terminated if maxLen is reached.
+ * @param maxLen Maximum number of characters to hash.
+ * @return The hash of the string.
+ */
+unsigned int hashKey(const char *str, size_t maxLen) {
+    unsigned int hash = 2166136261u;
+    size_t i;
+    for (i = 0; i < maxLen && str[i] != '\0'; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Builds the MAC and name hash indexes of the controllers array.
+ *
+ * Both indexes have at least twice the slots of controllers so probe sequences stay short.
+ * Controllers are inserted in array order, so among entries with the same key the probe
+ * finds the lowest index first, just like the linear scans did.
+ *
+ * @param controllers Pointer to the array of controllers.
+ * @param numControllers The number of controllers.
+ */
+void buildIndexes(struct Controller *controllers, int numControllers) {
+    unsigned int size = 16;
+    unsigned int i, slot;
+
+    while (size < 2 * (unsigned int)numControllers) {
+        size *= 2;
+    }
+    free(macIndex);
+    free(nameIndex);
+    macIndex = malloc(size * sizeof(int));
+    nameIndex = malloc(size * sizeof(int));
+    if (macIndex == NULL || nameIndex == NULL) {
+        lerror("Memory allocation failed for controllers index", true);
+    }
+    memset(macIndex, -1, size * sizeof(int));
+    memset(nameIndex, -1, size * sizeof(int));
+    indexMask = size - 1;
+
+    for (i = 0; i < (unsigned int)numControllers; i++) {
+        slot = hashKey(controllers[i].mac, sizeof(controllers[i].mac)) & indexMask;
+        while (macIndex[slot] != -1) {
+            slot = (slot + 1) & indexMask;
+        }
+        macIndex[slot] = i;
+
+        slot = hashKey(controllers[i].name, sizeof(controllers[i].name)) & indexMask;
+        while (nameIndex[slot] != -1) {
+            slot = (slot + 1) & indexMask;
+        }
+        nameIndex[slot] = i;
+    }
+}
+
 /**
  * @brief Reads controller data from a file and dynamically allocates memory for each controller struct.
  *
@@ -116,6 +189,7 @@ struct Controller* addController(struct Controller *controllers, int *numControl
  */
 int loadControllers(struct Controller **controllers, const char *filename) {
     int numControllers = 0;
+    int i;
     ctrl controller;
     FILE *file = fopen(filename, "r");
     if (file == NULL) {
@@ -128,6 +202,14 @@ int loadControllers(struct Controller **controllers, const char *filename) {
         *controllers = addController(*controllers,&numControllers,controller.name,controller.mac);
     }
 
+    /* Initialise locks once the array won't be moved by realloc anymore */
+    for (i = 0; i < numControllers; i++) {
+        mtx_init(&(*controllers)[i].lock, mtx_plain);
+    }
+
+    /* Index controllers by MAC and name for the packet lookups */
+    buildIndexes(*controllers, numControllers);
+
     fclose(file);
 
     return numControllers;
@@ -139,53 +221,60 @@ int loadControllers(struct Controller **controllers, const char *filename) {
  * @brief Checks if a controller is allowed.
  *
  * This function checks if the given packet, specified by the MAC address and name, is allowed based on the
- * provided array of controllers. It iterates through the array of controllers and compares the MAC address
- * and name of each controller with the given packet. If a both values are equal, the controller is
+ * provided array of controllers. It probes the MAC hash index and, for each controller with the same MAC
+ * address, checks that its name is contained in the packet data. If both values match, the controller is
  * considered allowed and the function returns the index of the controller. Otherwise, the controller is considered
  * not allowed and the function returns -1.
  * 
- * @param packet The packet struct to check.
+ * @param packet Pointer to the view of the packet to check.
  * @param controllers Pointer to the array of Controller structs containing allowed controllers.
- * @return Returns 1 if the controller is allowed, 0 otherwise.
+ * @param maxControllers The number of controllers
+ * @return Returns the index of the allowed controller if found, otherwise returns -1.
  */
-int isUDPAllowed(const struct UDPPacket packet, struct Controller *controllers, int maxControlers) {
+int isUDPAllowed(const struct UDPView *packet, struct Controller *controllers, int maxControllers) {
+    const char *mac = udpMac(packet);
+    unsigned int slot = hashKey(mac, 13) & indexMask;
     int i;
 
-    /*Iterate over allowed controllers*/
-    for (i = 0; i < maxControlers; i++) {
-        if (strcmp(packet.mac, controllers[i].mac) == 0 && 
-            strstr(packet.data, controllers[i].name) != NULL) {
+    /*Probe controllers with the same MAC hash*/
+    while ((i = macIndex[slot]) != -1) {
+        if (i < maxControllers &&
+            strncmp(mac, controllers[i].mac, 13) == 0 && 
+            strstr(udpData(packet), controllers[i].name) != NULL) {
             /*Return index*/
             return i;
         }
+        slot = (slot + 1) & indexMask;
     }
 
-
     return -1;
 }
 
 /**
  * @brief Checks if a TCP packet is allowed.
  *
- * This function iterates through the provided array of controllers and compares the MAC address 
- * of the given TCP packet with each controller. If a matching controller is found, the function 
+ * This function probes the MAC hash index and compares the MAC address of the given TCP packet
+ * with each candidate controller. If a matching controller is found, the function 
  * returns the index of the controller in the array. Otherwise, it returns -1 indicating that the 
  * packet is not allowed.
  * 
- * @param packet The TCPPacket struct representing the TCP packet to check.
+ * @param packet Pointer to the view of the TCP packet to check.
  * @param controllers Pointer to the array of Controller structs containing allowed controllers.
  * @param maxControllers The number of controllers
  * @return Returns the index of the allowed controller if found, otherwise returns -1.
  */
-int isTCPAllowed(const struct TCPPacket* packet, struct Controller *controllers, int maxControllers) {
+int isTCPAllowed(const struct TCPView* packet, struct Controller *controllers, int maxControllers) {
+    const char *mac = tcpMac(packet);
+    unsigned int slot = hashKey(mac, 13) & indexMask;
     int i;
         
-    /*Iterate over allowed controllers*/
-    for (i = 0; i < maxControllers ; i++) {
-        if (strcmp(packet->mac, controllers[i].mac) == 0 ) {
+    /*Probe controllers with the same MAC hash*/
+    while ((i = macIndex[slot]) != -1) {
+        if (i < maxControllers && strncmp(mac, controllers[i].mac, 13) == 0) {
             /*Return index*/
             return i;
         }
+        slot = (slot + 1) & indexMask;
     }
 
     return -1;
@@ -219,7 +308,7 @@ void storeDevices(char *devices, char deviceArray[][8], char *delimiter) {
 /**
  * @brief Checks if a controller with the given name exists in the array of controllers.
  *
- * This function iterates through the array of controllers and compares each controller's name with the given name.
+ * This function probes the name hash index and compares each candidate controller's name with the given name.
  * If a controller with the same name is found, its index is returned. If no matching controller is found, -1 is returned.
  * 
  * @param name The name of the controller to search for.
@@ -228,12 +317,14 @@ void storeDevices(char *devices, char deviceArray[][8], char *delimiter) {
  * @return int The index of the controller if found, otherwise -1.
  */
 int hasController(char *name,struct Controller *controllers, int maxControllers){
+    unsigned int slot = hashKey(name, strlen(name)) & indexMask;
     int i;
-    for (i = 0; i < maxControllers; i++) {
-        if (strcmp(name, controllers[i].name) == 0) {
+    while ((i = nameIndex[slot]) != -1) {
+        if (i < maxControllers && strcmp(name, controllers[i].name) == 0) {
             /*Return index*/
             return i;
         }
+        slot = (slot + 1) & indexMask;
     }
     return -1;
 }
@@ -262,15 +353,64 @@ int hasDevice(const char *device, const struct Controller *controller) {
     return -1;
 }
 
+/**
+ * @brief Keeps the last value stored of a device of a controller.
+ *
+ * This function copies the value into the last-value cache of the controller with the
+ * current coarse time, so a get with a maximum age can answer without asking the controller.
+ * The cache is emptied with the rest of the data when the controller is disconnected.
+ * Must be called with the controller data locked.
+ * 
+ * @param device The device name.
+ * @param value The value stored.
+ * @param controller Pointer to the controller struct.
+ */
+void updateLastValue(const char *device, const char *value, struct Controller *controller) {
+    int deviceNum;
+
+    if ((deviceNum = hasDevice(device, controller)) != -1) {
+        strncpy(controller->data.lastValues[deviceNum], value, sizeof(controller->data.lastValues[0]) - 1);
+        controller->data.lastValues[deviceNum][sizeof(controller->data.lastValues[0]) - 1] = '\0';
+        controller->data.lastValueTimes[deviceNum] = clock_coarse();
+    }
+}
+
+/**
+ * @brief Registers a valid packet from a controller and re-arms its liveness deadline.
+ *
+ * This function stores the time of the last packet received and moves the controller
+ * liveness deadline LIVENESS_TIMEOUT milliseconds ahead. The coarse clock is enough
+ * here and cheaper on every packet, it never runs ahead of the precise one, so the
+ * liveness check can't expire a controller early.
+ * 
+ * @param controller Pointer to the controller struct that sent the packet.
+ */
+void keepAlive(struct Controller *controller) {
+    controller->data.lastPacketTime = clock_coarse();
+    timers_arm(liveness, controller->index, controller->data.lastPacketTime + LIVENESS_TIMEOUT);
+}
+
+/**
+ * @brief Stops checking the liveness of a controller.
+ *
+ * @param controller Pointer to the controller struct.
+ */
+void stopLiveness(struct Controller *controller) {
+    controller->data.lastPacketTime = 0;
+    timers_cancel(liveness, controller->index);
+}
+
 /**
  * @brief Disconnects a controller and sets its status to DISCONNECTED.
  *
- * This function resets the data of the provided controller to 0's and sets its status to DISCONNECTED.
+ * This function resets the data of the provided controller to 0's, sets its status to DISCONNECTED
+ * and cancels its liveness deadline.
  * 
  * @param controller Pointer to the controller struct to disconnect.
  */
 void disconnectController(struct Controller *controller) {
-    mtx_lock(&mutex);
+    mtx_lock(&controller->lock);
         initializeControllerInfo(&controller->data);
-    mtx_unlock(&mutex);
+        timers_cancel(liveness, controller->index);
+    mtx_unlock(&controller->lock);
 }
\ No newline at end of file
@@ -22,14 +22,36 @@ struct ControllerInfo{
     unsigned short tcp; /*Range 0-65535*/
     unsigned short udp; /*Range 0-65535*/
     char ip[INET_ADDRSTRLEN];
-    time_t lastPacketTime;
+    uint64_t lastPacketTime; /* Coarse monotonic milliseconds (clock_coarse), 0 if not checked */
+    char lastValues[10][7]; /* Last value stored of each device, same index as devices */
+    uint64_t lastValueTimes[10]; /* Coarse time (clock_coarse) it was stored, 0 if none */
 };
 
-/*Define struct to load authorized clients*/
+/*Define struct for a subscription handshake in progress*/
+struct Subscription{
+    int socket; /* Session socket waiting for [SUBS_INFO], -1 if there is no handshake */
+    reactor_source_t *source; /* Registration of socket in the reactor */
+    char rand[9]; /* Identifier sent in [SUBS_ACK] */
+    char situation[13]; /* Situation sent in [SUBS_REQ] */
+    struct Server *srvConf;
+};
+
+/*
+Define struct to load authorized clients.
+- name, mac and index never change once loaded and can be read without locking.
+- data and subs are protected by lock.
+
+Lock order: controller lock -> liveness timers lock -> stdout (logs).
+Never hold two controller locks at the same time, and release the controller
+lock before calling disconnectController, which takes it by itself.
+*/
 struct Controller{
+    int index; /* Position in the controllers array, used as timer id */
     char name[9];
     char mac[13];
+    mtx_t lock; /* Protects data */
     struct ControllerInfo data;
+    struct Subscription subs;
 };
 
 /* 
@@ -52,6 +74,12 @@ enum Status{
     SEND_HELLO = 0xa6
 };
 
+/* Milliseconds without packets before a controller is disconnected (3 HELLO periods) */
+#define LIVENESS_TIMEOUT 6000
+
+/* Liveness deadlines of the subscribed controllers, indexed by controller index */
+extern timer_heap_t *liveness;
+
 /**
  * @brief Reads controller data from a file and dynamically allocates memory for each controller struct.
  * 
@@ -63,26 +91,47 @@ enum Status{
  */
 int loadControllers(struct Controller **controllers, const char *filename);
 
+/**
+ * @brief Hashes a string of at most maxLen characters (FNV-1a).
+ * 
+ * Also used as thread pool hint, so every task of a controller runs on the same worker.
+ * 
+ * @param str The string to hash, doesn't need to be null-terminated if maxLen is reached.
+ * @param maxLen Maximum number of characters to hash.
+ * @return The hash of the string.
+ */
+unsigned int hashKey(const char *str, size_t maxLen);
+
+/**
+ * @brief Builds the MAC and name hash indexes of the controllers array.
+ * 
+ * Called by loadControllers, lookups (isUDPAllowed, isTCPAllowed, hasController) use these indexes.
+ * 
+ * @param controllers Pointer to the array of controllers.
+ * @param numControllers The number of controllers.
+ */
+void buildIndexes(struct Controller *controllers, int numControllers);
+
 /**
  * @brief Checks if a controller is allowed.
  * 
- * @param packet The packet struct to check.
+ * @param packet Pointer to the view of the packet to check.
  * @param controllers Pointer to the array of Controller structs containing allowed controllers.
  * @param maxControllers The number of controllers
- * @return Returns 1 if the controller is allowed, 0 otherwise.
+ * @return Returns the index of the allowed controller if found, otherwise returns -1.
  */
-int isUDPAllowed(const struct UDPPacket packet, struct Controller *controllers, int maxControllers);
+int isUDPAllowed(const struct UDPView *packet, struct Controller *controllers, int maxControllers);
 
 
 /**
  * @brief Checks if a TCP packet is allowed.
  * 
- * @param packet The TCPPacket struct representing the TCP packet to check.
+ * @param packet Pointer to the view of the TCP packet to check.
  * @param controllers Pointer to the array of Controller structs containing allowed controllers.
  *  @param maxControllers The number of controllers
  * @return Returns the index of the allowed controller if found, otherwise returns -1.
  */
-int isTCPAllowed(const struct TCPPacket* packet, struct Controller *controllers, int maxControllers);
+int isTCPAllowed(const struct TCPView* packet, struct Controller *controllers, int maxControllers);
 /**
  * @brief Tokenizes and stores an string into diferent devices names.
  * 
@@ -111,6 +160,35 @@ int hasDevice(const char *device, const struct Controller *controller);
  */
 int hasController(char *name,struct Controller *controllers, int maxControllers);
 
+/**
+ * @brief Keeps the last value stored of a device of a controller.
+ * 
+ * Must be called with the controller data locked.
+ * 
+ * @param device The device name.
+ * @param value The value stored.
+ * @param controller Pointer to the controller struct.
+ */
+void updateLastValue(const char *device, const char *value, struct Controller *controller);
+
+/**
+ * @brief Registers a valid packet from a controller and re-arms its liveness deadline.
+ *
+ * Must be called with the controller data locked.
+ *
+ * @param controller Pointer to the controller struct that sent the packet.
+ */
+void keepAlive(struct Controller *controller);
+
+/**
+ * @brief Stops checking the liveness of a controller.
+ *
+ * Must be called with the controller data locked.
+ *
+ * @param controller Pointer to the controller struct.
+ */
+void stopLiveness(struct Controller *controller);
+
 /**
  * @brief Disconnects a controller and sets its status to DISCONNECTED.
  * 
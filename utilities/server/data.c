@@ -3,7 +3,7 @@
  * @brief Function implementations for handling data communication.
  * 
  * This file contains function for handling data communication, including
- * saving TCPPacket data to a file and handling data petition communication.
+ * saving TCP packet data to a file and handling data petition communication.
  * 
  * @author Eric Bitria Ribes
  * @version 0.4
@@ -33,46 +33,42 @@ const char* getTCPName(enum TCPType type) {
 }
 
 /**
- * @brief Function to save TCPPacket data to a file.
+ * @brief Function to save TCP packet data to a file.
  *
- * This function saves the data from a TCPPacket struct to a file, appending it to an existing file
- * or creating a new one if necessary. The data is formatted and written to the file along with
- * information about the controller and the current timestamp.
+ * This function saves the data from a received TCP packet as a row of the controller
+ * time-series file, and/or as a text line of its data file, along with the current
+ * timestamp. The caller adds it to the rollups of the device once it's stored.
  *
- * @param packet The TCPPacket struct containing data to be saved.
- * @param controller The Controller struct containing information about the controller.
+ * @param packet Pointer to the view of the received packet containing data to be saved.
+ * @param name Name of the controller.
+ * @param situation Situation of the controller, copied under its lock.
  * @param packetType The type of packet from the data has been received.
+ * @param dataFormat Where the record is stored, DATA_TSDB and DATA_CSV bits.
+ * 
+ * Must be called without the controller lock, the write-ahead log may wait
+ * for its sync.
  * 
  * @return NULL if successful, a msg if failed to open/write/create file.
  */
-const char* save(struct TCPPacket *packet, struct Controller *controller, unsigned char packetType) {
-    char filename[50], date_str[9];
-    FILE *file;
-    time_t now;
-    struct tm *local_time;
-    /* Get current time */
-    time(&now);
-    local_time = localtime(&now);
-
-    /* Create filename using name and situation */
-    sprintf(filename, "%s-%s.data", controller->name, controller->data.situation);
-
-    /* Open file or create one */
-    if ((file = fopen(filename, "a")) == NULL) {
-        fclose(file);
-        return strerror(errno);
+const char* save(const struct TCPView *packet, const char *name, const char *situation, unsigned char packetType, int dataFormat) {
+    char line[80];
+    const char *error;
+    int length;
+
+    if (dataFormat & DATA_CSV) {
+        /* Format the record with the cached date and time */
+        length = sprintf(line, "%s,%s,%s,%s,%s\n", clock_date(), clock_time(), getTCPName(packetType), tcpDevice(packet), tcpValue(packet));
+
+        /* Append it to the buffer of the open data file */
+        if ((error = storageAppend(name, situation, line, length)) != NULL) {
+            return error;
+        }
     }
-
-    /* Save data */
-    strftime(date_str, sizeof(date_str), "%d-%m-%y", local_time);
-
-    /* Write data to file */
-    if (fprintf(file, "%s,%s,%s,%s,%s\n", date_str, get_current_time(), getTCPName(packetType), packet->device, packet->value) < 0) {
-        fclose(file);
-        return strerror(errno);
+    if (dataFormat & DATA_TSDB) {
+        if ((error = tsdbAppend(name, situation, packetType, tcpDevice(packet), tcpValue(packet))) != NULL) {
+            return error;
+        }
     }
-
-    fclose(file);
     return NULL;
 }
 
@@ -92,33 +88,33 @@ void dataPetition(void *st){
     int dataSckt;
     unsigned char packetType;
     struct sockaddr_in client_addr;
-    struct TCPPacket* dataPacket;
+    char buffer[PDUTCP];
+    struct TCPView dataPacket;
     struct timeval tcpTimeout;
     /* Packet msg */
     const char *result;
     char msg[80];
+    char situation[13];
     /* Create socket */
     if ((dataSckt = socket(AF_INET, SOCK_STREAM, 0)) < 0){
         lerror("Unexpected error opening socket", true);
     }
     /* Initialize server address struct */
-    mtx_lock(&mutex);
+    mtx_lock(&args->controller->lock);
     memset(&client_addr, 0, sizeof(client_addr));
     client_addr.sin_family = AF_INET;
     client_addr.sin_port = htons(args->controller->data.tcp);
 
     if (inet_pton(AF_INET, args->controller->data.ip, &client_addr.sin_addr) <= 0) {
         lwarning("Unexpected error when setting adress:",true);
-        mtx_unlock(&mutex);
+        mtx_unlock(&args->controller->lock);
         disconnectController(args->controller);
         return;
     }
-    mtx_unlock(&mutex);
+    mtx_unlock(&args->controller->lock);
     if (connect(dataSckt, (struct sockaddr *)&client_addr, sizeof(client_addr)) < 0) {
         close(dataSckt);
-        mtx_lock(&mutex);
         lwarning("Connection to controller %s failed", true,args->controller->name);
-        mtx_unlock(&mutex);
         disconnectController(args->controller);
         return;
     }
@@ -142,79 +138,80 @@ void dataPetition(void *st){
     /* Ensure the device is an actuator */
 
     /* Create and send SET_DATA packet */
-    mtx_lock(&mutex);
+    mtx_lock(&args->controller->lock);
     sendTcp(dataSckt,
-        createTCPPacket(packetType,
-                        args->servConf->mac,
-                        args->controller->data.rand,
-                        args->device,
-                        args->value,
-                        ""
-                        )
-                    );
-    mtx_unlock(&mutex);
+            packetType,
+            args->servConf->mac,
+            args->controller->data.rand,
+            args->device,
+            args->value,
+            ""
+    );
+    mtx_unlock(&args->controller->lock);
 
     /* Recv packet */
-    dataPacket = recvTcp(&dataSckt);
-
     /* Check packet */
-    if (dataPacket == NULL){
-        mtx_lock(&mutex);
+    if (!recvTcp(&dataSckt, buffer)){
         lwarning("Didn't receive DATA_ACK packet in 3 seconds. Disconnecting %s.",false,args->controller->name);
-        mtx_unlock(&mutex);
         disconnectController(args->controller);
 
         close(dataSckt);
         return;
     }
 
-    mtx_lock(&mutex);
-    if (strcmp(dataPacket->mac,args->controller->mac) != 0 || 
-        strcmp(dataPacket->rnd,args->controller->data.rand) != 0){
+    mtx_lock(&args->controller->lock);
+    if (!tcpView(&dataPacket, buffer) ||
+        strcmp(tcpMac(&dataPacket),args->controller->mac) != 0 || 
+        strcmp(tcpRnd(&dataPacket),args->controller->data.rand) != 0){
         lwarning("Recevied wrong DATA_ACK credentials. Disconnecting %s.",false,args->controller->name);
-        mtx_unlock(&mutex);
+        mtx_unlock(&args->controller->lock);
 
         disconnectController(args->controller);
 
         close(dataSckt);
         return;
     }
-    mtx_unlock(&mutex);
+    mtx_unlock(&args->controller->lock);
 
-    if(strcmp(dataPacket->device,args->device) != 0){
-        mtx_lock(&mutex);
+    if(strcmp(tcpDevice(&dataPacket),args->device) != 0){
         lwarning("Recevied wrong requested device. Disconnecting %s.",false,args->controller->name);
-        mtx_unlock(&mutex);
         disconnectController(args->controller);
 
         close(dataSckt);
         return;
     }
 
-    if(packetType == SET_DATA && strcmp(dataPacket->value,args->value) != 0){
-        mtx_lock(&mutex);
+    if(packetType == SET_DATA && strcmp(tcpValue(&dataPacket),args->value) != 0){
         lwarning("Recevied wrong value for requested device. Disconnecting %s.",false,args->controller->name);
-        mtx_unlock(&mutex);
         disconnectController(args->controller);
 
         close(dataSckt);
         return;
     }
     
-    switch (dataPacket->type) {
+    switch (tcpType(&dataPacket)) {
         case DATA_ACK:
 
             linfo("Received confirmation for device %s. Storing data...",true,args->device);
-            if ((result = save(dataPacket,args->controller,packetType)) == NULL){
-                linfo("Controller %s updated %s. Value: %s", false, dataPacket->mac,dataPacket->device,dataPacket->value);
+            /* Store it without the controller lock, only the situation is read */
+            mtx_lock(&args->controller->lock);
+            strcpy(situation, args->controller->data.situation);
+            mtx_unlock(&args->controller->lock);
+            result = save(&dataPacket,args->controller->name,situation,packetType,args->servConf->dataFormat);
+            if (result == NULL){
+                mtx_lock(&args->controller->lock);
+                updateLastValue(tcpDevice(&dataPacket),tcpValue(&dataPacket),args->controller);
+                rollupAdd(args->controller,tcpDevice(&dataPacket),tcpValue(&dataPacket));
+                mtx_unlock(&args->controller->lock);
+                linfo("Controller %s updated %s. Value: %s", false, tcpMac(&dataPacket),tcpDevice(&dataPacket),tcpValue(&dataPacket));
             } else {
                 /* Print fail messages */
-                sprintf(msg,"Couldn't store %s data %s.",dataPacket->device,result);
-                mtx_lock(&mutex);
-                lwarning("Couldn't store %s data from Controller: %s. Reason: %s", false,dataPacket->device,args->controller->name,result);
+                sprintf(msg,"Couldn't store %s data %s.",tcpDevice(&dataPacket),result);
+                mtx_lock(&args->controller->lock);
+                lwarning("Couldn't store %s data from Controller: %s. Reason: %s", false,tcpDevice(&dataPacket),args->controller->name,result);
                 /* Send error packet */
-                sendTcp(dataSckt, createTCPPacket(DATA_NACK,args->controller->mac,args->controller->data.rand,dataPacket->device,dataPacket->value,msg));
-                mtx_unlock(&mutex);
+                sendTcp(dataSckt, DATA_NACK,args->controller->mac,args->controller->data.rand,tcpDevice(&dataPacket),tcpValue(&dataPacket),msg);
+                mtx_unlock(&args->controller->lock);
                 /* Disconnect packet */
                 disconnectController(args->controller);
             }
@@ -222,7 +219,7 @@ void dataPetition(void *st){
 
         case DATA_NACK:
 
-            lwarning("Couldn't get device info: %s",true,dataPacket->data);
+            lwarning("Couldn't get device info: %s",true,tcpData(&dataPacket));
             break;
 
         case DATA_REJ:
@@ -254,67 +251,86 @@ void dataPetition(void *st){
  */
 void dataReception(void* args){
     struct dataThreadArgs *dataArgs = (struct dataThreadArgs*)args;
-    struct TCPPacket* tcp_packet;
+    char buffer[PDUTCP];
+    struct TCPView tcp_packet;
 
     int controllerIndex;
     unsigned char packetType = 0;
     char msg[80];
 
     /*Get Packet*/
-    tcp_packet = recvTcp(&dataArgs->client_socket);
-    if (tcp_packet == NULL) {
+    if (!recvTcp(&dataArgs->client_socket, buffer)) {
         lwarning("Haven't received data trough TCP socket in 3 seconds. Clossing socket...",false);
         close(dataArgs->client_socket);
-        free(tcp_packet);
+        return;
+    }
+    /*Check its fields are terminated, they are read in place*/
+    if (!tcpView(&tcp_packet, buffer)) {
+        lwarning("Received malformed packet. Expected [SEND_DATA].",false);
+        close(dataArgs->client_socket);
         return;
     }
     /*Check its SEND_DATA*/
-    if(tcp_packet->type != SEND_DATA){
-        lwarning("Received unexpected packet by controller %s. Expected [SEND_DATA].",false,tcp_packet->mac);
+    if(tcpType(&tcp_packet) != SEND_DATA){
+        lwarning("Received unexpected packet by controller %s. Expected [SEND_DATA].",false,tcpMac(&tcp_packet));
         close(dataArgs->client_socket);
-        free(tcp_packet);
         return;
     }
     /*Check allowed controller*/
-    if((controllerIndex = isTCPAllowed(tcp_packet, dataArgs->controllers,dataArgs->servConf->numControllers)) != -1){ 
-        if (strncmp(tcp_packet->rnd, dataArgs->controllers[controllerIndex].data.rand,8) == 0){ /* Check Identificator */
+    if((controllerIndex = isTCPAllowed(&tcp_packet, dataArgs->controllers,dataArgs->servConf->numControllers)) != -1){ 
+        bool disconnect = true; /* Disconnect once the controller lock is released */
+        bool store = false; /* Store once the controller lock is released */
+        char situation[13];
+
+        mtx_lock(&dataArgs->controllers[controllerIndex].lock);
+        if (fieldIsDigits(tcpRnd(&tcp_packet), 8) && strncmp(tcpRnd(&tcp_packet), dataArgs->controllers[controllerIndex].data.rand, 8) == 0){ /* Check Identificator */
             /*Check correct status*/
             if(dataArgs->controllers[controllerIndex].data.status == SEND_HELLO){
                 /*Check if controller has device*/
-                if(hasDevice(tcp_packet->device,&dataArgs->controllers[controllerIndex]) != -1){
-                    const char *result;
-                    /*Check error msg*/
-        /*---->*/    if ((result = save(tcp_packet,&dataArgs->controllers[controllerIndex],SEND_DATA)) == NULL){
-                        linfo("Controller %s updated %s. Value: %s", false, tcp_packet->mac,tcp_packet->device,tcp_packet->value);
-                        packetType = DATA_ACK;
-                    } else {
-                        sprintf(msg,"Couldn't store %s data %s.",tcp_packet->device,result);
-                        lwarning("Couldn't store %s data from Controller: %s. Reason: %s", false,tcp_packet->device,tcp_packet->mac,result);
-                        packetType = DATA_NACK;
-                        disconnectController(&dataArgs->controllers[controllerIndex]);
-                    }
+                if(hasDevice(tcpDevice(&tcp_packet),&dataArgs->controllers[controllerIndex]) != -1){
+                    strcpy(situation, dataArgs->controllers[controllerIndex].data.situation);
+                    store = true;
                 } else {
-                    sprintf(msg,"Controller doesn't have %s device.",tcp_packet->device);
-                    lwarning("Denied connection to Controller: %s. Reason: Controller doesn't have %s device. Disconnecting...", false, tcp_packet->mac,tcp_packet->device);
+                    sprintf(msg,"Controller doesn't have %s device.",tcpDevice(&tcp_packet));
+                    lwarning("Denied connection to Controller: %s. Reason: Controller doesn't have %s device. Disconnecting...", false, tcpMac(&tcp_packet),tcpDevice(&tcp_packet));
                     packetType = DATA_NACK;
-                    disconnectController(&dataArgs->controllers[controllerIndex]);
                 }
             } else {
                 sprintf(msg,"Controller is not in SEND_HELLO status.");
-                lwarning("Denied connection to Controller: %s. Reason: Controller is not in SEND_HELLO status. Disconnecting...", false, tcp_packet->mac);
+                lwarning("Denied connection to Controller: %s. Reason: Controller is not in SEND_HELLO status. Disconnecting...", false, tcpMac(&tcp_packet));
                 packetType = DATA_REJ;
-                disconnectController(&dataArgs->controllers[controllerIndex]);
             }
         } else {
             sprintf(msg,"Wrong Identification.");
-            lwarning("Denied connection to Controller: %s. Reason: Wrong Identification. Disconnecting...", false, tcp_packet->mac);
-            disconnectController(&dataArgs->controllers[controllerIndex]);
+            lwarning("Denied connection to Controller: %s. Reason: Wrong Identification. Disconnecting...", false, tcpMac(&tcp_packet));
             packetType = DATA_REJ;
         }
-
+        mtx_unlock(&dataArgs->controllers[controllerIndex].lock);
+
+        if (store) {
+            const char *result;
+            /*Check error msg*/
+/*---->*/   if ((result = save(&tcp_packet,dataArgs->controllers[controllerIndex].name,situation,SEND_DATA,dataArgs->servConf->dataFormat)) == NULL){
+                linfo("Controller %s updated %s. Value: %s", false, tcpMac(&tcp_packet),tcpDevice(&tcp_packet),tcpValue(&tcp_packet));
+                /* Take the lock again only to update the device */
+                mtx_lock(&dataArgs->controllers[controllerIndex].lock);
+                updateLastValue(tcpDevice(&tcp_packet),tcpValue(&tcp_packet),&dataArgs->controllers[controllerIndex]);
+                rollupAdd(&dataArgs->controllers[controllerIndex],tcpDevice(&tcp_packet),tcpValue(&tcp_packet));
+                mtx_unlock(&dataArgs->controllers[controllerIndex].lock);
+                packetType = DATA_ACK;
+                disconnect = false;
+            } else {
+                sprintf(msg,"Couldn't store %s data %s.",tcpDevice(&tcp_packet),result);
+                lwarning("Couldn't store %s data from Controller: %s. Reason: %s", false,tcpDevice(&tcp_packet),tcpMac(&tcp_packet),result);
+                packetType = DATA_NACK;
+            }
+        }
+        if (disconnect) {
+            disconnectController(&dataArgs->controllers[controllerIndex]);
+        }
     } else {
         sprintf(msg,"Not listed in allowed Controllers file.");
-        lwarning("Denied connection to Controller: %s. Reason: Not listed in allowed Controllers file. Disconnecting...", false, tcp_packet->mac);
+        lwarning("Denied connection to Controller: %s. Reason: Not listed in allowed Controllers file. Disconnecting...", false, tcpMac(&tcp_packet));
         packetType = DATA_REJ;
     }
 
@@ -324,14 +340,13 @@ void dataReception(void* args){
     device and its value and finally a msg describing the operation made.
     */
     sendTcp(dataArgs->client_socket, 
-            createTCPPacket(packetType,
-                            dataArgs->servConf->mac,
-                            tcp_packet->rnd,
-                            tcp_packet->device,
-                            tcp_packet->value,
-                            msg
-                            )
-            );
+            packetType,
+            dataArgs->servConf->mac,
+            tcpRnd(&tcp_packet),
+            tcpDevice(&tcp_packet),
+            tcpValue(&tcp_packet),
+            msg
+    );
     /*Close comunication*/
     close(dataArgs->client_socket);
     return;
@@ -3,7 +3,7 @@
  * @brief Function definitions for handling data communication.
  * 
  * This file contains function definitions for handling data communication, including
- * saving TCPPacket data to a file and handling data petition communication.
+ * saving TCP packet data to a file and handling data petition communication.
  * 
  * @author Eric Bitria Ribes
  * @version 0.2
@@ -36,20 +36,29 @@ struct dataThreadArgs {
 struct dataPetition {
     struct Controller *controller; /**< Pointer to controller information */
     struct Server *servConf; /**< Pointer to server configuration */
-    char *device; /**< Device identifier */
-    char *value; /**< Data value */
+    char device[8]; /**< Device identifier */
+    char value[7]; /**< Data value */
 };
 
 /**
- * @brief Function to save TCPPacket data to a file.
+ * @brief Function to get the name of a TCP type enum value.
+ * @param type The TCP type enum value.
+ * @return The name of the TCP type enum value as a string.
+ */
+const char* getTCPName(enum TCPType type);
+
+/**
+ * @brief Function to save TCP packet data to a file.
  *
- * @param packet The TCPPacket struct containing data to be saved.
- * @param controller The Controller struct containing information about the controller.
+ * @param packet Pointer to the view of the received packet containing data to be saved.
+ * @param name Name of the controller.
+ * @param situation Situation of the controller, copied under its lock.
  * @param packetType The type of packet from the data has been received.
+ * @param dataFormat Where the record is stored, DATA_TSDB and DATA_CSV bits.
  * 
  * @return NULL if successful, a msg if failed to open/write/create file.
  */
-const char *save(struct TCPPacket *packet, struct Controller *controller, unsigned char packetType);
+const char *save(const struct TCPView *packet, const char *name, const char *situation, unsigned char packetType, int dataFormat);
 
 /**
  * @brief Function to handle data petition communication.
@@ -0,0 +1,352 @@
+/**
+ * @file history.c
+ * @brief Function implementations for the history queries of the time-series files.
+ *
+ * A query maps the time-series files of the controller and only decodes the
+ * chunks whose time range overlaps the one asked for, printing their rows
+ * as it goes, so neither the file nor the result is ever loaded whole.
+ *
+ * The chunks are found through a time index of each file, the offset and
+ * time range of every chunk read from their headers. It's built the first
+ * time a file is queried and extended with the chunks appended since, so
+ * later queries only touch the headers of the new chunks. As the wall clock
+ * may go back, each entry also keeps the newest time up to it and the oldest
+ * time from it on: the first is sorted, and a binary search finds the first
+ * chunk that can hold the range, and the second tells when no chunk left
+ * can.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "../commons.h"
+
+/* Time indexes of the files queried so far, protected by historyLock */
+static struct HistoryIndex *indexes = NULL;
+static int numIndexes = 0;
+
+static mtx_t historyLock;
+
+/**
+ * @brief Initializes the lock of the time indexes.
+ */
+void historyInit() {
+    mtx_init(&historyLock, mtx_plain);
+}
+
+/**
+ * @brief Parses a time of a history query.
+ *
+ * @param str Local time as dd-mm-yy,HH:MM:SS, or dd-mm-yy for a whole day.
+ * @param end Whether the time stands for the last millisecond of its second, or of its day, instead of the first.
+ * @param time Where the milliseconds since the epoch are stored.
+ *
+ * @return Returns false if the time isn't valid.
+ */
+bool parseHistoryTime(const char *str, bool end, uint64_t *time) {
+    struct tm date;
+    time_t seconds;
+    int dateEnd = 0, timeEnd = 0, fields;
+
+    memset(&date, 0, sizeof(date));
+    fields = sscanf(str, "%2d-%2d-%2d%n,%2d:%2d:%2d%n", &date.tm_mday, &date.tm_mon, &date.tm_year, &dateEnd,
+        &date.tm_hour, &date.tm_min, &date.tm_sec, &timeEnd);
+    if (!(fields == 6 && str[timeEnd] == '\0') && !(fields == 3 && dateEnd > 0 && str[dateEnd] == '\0')) {
+        return false;
+    }
+    if (date.tm_mday < 1 || date.tm_mday > 31 || date.tm_mon < 1 || date.tm_mon > 12 ||
+        date.tm_hour > 23 || date.tm_min > 59 || date.tm_sec > 59) {
+        return false;
+    }
+    if (fields == 3 && end) {
+        date.tm_hour = 23;
+        date.tm_min = 59;
+        date.tm_sec = 59;
+    }
+    date.tm_mon -= 1;
+    date.tm_year += 100;
+    date.tm_isdst = -1;
+    if ((seconds = mktime(&date)) == (time_t)-1) {
+        return false;
+    }
+    *time = (uint64_t)seconds * 1000 + (end ? 999 : 0);
+    return true;
+}
+
+/**
+ * @brief Finds the time index of a file, adding an empty one if it's new.
+ *
+ * Must be called with historyLock held. The index of a file that was
+ * removed and created again is emptied.
+ *
+ * @param filename Name of the file.
+ * @param inode Inode of the file.
+ *
+ * @return The index, or NULL if it can't be allocated.
+ */
+struct HistoryIndex* getIndex(const char *filename, ino_t inode) {
+    struct HistoryIndex *index, *grown;
+    int i;
+
+    for (i = 0; i < numIndexes; i++) {
+        index = &indexes[i];
+        if (strcmp(index->filename, filename) == 0) {
+            if (index->inode != inode) {
+                index->inode = inode;
+                index->indexed = 0;
+                index->numChunks = 0;
+            }
+            return index;
+        }
+    }
+    if ((grown = (struct HistoryIndex*)realloc(indexes, (numIndexes + 1) * sizeof(struct HistoryIndex))) == NULL) {
+        return NULL;
+    }
+    indexes = grown;
+    index = &indexes[numIndexes++];
+    memset(index, 0, sizeof(*index));
+    strcpy(index->filename, filename);
+    index->inode = inode;
+    return index;
+}
+
+/**
+ * @brief Adds the chunks appended to a file since it was last indexed.
+ *
+ * Must be called with historyLock held. Only the header and footer of each
+ * chunk are read, its checksum is checked when it's decoded.
+ *
+ * @param index The index of the file.
+ * @param map The file, mapped.
+ * @param size Bytes of the file holding complete chunks.
+ */
+void updateIndex(struct HistoryIndex *index, const char *map, uint64_t size) {
+    struct HistoryChunk *chunk, *grown;
+    struct TSDBChunk header;
+    uint32_t footer[2];
+    int i;
+
+    if (size < index->indexed) {
+        index->indexed = 0;
+        index->numChunks = 0;
+    }
+    while (size - index->indexed >= sizeof(header) + 8) {
+        memcpy(&header, map + index->indexed, sizeof(header));
+        if (!checkChunk(&header, size - index->indexed)) {
+            break;
+        }
+        memcpy(footer, map + index->indexed + header.size - 8, 8);
+        if (footer[0] != header.size || footer[1] != TSDB_MAGIC) {
+            break;
+        }
+        if (index->numChunks == index->maxChunks) {
+            if ((grown = (struct HistoryChunk*)realloc(index->chunks, (index->maxChunks * 2 + 16) * sizeof(struct HistoryChunk))) == NULL) {
+                lwarning("Failed memory allocation for the time index of %s", true, index->filename);
+                return;
+            }
+            index->chunks = grown;
+            index->maxChunks = index->maxChunks * 2 + 16;
+        }
+        chunk = &index->chunks[index->numChunks];
+        chunk->offset = index->indexed;
+        chunk->minTime = chunk->minAfter = header.minTime;
+        chunk->maxTime = chunk->maxBefore = header.maxTime;
+        if (index->numChunks > 0 && chunk[-1].maxBefore > chunk->maxBefore) {
+            chunk->maxBefore = chunk[-1].maxBefore;
+        }
+        for (i = index->numChunks - 1; i >= 0 && index->chunks[i].minAfter > header.minTime; i--) {
+            index->chunks[i].minAfter = header.minTime;
+        }
+        index->numChunks++;
+        index->indexed += header.size;
+    }
+    if (index->indexed < size) {
+        lwarning("Time-series file %s is corrupted at byte %lu, the chunks after it can't be queried.", true,
+            index->filename, (unsigned long)index->indexed);
+    }
+}
+
+/**
+ * @brief Finds the first chunk of an index that can hold rows from a time on.
+ *
+ * @param index The index.
+ * @param from The time.
+ *
+ * @return Position of the chunk, numChunks if there's none.
+ */
+int findChunk(const struct HistoryIndex *index, uint64_t from) {
+    int low = 0, high = index->numChunks, middle;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (index->chunks[middle].maxBefore < from) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Prints the rows of a device inside a time range.
+ *
+ * @param rows The rows.
+ * @param device Identifier of the device.
+ * @param name Name of the device.
+ * @param query The query.
+ * @param out Stream where the rows are printed.
+ *
+ * @return Number of rows printed.
+ */
+int printRows(const struct TSDBRows *rows, int device, const char *name, const struct historyQuery *query, FILE *out) {
+    char date[20];
+    struct tm local;
+    time_t seconds;
+    int i, printed = 0;
+
+    for (i = 0; i < rows->count; i++) {
+        if (rows->device[i] != device || rows->time[i] < query->from || rows->time[i] > query->to) {
+            continue;
+        }
+        seconds = (time_t)(rows->time[i] / 1000);
+        localtime_r(&seconds, &local);
+        strftime(date, sizeof(date), "%d-%m-%y,%H:%M:%S", &local);
+        if (GORILLA_IS_TEXT(rows->textMap, i)) {
+            fprintf(out, "%s,%s,%s,%.7s\n", date, getTCPName(rows->op[i]), name, rows->text[i]);
+        } else {
+            fprintf(out, "%s,%s,%s,%g\n", date, getTCPName(rows->op[i]), name, rows->value[i]);
+        }
+        printed++;
+    }
+    return printed;
+}
+
+/**
+ * @brief Prints the rows of a device of one time-series file inside a time range.
+ *
+ * Must be called with historyLock held. The rows still buffered in memory
+ * are printed after the ones of the chunks.
+ *
+ * @param filename Name of the file.
+ * @param device Identifier of the device.
+ * @param query The query.
+ * @param out Stream where the rows are printed.
+ *
+ * @return Number of rows printed.
+ */
+int queryFile(const char *filename, int device, const struct historyQuery *query, FILE *out) {
+    struct TSDBRows buffered, rows;
+    struct TSDBChunk header;
+    struct HistoryIndex *index;
+    struct stat info;
+    char *map = NULL;
+    off_t size;
+    int fd, i, printed = 0;
+
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &info) < 0) {
+        lwarning("Failed to open time-series file %s: %s", true, filename, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    if ((size = tsdbSnapshot(filename, fd, &buffered)) > 0 &&
+        (map = (char*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        lwarning("Failed to map time-series file %s: %s", true, filename, strerror(errno));
+        map = NULL;
+    }
+    close(fd);
+
+    if (map != NULL && (index = getIndex(filename, info.st_ino)) != NULL) {
+        updateIndex(index, map, size);
+        for (i = findChunk(index, query->from); i < index->numChunks && index->chunks[i].minAfter <= query->to; i++) {
+            if (index->chunks[i].minTime > query->to || index->chunks[i].maxTime < query->from) {
+                continue;
+            }
+            memcpy(&header, map + index->chunks[i].offset, sizeof(header));
+            STATS_ADD(historyChunks, 1);
+            if (walChecksum(map + index->chunks[i].offset + 16, header.size - 8 - 16) != header.checksum ||
+                !decodeChunk(map + index->chunks[i].offset, &rows)) {
+                lwarning("Skipped corrupted chunk of %s at byte %lu.", true, filename, (unsigned long)index->chunks[i].offset);
+                continue;
+            }
+            printed += printRows(&rows, device, query->device, query, out);
+        }
+    }
+    if (map != NULL) {
+        munmap(map, size);
+    }
+    return printed + printRows(&buffered, device, query->device, query, out);
+}
+
+/**
+ * @brief Prints the records of a device of a controller inside a time range.
+ *
+ * Every situation of the controller has its own file, they're read one
+ * after the other in the order of their names. Queries run one at a time,
+ * as they share the time indexes.
+ *
+ * The rows are gathered in memory and printed at once after the queued log
+ * lines, holding stdout so no line of another thread lands among them. The
+ * files aren't read with stdout held, as the logger flusher waits for it.
+ *
+ * @param arg Pointer to a struct historyQuery.
+ */
+void historyQuery(void *arg) {
+    struct historyQuery *query = (struct historyQuery *)arg;
+    char pattern[30];
+    glob_t matches;
+    size_t i, length = 0;
+    char *result = NULL;
+    FILE *out;
+    int device, printed = 0;
+
+    STATS_ADD(historyQueries, 1);
+    sprintf(pattern, "%s-*.tsdb", query->controller);
+    if (glob(pattern, 0, NULL, &matches) != 0) {
+        linfo("No time-series files of controller %s.", true, query->controller);
+        return;
+    }
+    if ((device = tsdbDevice(query->device)) != -1) {
+        if ((out = open_memstream(&result, &length)) == NULL) {
+            lwarning("Failed to buffer the history of controller %s: %s", true, query->controller, strerror(errno));
+            globfree(&matches);
+            return;
+        }
+        mtx_lock(&historyLock);
+        for (i = 0; i < matches.gl_pathc; i++) {
+            printed += queryFile(matches.gl_pathv[i], device, query, out);
+        }
+        mtx_unlock(&historyLock);
+        fclose(out);
+
+        /* Queued lines go before the rows, which are written together */
+        logger_flush();
+        flockfile(stdout);
+        fwrite(result, 1, length, stdout);
+        fflush(stdout);
+        funlockfile(stdout);
+        free(result);
+    }
+    globfree(&matches);
+    STATS_ADD(historyRows, printed);
+    linfo("History of device %s of controller %s: %d records.", true, query->device, query->controller, printed);
+}
+
+/**
+ * @brief Frees the time indexes.
+ */
+void historyClose() {
+    int i;
+
+    mtx_lock(&historyLock);
+    for (i = 0; i < numIndexes; i++) {
+        free(indexes[i].chunks);
+    }
+    free(indexes);
+    indexes = NULL;
+    numIndexes = 0;
+    mtx_unlock(&historyLock);
+}
@@ -0,0 +1,82 @@
+/**
+ * @file history.h
+ * @brief Function definitions for the history queries of the time-series files.
+ *
+ * This file contains the definitions of the time index of each time-series
+ * file and of the history command that reads a time range from them.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "../commons.h"
+
+/**
+ * @brief Represents a chunk in the time index of a file.
+ */
+struct HistoryChunk {
+    uint64_t offset; /**< Where the chunk starts */
+    uint64_t minTime; /**< Oldest row of the chunk */
+    uint64_t maxTime; /**< Newest row of the chunk */
+    uint64_t maxBefore; /**< Newest row of this chunk and the ones before it */
+    uint64_t minAfter; /**< Oldest row of this chunk and the ones after it */
+};
+
+/**
+ * @brief Represents the time index of a time-series file.
+ */
+struct HistoryIndex {
+    char filename[50]; /**< Name of the file, name-situation.tsdb */
+    ino_t inode; /**< Inode of the file, a new one discards the index */
+    uint64_t indexed; /**< Bytes of the file already indexed */
+    struct HistoryChunk *chunks; /**< The chunks, in file order */
+    int numChunks; /**< Number of chunks */
+    int maxChunks; /**< Allocated chunks */
+};
+
+/**
+ * @brief Arguments of a history query.
+ */
+struct historyQuery {
+    char controller[9]; /**< Name of the controller */
+    char device[8]; /**< Name of the device */
+    uint64_t from; /**< Oldest time of the range, milliseconds since the epoch */
+    uint64_t to; /**< Newest time of the range, included */
+};
+
+/**
+ * @brief Initializes the lock of the time indexes.
+ */
+void historyInit();
+
+/**
+ * @brief Parses a time of a history query.
+ *
+ * @param str Local time as dd-mm-yy,HH:MM:SS, or dd-mm-yy for a whole day.
+ * @param end Whether the time stands for the last millisecond of its second, or of its day, instead of the first.
+ * @param time Where the milliseconds since the epoch are stored.
+ *
+ * @return Returns false if the time isn't valid.
+ */
+bool parseHistoryTime(const char *str, bool end, uint64_t *time);
+
+/**
+ * @brief Prints the records of a device of a controller inside a time range.
+ *
+ * Executed by the thread pool, the records are printed as the lines of the
+ * text data files while the chunks are read.
+ *
+ * @param arg Pointer to a struct historyQuery.
+ */
+void historyQuery(void *arg);
+
+/**
+ * @brief Frees the time indexes.
+ */
+void historyClose();
+
+#endif /* HISTORY_H */
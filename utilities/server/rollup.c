@@ -0,0 +1,360 @@
+/**
+ * @file rollup.c
+ * @brief Function implementations for the rollups of the device values.
+ *
+ * Statistics over a period used to be computed by reading back every
+ * record. Instead each value stored by save() is also added to the open
+ * bucket of its device for every width of Rollup-buckets, a count, minimum,
+ * maximum and sum, so a rollup file holds one record per device and bucket
+ * however many values arrived, and a query reads only those.
+ *
+ * A bucket is completed when a value of a later bucket arrives or by the
+ * clock tick once its time is over, and the completed buckets of a file
+ * are written together by the next tick, or as soon as ROLLUP_PENDING of
+ * them are waiting. The open buckets aren't in the write-ahead log, a crash
+ * loses them.
+ *
+ * Each controller has its own lock for its buckets and files, so writing
+ * the rollup files of one doesn't stop the values of the others.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "../commons.h"
+
+/* Rollups of each controller, indexed like controllers, each protected by its lock */
+static struct RollupController *rollups = NULL;
+static struct Controller *rollupControllers = NULL;
+static int numRollups = 0;
+
+/* Bucket widths in milliseconds */
+static uint64_t widths[ROLLUP_MAX_WIDTHS];
+static int numWidths = 0;
+
+/**
+ * @brief Allocates the rollups of every controller.
+ *
+ * @param controllers Pointer to the array of controllers.
+ * @param numControllers The number of controllers.
+ * @param bucketWidths Bucket widths in seconds.
+ * @param numBucketWidths Number of widths, 0 disables the rollups.
+ */
+void rollupInit(struct Controller *controllers, int numControllers, const int *bucketWidths, int numBucketWidths) {
+    int i;
+
+    if ((rollups = (struct RollupController*)calloc(numControllers, sizeof(struct RollupController))) == NULL) {
+        lerror("Failed memory allocation for rollups", true);
+    }
+    for (i = 0; i < numControllers; i++) {
+        mtx_init(&rollups[i].lock, mtx_plain);
+    }
+    for (i = 0; i < numBucketWidths; i++) {
+        widths[i] = (uint64_t)bucketWidths[i] * 1000;
+    }
+    numWidths = numBucketWidths;
+    rollupControllers = controllers;
+    numRollups = numControllers;
+}
+
+/**
+ * @brief Writes the completed buckets of a width of a controller to its rollup file.
+ *
+ * Must be called with the lock of the controller held. The buckets are dropped if the write fails.
+ *
+ * @param controller Index of the controller.
+ * @param width Index of the width.
+ */
+void writePending(int controller, int width) {
+    struct RollupController *rollup = &rollups[controller];
+    char filename[50];
+    size_t length = rollup->numPending[width] * sizeof(struct RollupRecord);
+    int fd;
+
+    if (rollup->numPending[width] == 0) {
+        return;
+    }
+    sprintf(filename, "%s-%lu.rollup", rollupControllers[controller].name, (unsigned long)(widths[width] / 1000));
+    if ((fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)) < 0 ||
+        write(fd, rollup->pending[width], length) != (ssize_t)length) {
+        lwarning("Failed to write rollup file %s: %s", true, filename, strerror(errno));
+    } else {
+        STATS_ADD(rollupBuckets, rollup->numPending[width]);
+        STATS_ADD(rollupWrites, 1);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    rollup->numPending[width] = 0;
+}
+
+/**
+ * @brief Moves an open bucket to the completed ones of its file.
+ *
+ * Must be called with the lock of the controller held.
+ *
+ * @param controller Index of the controller.
+ * @param series The device.
+ * @param width Index of the width.
+ */
+void completeBucket(int controller, struct RollupSeries *series, int width) {
+    struct RollupController *rollup = &rollups[controller];
+
+    if (series->buckets[width].count == 0) {
+        return;
+    }
+    rollup->pending[width][rollup->numPending[width]++] = series->buckets[width];
+    series->buckets[width].count = 0;
+    if (rollup->numPending[width] == ROLLUP_PENDING) {
+        writePending(controller, width);
+    }
+}
+
+/**
+ * @brief Adds a value of a device to the open buckets of every width.
+ *
+ * The device has the slot of its index in the devices of the controller. If
+ * another device had it, from a previous subscription, its buckets are
+ * completed first. Only this function changes the device of a slot, and
+ * the controller lock is held, so the name is interned before taking the
+ * lock of the rollups.
+ *
+ * @param controller Pointer to the controller struct.
+ * @param device Name of the device, one of the devices of the controller.
+ * @param value The value, ignored if it isn't a number.
+ */
+void rollupAdd(struct Controller *controller, const char *device, const char *value) {
+    struct RollupSeries *series;
+    struct RollupRecord *bucket;
+    uint64_t now, start;
+    double number;
+    char *end;
+    int slot, id = -1, i;
+
+    number = strtod(value, &end);
+    if (numWidths == 0 || value[0] == '\0' || *end != '\0' || !isfinite(number) ||
+        (slot = hasDevice(device, controller)) == -1) {
+        return;
+    }
+    now = clock_wall();
+    series = &rollups[controller->index].series[slot];
+    if (strcmp(series->device, device) != 0 && (id = tsdbInternDevice(device)) < 0) {
+        lwarning("Device dictionary full or not writable, %s isn't rolled up.", false, device);
+        return;
+    }
+
+    mtx_lock(&rollups[controller->index].lock);
+    if (id != -1) {
+        for (i = 0; i < numWidths; i++) {
+            completeBucket(controller->index, series, i);
+            series->buckets[i].device = (uint16_t)id;
+        }
+        strcpy(series->device, device);
+    }
+    for (i = 0; i < numWidths; i++) {
+        bucket = &series->buckets[i];
+        start = now - now % widths[i];
+        if (bucket->count > 0 && bucket->start != start) {
+            completeBucket(controller->index, series, i);
+        }
+        if (bucket->count == 0) {
+            bucket->start = start;
+            bucket->min = bucket->max = number;
+            bucket->sum = 0;
+        }
+        bucket->min = number < bucket->min ? number : bucket->min;
+        bucket->max = number > bucket->max ? number : bucket->max;
+        bucket->sum += number;
+        bucket->count++;
+    }
+    mtx_unlock(&rollups[controller->index].lock);
+    STATS_ADD(rollupValues, 1);
+}
+
+/**
+ * @brief Completes the buckets whose time is over and writes the completed ones.
+ *
+ * Called from the clock tick.
+ */
+void rollupFlushExpired() {
+    uint64_t now = clock_wall();
+    struct RollupSeries *series;
+    int c, s, w;
+
+    if (numWidths == 0) {
+        return;
+    }
+    for (c = 0; c < numRollups; c++) {
+        mtx_lock(&rollups[c].lock);
+        for (s = 0; s < 10; s++) {
+            series = &rollups[c].series[s];
+            for (w = 0; w < numWidths; w++) {
+                if (series->buckets[w].count > 0 && now >= series->buckets[w].start + widths[w]) {
+                    completeBucket(c, series, w);
+                }
+            }
+        }
+        for (w = 0; w < numWidths; w++) {
+            writePending(c, w);
+        }
+        mtx_unlock(&rollups[c].lock);
+    }
+}
+
+/**
+ * @brief Prints a bucket.
+ *
+ * @param bucket The bucket.
+ */
+void printBucket(const struct RollupRecord *bucket) {
+    char date[20];
+    struct tm local;
+    time_t seconds = (time_t)(bucket->start / 1000);
+
+    localtime_r(&seconds, &local);
+    strftime(date, sizeof(date), "%d-%m-%y,%H:%M:%S", &local);
+    printf("%s,%lu,%g,%g,%g\n", date, (unsigned long)bucket->count, bucket->min, bucket->max, bucket->sum / bucket->count);
+}
+
+/**
+ * @brief Prints a bucket of a query, or adds it to the previous one if it has the same start.
+ *
+ * @param bucket The bucket, NULL to print the held one.
+ * @param held The bucket waiting to be printed, count 0 if there's none.
+ *
+ * @return Number of buckets printed.
+ */
+int mergeBucket(const struct RollupRecord *bucket, struct RollupRecord *held) {
+    int printed = 0;
+
+    if (held->count > 0 && (bucket == NULL || bucket->start != held->start)) {
+        printBucket(held);
+        held->count = 0;
+        printed = 1;
+    }
+    if (bucket == NULL) {
+        return printed;
+    }
+    if (held->count == 0) {
+        *held = *bucket;
+        return printed;
+    }
+    held->min = bucket->min < held->min ? bucket->min : held->min;
+    held->max = bucket->max > held->max ? bucket->max : held->max;
+    held->sum += bucket->sum;
+    held->count += bucket->count;
+    return printed;
+}
+
+/**
+ * @brief Prints the buckets of a device of a controller inside a time range.
+ *
+ * The completed buckets are written and the size of the file and the open
+ * bucket taken under the lock of the controller, so a bucket is either in the mapped part
+ * of the file or open, never in both. The records are about in start order,
+ * a binary search finds the first one that can overlap the range, starting
+ * two widths before it, and the scan stops two widths after it.
+ *
+ * The buckets are printed after the queued log lines with stdout held, so
+ * no line of another thread lands among them. Nothing is locked or logged
+ * meanwhile, as the logger flusher waits for stdout.
+ *
+ * @param arg Pointer to a struct rollupQuery.
+ */
+void rollupQuery(void *arg) {
+    struct rollupQuery *query = (struct rollupQuery *)arg;
+    struct RollupRecord current, held, record;
+    char filename[50], *map = NULL;
+    uint64_t width = widths[query->width], first;
+    size_t count = 0, low, high, middle;
+    struct stat info;
+    int fd, slot, device, printed = 0;
+
+    STATS_ADD(rollupQueries, 1);
+    sprintf(filename, "%s-%lu.rollup", rollupControllers[query->controller].name, (unsigned long)(width / 1000));
+    if ((device = tsdbDevice(query->device)) == -1) {
+        linfo("No values of device %s have been rolled up.", true, query->device);
+        return;
+    }
+    fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+    mtx_lock(&rollups[query->controller].lock);
+    writePending(query->controller, query->width);
+    current.count = 0;
+    for (slot = 0; slot < 10; slot++) {
+        if (strcmp(rollups[query->controller].series[slot].device, query->device) == 0) {
+            current = rollups[query->controller].series[slot].buckets[query->width];
+        }
+    }
+    if (fd >= 0 && fstat(fd, &info) == 0) {
+        count = info.st_size / sizeof(struct RollupRecord);
+    }
+    mtx_unlock(&rollups[query->controller].lock);
+
+    if (count > 0 && (map = (char*)mmap(NULL, count * sizeof(struct RollupRecord), PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        lwarning("Failed to map rollup file %s: %s", true, filename, strerror(errno));
+        map = NULL;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    /* Queued lines go before the buckets, which are written together */
+    logger_flush();
+    flockfile(stdout);
+    held.count = 0;
+    if (map != NULL) {
+        first = query->from > 2 * width ? query->from - 2 * width : 0;
+        for (low = 0, high = count; low < high; ) {
+            middle = low + (high - low) / 2;
+            memcpy(&record, map + middle * sizeof(record), sizeof(record));
+            if (record.start < first) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        for (; low < count; low++) {
+            memcpy(&record, map + low * sizeof(record), sizeof(record));
+            if (record.start > query->to + 2 * width) {
+                break;
+            }
+            if (record.device == device && record.count > 0 && record.start <= query->to && record.start + width > query->from) {
+                printed += mergeBucket(&record, &held);
+            }
+        }
+        munmap(map, count * sizeof(struct RollupRecord));
+    }
+    if (current.count > 0 && current.start <= query->to && current.start + width > query->from) {
+        printed += mergeBucket(&current, &held);
+    }
+    printed += mergeBucket(NULL, &held);
+    fflush(stdout);
+    funlockfile(stdout);
+    linfo("Rollup of device %s of controller %s every %lu s: %d buckets.", true, query->device,
+        rollupControllers[query->controller].name, (unsigned long)(width / 1000), printed);
+}
+
+/**
+ * @brief Writes every bucket, the open ones as they are.
+ */
+void rollupClose() {
+    int c, s, w;
+
+    if (rollups == NULL) {
+        return;
+    }
+    for (c = 0; c < numRollups; c++) {
+        mtx_lock(&rollups[c].lock);
+        for (s = 0; s < 10; s++) {
+            for (w = 0; w < numWidths; w++) {
+                completeBucket(c, &rollups[c].series[s], w);
+            }
+        }
+        for (w = 0; w < numWidths; w++) {
+            writePending(c, w);
+        }
+        mtx_unlock(&rollups[c].lock);
+    }
+}
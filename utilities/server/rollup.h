@@ -0,0 +1,114 @@
+/**
+ * @file rollup.h
+ * @brief Function definitions for the rollups of the device values.
+ *
+ * This file contains the definitions of the per-device aggregates (count,
+ * minimum, maximum and average) kept at ingest time for each bucket width,
+ * and of the rollup files where the completed buckets are stored.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include "../commons.h"
+
+#define ROLLUP_MAX_WIDTHS 4 /* Maximum number of bucket widths in Rollup-buckets. */
+#define ROLLUP_PENDING 20 /* Completed buckets of a rollup file kept in memory before they're written. */
+
+/*
+Rollup file, name-width.rollup, one per controller and bucket width in seconds.
+A sequence of struct RollupRecord, in the order the buckets were completed,
+which is their start order give or take one bucket. A bucket still open when
+the server quits is written as it is, and the rest of it later as another
+record with the same start, so readers add up consecutive records of a
+device with the same start. The device is an index of the TSDB_DEVICES
+dictionary.
+*/
+
+/**
+ * @brief Represents a bucket of a rollup file, 40 bytes.
+ */
+struct RollupRecord {
+    uint64_t start; /**< Start of the bucket, milliseconds since the epoch, multiple of its width */
+    uint32_t count; /**< Number of values */
+    uint16_t device; /**< Identifier of the device */
+    uint16_t reserved; /**< Zero */
+    double min; /**< Smallest value */
+    double max; /**< Largest value */
+    double sum; /**< Sum of the values, the average is sum / count */
+};
+
+/**
+ * @brief Represents the open buckets of a device of a controller.
+ */
+struct RollupSeries {
+    char device[8]; /**< Name of the device, empty if the slot is free */
+    struct RollupRecord buckets[ROLLUP_MAX_WIDTHS]; /**< Open bucket of each width, count 0 if there's none */
+};
+
+/**
+ * @brief Represents the rollups of a controller, indexed like the devices of the controller.
+ */
+struct RollupController {
+    mtx_t lock; /**< Protects the buckets and the writes of the rollup files of the controller */
+    struct RollupSeries series[10]; /**< Open buckets of each device */
+    struct RollupRecord pending[ROLLUP_MAX_WIDTHS][ROLLUP_PENDING]; /**< Completed buckets not written yet */
+    int numPending[ROLLUP_MAX_WIDTHS]; /**< Number of them of each width */
+};
+
+/**
+ * @brief Arguments of a rollup query.
+ */
+struct rollupQuery {
+    int controller; /**< Index of the controller */
+    int width; /**< Index of the bucket width in Rollup-buckets */
+    char device[8]; /**< Name of the device */
+    uint64_t from; /**< Oldest time of the range, milliseconds since the epoch */
+    uint64_t to; /**< Newest time of the range, included */
+};
+
+/**
+ * @brief Allocates the rollups of every controller.
+ *
+ * @param controllers Pointer to the array of controllers.
+ * @param numControllers The number of controllers.
+ * @param bucketWidths Bucket widths in seconds.
+ * @param numBucketWidths Number of widths, 0 disables the rollups.
+ */
+void rollupInit(struct Controller *controllers, int numControllers, const int *bucketWidths, int numBucketWidths);
+
+/**
+ * @brief Adds a value of a device to the open buckets of every width.
+ *
+ * Must be called with the controller data locked.
+ *
+ * @param controller Pointer to the controller struct.
+ * @param device Name of the device, one of the devices of the controller.
+ * @param value The value, ignored if it isn't a number.
+ */
+void rollupAdd(struct Controller *controller, const char *device, const char *value);
+
+/**
+ * @brief Completes the buckets whose time is over and writes the completed ones.
+ */
+void rollupFlushExpired();
+
+/**
+ * @brief Prints the buckets of a device of a controller inside a time range.
+ *
+ * Executed by the thread pool, the buckets are printed while the rollup file is read.
+ *
+ * @param arg Pointer to a struct rollupQuery.
+ */
+void rollupQuery(void *arg);
+
+/**
+ * @brief Writes every bucket, the open ones as they are.
+ */
+void rollupClose();
+
+#endif /* ROLLUP_H */
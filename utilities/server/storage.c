@@ -0,0 +1,387 @@
+/**
+ * @file storage.c
+ * @brief Function implementations for the device data files writer.
+ *
+ * Opening, writing and closing the data file for every record cost three
+ * syscalls and a path lookup per reading. Instead the data files are kept
+ * open in a cache with a bounded number of descriptors, and the records are
+ * buffered and written when the buffer of a file is full, when the file is
+ * evicted as the least recently used one that can be written, or by the clock tick once they
+ * have waited STORAGE_FLUSH_AGE milliseconds. quit() writes and closes all.
+ *
+ * Records go to the write-ahead log first, with the position they'll have
+ * in their data file, and are copied to the buffer once the log is durable.
+ *
+ * A single lock protects the cache, it's only held to copy a record into
+ * its buffer and for the writes, never while waiting for the log.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "../commons.h"
+
+/* Cache slots, numFiles of them, fd -1 when free */
+static struct StorageFile *files = NULL;
+static int numFiles = 0;
+
+/* Open addressing hash index (linear probing) of the open files by filename, -1 marks empty slots */
+static int *fileIndex = NULL;
+static unsigned int indexMask = 0; /* Index size - 1, the size is a power of two */
+
+/* Free cache slots, a stack of numFree positions in files */
+static int *freeFiles = NULL;
+static int numFree = 0;
+
+/* Most and least recently used open files */
+static struct StorageFile *newest = NULL;
+static struct StorageFile *oldest = NULL;
+
+static mtx_t storageLock;
+
+/**
+ * @brief Allocates the cache of open data files.
+ *
+ * @param maxFiles Maximum number of data files kept open at once.
+ */
+void storageInit(int maxFiles) {
+    unsigned int size = 16;
+    int i;
+
+    while (size < 2 * (unsigned int)maxFiles) {
+        size *= 2;
+    }
+    if ((files = (struct StorageFile*)calloc(maxFiles, sizeof(struct StorageFile))) == NULL ||
+        (fileIndex = (int*)malloc(size * sizeof(int))) == NULL || (freeFiles = (int*)malloc(maxFiles * sizeof(int))) == NULL) {
+        lerror("Failed memory allocation for data files cache", true);
+    }
+    memset(fileIndex, -1, size * sizeof(int));
+    indexMask = size - 1;
+    for (i = 0; i < maxFiles; i++) {
+        files[i].fd = -1;
+        freeFiles[i] = maxFiles - 1 - i;
+    }
+    numFiles = numFree = maxFiles;
+    mtx_init(&storageLock, mtx_plain);
+}
+
+/**
+ * @brief Writes the buffered records of a file.
+ *
+ * Must be called with storageLock held. If the write fails the part of it
+ * that reached the file is cut off and the records stay buffered, so size
+ * keeps matching the file once a later write succeeds.
+ *
+ * @param file The file.
+ *
+ * @return NULL if successful, a msg if the write failed.
+ */
+const char* flushFile(struct StorageFile *file) {
+    size_t written = 0;
+    ssize_t result;
+    const char *error;
+
+    while (written < file->used) {
+        if ((result = write(file->fd, file->buffer + written, file->used - written)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = strerror(errno);
+            if (written > 0 && ftruncate(file->fd, file->size - file->used) < 0) {
+                lwarning("Failed to cut data file %s: %s", true, file->filename, strerror(errno));
+            }
+            return error;
+        }
+        written += result;
+    }
+    if (file->used > 0) {
+        STATS_ADD(storageWrites, 1);
+    }
+    file->used = 0;
+    return NULL;
+}
+
+/**
+ * @brief Adds an open file to the hash index.
+ *
+ * @param file The file.
+ */
+void indexFile(struct StorageFile *file) {
+    unsigned int slot = file->hash & indexMask;
+
+    while (fileIndex[slot] != -1) {
+        slot = (slot + 1) & indexMask;
+    }
+    fileIndex[slot] = (int)(file - files);
+}
+
+/**
+ * @brief Removes a file from the hash index.
+ *
+ * The entries after it in the probe sequence are moved back into the hole,
+ * so lookups never stop before them.
+ *
+ * @param file The file, in the index.
+ */
+void unindexFile(struct StorageFile *file) {
+    unsigned int slot = file->hash & indexMask, next, home;
+
+    while (fileIndex[slot] != (int)(file - files)) {
+        slot = (slot + 1) & indexMask;
+    }
+    for (next = (slot + 1) & indexMask; fileIndex[next] != -1; next = (next + 1) & indexMask) {
+        home = files[fileIndex[next]].hash & indexMask;
+        /* The entry can fill the hole unless its home is between the hole and it */
+        if (((next - home) & indexMask) >= ((next - slot) & indexMask)) {
+            fileIndex[slot] = fileIndex[next];
+            slot = next;
+        }
+    }
+    fileIndex[slot] = -1;
+}
+
+/**
+ * @brief Removes a file from the recently used list.
+ *
+ * @param file The file.
+ */
+void unlinkFile(struct StorageFile *file) {
+    if (file->prev != NULL) {
+        file->prev->next = file->next;
+    } else {
+        newest = file->next;
+    }
+    if (file->next != NULL) {
+        file->next->prev = file->prev;
+    } else {
+        oldest = file->prev;
+    }
+    file->prev = file->next = NULL;
+}
+
+/**
+ * @brief Puts a file at the front of the recently used list.
+ *
+ * @param file The file, not in the list.
+ */
+void pushFile(struct StorageFile *file) {
+    file->prev = NULL;
+    file->next = newest;
+    if (newest != NULL) {
+        newest->prev = file;
+    } else {
+        oldest = file;
+    }
+    newest = file;
+}
+
+/**
+ * @brief Writes the records and closes a file, leaving its slot free.
+ *
+ * The records are dropped if the write fails, the file is opened again at
+ * its real end. Only storageClose closes a file whose records aren't written.
+ *
+ * @param file The file.
+ *
+ * @return NULL if successful, a msg if the write failed.
+ */
+const char* closeFile(struct StorageFile *file) {
+    const char *error = flushFile(file);
+
+    file->used = 0;
+    unlinkFile(file);
+    unindexFile(file);
+    close(file->fd);
+    file->fd = -1;
+    freeFiles[numFree++] = (int)(file - files);
+    return error;
+}
+
+/**
+ * @brief Finds the open file of a filename, or opens it in a free slot.
+ *
+ * The open files are found through their hash index. When every slot is
+ * taken the least recently used file whose records can be written is
+ * closed. A file whose records can't be written keeps its slot, they're
+ * acknowledged and the log keeps them until they're written.
+ *
+ * @param filename Name of the file.
+ * @param error Where the msg of a failed open or write is stored.
+ *
+ * @return The file, or NULL if it couldn't be opened or no file could be closed.
+ */
+struct StorageFile* getFile(const char *filename, const char **error) {
+    unsigned int hash = hashKey(filename, sizeof(files[0].filename));
+    struct StorageFile *file, *slot;
+    const char *evictError = NULL;
+    unsigned int probe = hash & indexMask;
+
+    while (fileIndex[probe] != -1) {
+        file = &files[fileIndex[probe]];
+        if (file->hash == hash && strcmp(file->filename, filename) == 0) {
+            unlinkFile(file);
+            pushFile(file);
+            return file;
+        }
+        probe = (probe + 1) & indexMask;
+    }
+
+    if (numFree == 0) {
+        for (file = oldest; file != NULL && (evictError = flushFile(file)) != NULL; file = file->prev) {
+            lwarning("Failed to write data file %s: %s", true, file->filename, evictError);
+        }
+        if (file == NULL) {
+            *error = evictError;
+            return NULL;
+        }
+        STATS_ADD(storageEvictions, 1);
+        closeFile(file);
+    }
+    slot = &files[freeFiles[numFree - 1]];
+    if ((slot->fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+        slot->fd = -1;
+        *error = strerror(errno);
+        return NULL;
+    }
+    numFree--;
+    STATS_ADD(storageOpens, 1);
+    strcpy(slot->filename, filename);
+    slot->hash = hash;
+    slot->used = 0;
+    slot->size = lseek(slot->fd, 0, SEEK_END);
+    pushFile(slot);
+    indexFile(slot);
+    return slot;
+}
+
+/**
+ * @brief Appends a record to the data file of a controller, through the write-ahead log.
+ *
+ * The record is only copied to the buffer of the file, it's written when the
+ * buffer is full, when the file is closed or by storageFlushExpired. Its
+ * position is taken before appending it to the log and can't change until
+ * it's copied, since the controller lock keeps other records of the same
+ * file out and the room for it is made first. The record is refused if
+ * there's no room because the buffered ones can't be written. The file may
+ * be closed meanwhile, so it's looked up again.
+ *
+ * @param name Name of the controller.
+ * @param situation Situation of the controller.
+ * @param line The record, ending with a newline.
+ * @param length Length of line.
+ *
+ * @return NULL if successful, a msg if failed to open/write/create file.
+ */
+const char* storageAppend(const char *name, const char *situation, const char *line, size_t length) {
+    char filename[50];
+    const char *error = NULL;
+    struct StorageFile *file;
+    uint64_t offset;
+
+    /* Create filename using name and situation */
+    sprintf(filename, "%s-%s.data", name, situation);
+
+    mtx_lock(&storageLock);
+    if ((file = getFile(filename, &error)) == NULL) {
+        mtx_unlock(&storageLock);
+        return error;
+    }
+    if (file->used + length > STORAGE_BUFFER && (error = flushFile(file)) != NULL) {
+        mtx_unlock(&storageLock);
+        return error;
+    }
+    offset = file->size;
+    mtx_unlock(&storageLock);
+
+    if ((error = walAppend(WAL_BYTES, filename, offset, line, length)) != NULL) {
+        return error;
+    }
+
+    mtx_lock(&storageLock);
+    STATS_ADD(storageRecords, 1);
+    if ((file = getFile(filename, &error)) == NULL) {
+        mtx_unlock(&storageLock);
+        walApplied();
+        return error;
+    }
+    if (file->used + length > STORAGE_BUFFER && (error = flushFile(file)) != NULL) {
+        mtx_unlock(&storageLock);
+        walApplied();
+        return error;
+    }
+    if (file->used == 0) {
+        file->firstWrite = clock_coarse();
+    }
+    memcpy(file->buffer + file->used, line, length);
+    file->used += length;
+    file->size += length;
+    mtx_unlock(&storageLock);
+    walApplied();
+    return error;
+}
+
+/**
+ * @brief Writes the records buffered for longer than STORAGE_FLUSH_AGE.
+ *
+ * Called from the clock tick, so a record reaches its file in at most
+ * STORAGE_FLUSH_AGE milliseconds plus one second.
+ */
+void storageFlushExpired() {
+    struct StorageFile *file;
+    uint64_t now = clock_coarse();
+    const char *error;
+
+    mtx_lock(&storageLock);
+    for (file = newest; file != NULL; file = file->next) {
+        if (file->used > 0 && now - file->firstWrite >= STORAGE_FLUSH_AGE && (error = flushFile(file)) != NULL) {
+            lwarning("Failed to write data file %s: %s", true, file->filename, error);
+        }
+    }
+    mtx_unlock(&storageLock);
+}
+
+/**
+ * @brief Writes every buffered record, keeping the data files open.
+ *
+ * @return Returns false if some records couldn't be written, they stay buffered.
+ */
+bool storageFlushAll() {
+    struct StorageFile *file;
+    const char *error;
+    bool written = true;
+
+    mtx_lock(&storageLock);
+    for (file = newest; file != NULL; file = file->next) {
+        if ((error = flushFile(file)) != NULL) {
+            lwarning("Failed to write data file %s: %s", true, file->filename, error);
+            written = false;
+        }
+    }
+    mtx_unlock(&storageLock);
+    return written;
+}
+
+/**
+ * @brief Writes every buffered record and closes all the data files.
+ *
+ * @return Returns false if some records couldn't be written, they're dropped.
+ */
+bool storageClose() {
+    struct StorageFile *file;
+    const char *error;
+    bool written = true;
+
+    if (files == NULL) {
+        return true;
+    }
+    mtx_lock(&storageLock);
+    while ((file = oldest) != NULL) {
+        if ((error = closeFile(file)) != NULL) {
+            lwarning("Failed to write data file %s: %s", true, file->filename, error);
+            written = false;
+        }
+    }
+    mtx_unlock(&storageLock);
+    return written;
+}
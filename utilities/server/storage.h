@@ -0,0 +1,79 @@
+/**
+ * @file storage.h
+ * @brief Function definitions for the device data files writer.
+ *
+ * This file contains the definitions of the cache of open data files where
+ * the records received from the controllers are appended.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "../commons.h"
+
+#define STORAGE_FILES 64 /* Data files kept open if Storage-files is not set. */
+#define MAX_STORAGE_FILES 1024 /* Maximum value accepted for Storage-files. */
+#define STORAGE_BUFFER 4096 /* Bytes buffered for a file before they're written. */
+#define STORAGE_FLUSH_AGE 1000 /* Milliseconds a buffered record waits before the clock tick writes it. */
+
+/**
+ * @brief Represents an open data file and the records not written yet.
+ */
+struct StorageFile {
+    char filename[50]; /**< Name of the file, name-situation.data */
+    unsigned int hash; /**< Hash of filename */
+    int fd; /**< File descriptor, -1 if the slot is free */
+    size_t used; /**< Bytes in buffer */
+    uint64_t size; /**< Bytes of the data file, buffered ones included */
+    uint64_t firstWrite; /**< Coarse time the oldest buffered record was added */
+    struct StorageFile *prev; /**< More recently used file */
+    struct StorageFile *next; /**< Less recently used file */
+    char buffer[STORAGE_BUFFER]; /**< Records not written yet */
+};
+
+/**
+ * @brief Allocates the cache of open data files.
+ *
+ * @param maxFiles Maximum number of data files kept open at once.
+ */
+void storageInit(int maxFiles);
+
+/**
+ * @brief Appends a record to the data file of a controller, through the write-ahead log.
+ *
+ * Must be called with the controller data locked, so the records of a data
+ * file are appended one at a time.
+ *
+ * @param name Name of the controller.
+ * @param situation Situation of the controller.
+ * @param line The record, ending with a newline.
+ * @param length Length of line.
+ *
+ * @return NULL if successful, a msg if failed to open/write/create file.
+ */
+const char* storageAppend(const char *name, const char *situation, const char *line, size_t length);
+
+/**
+ * @brief Writes the records buffered for longer than STORAGE_FLUSH_AGE.
+ */
+void storageFlushExpired();
+
+/**
+ * @brief Writes every buffered record, keeping the data files open.
+ *
+ * @return Returns false if some records couldn't be written, they stay buffered.
+ */
+bool storageFlushAll();
+
+/**
+ * @brief Writes every buffered record and closes all the data files.
+ *
+ * @return Returns false if some records couldn't be written, they're dropped.
+ */
+bool storageClose();
+
+#endif /* STORAGE_H */
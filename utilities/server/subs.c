@@ -9,70 +9,156 @@
 
 #include "../commons.h"
 
+/* [SUBS_INFO] deadlines of the subscriptions in progress, indexed by controller index */
+timer_heap_t *subscriptions = NULL;
+
 /**
- * @brief Handles the subscription process for a controller.
+ * @brief Starts the subscription process for a controller.
  *
- * This function initiates a subscription process for a controller. It generates a random
- * identifier, sets up a UDP socket, and handles acknowledgment and information packets
- * received from the controller. It waits for a certain time for the controller to send
- * subscription information and disconnects if no information is received within the timeout.
+ * This function generates a random identifier, sets up a session UDP socket and sends
+ * [SUBS_ACK]. The socket is registered in the reactor and a SUBS_INFO_TIMEOUT deadline is
+ * armed, so the calling thread returns right away instead of waiting for [SUBS_INFO]:
+ * onSubsInfoReadable or onSubsTimeout finish the handshake from the reactor.
  *
- * @param socket Pointer to the UDP socket for communication with the controller.
+ * @param socket The UDP socket where [SUBS_REQ] was received.
  * @param addr Pointer to the socket address structure containing controller's address.
  * @param controller Pointer to the struct containing controller information.
  * @param situation Pointer to the situation information.
  * @param srvConf Pointer to the server configuration struct.
  */
-void subsProcess(int socket, struct sockaddr_in *addr, struct Controller *controller,  char *situation, struct Server *srvConf) {
-    struct timeval timeout;
+void subsProcess(int socket, struct sockaddr_in *addr, struct Controller *controller, const char *situation, struct Server *srvConf) {
     struct sockaddr_in newAddress;
     int newUDPSocket;
-    fd_set readfds;
-    int received;
-    char rnd[9];
-
-    /* Log start of the thread */
-    mtx_lock(&mutex);
-    linfo("Starting new subscription process for: %s.", false, controller->name);
-    mtx_unlock(&mutex);
-
-    /* Generate random identifier */
-    generateIdentifier(rnd);
 
     /* Set up UDP socket */
     newUDPSocket = setupUDPSocket(&newAddress);
 
+    mtx_lock(&controller->lock);
+    /* Another [SUBS_REQ] may have started the handshake meanwhile */
+    if (controller->data.status != DISCONNECTED || controller->subs.socket != -1) {
+        mtx_unlock(&controller->lock);
+        close(newUDPSocket);
+        return;
+    }
+
+    /* Log start of the handshake */
+    linfo("Starting new subscription process for: %s.", false, controller->name);
+
+    /* Generate random identifier and save the session */
+    generateIdentifier(controller->subs.rand);
+    strncpy(controller->subs.situation, situation, 12);
+    controller->subs.situation[12] = '\0';
+    controller->subs.srvConf = srvConf;
+    controller->subs.socket = newUDPSocket;
+
     /* Handle SUBS_ACK */
-    handleSubsAck(controller,srvConf,&newAddress,addr,newUDPSocket,rnd);
-
-    /* Initialize file descriptor and set timeout */
-    FD_ZERO(&readfds);
-    FD_SET(newUDPSocket, &readfds);
-    timeout.tv_sec = 2;
-    timeout.tv_usec = 0;
-
-    /* Wait for SUBS_INFO or timeout */
-    if ((received = select(newUDPSocket + 1, &readfds, NULL, NULL, &timeout)) < 0) {
-        lerror("Error initializing select during subs process by: %s", true, srvConf->name);
-    } else if (received == 0) {
-        /* Handle timeout */
-        mtx_lock(&mutex);
-        linfo("Controller %s hasn't sent [SUBS_INFO] in the last 2 seconds. Disconnecting...",false, controller->name);
-        mtx_unlock(&mutex);
-        disconnectController(controller);
+    handleSubsAck(controller, srvConf, &newAddress, addr, newUDPSocket, controller->subs.rand);
 
-    } else {
+    /* Wait for SUBS_INFO or timeout without blocking this thread */
+    timers_arm(subscriptions, controller->index, timers_now() + SUBS_INFO_TIMEOUT);
+    controller->subs.source = reactor_add(reactor, newUDPSocket, REACTOR_READ, onSubsInfoReadable, controller);
+    mtx_unlock(&controller->lock);
+}
+
+/**
+ * @brief Ends the subscription handshake of a controller.
+ *
+ * Unregisters and closes the session socket and cancels the [SUBS_INFO] deadline.
+ * Must be called from the reactor thread with the controller lock held.
+ *
+ * @param controller Pointer to the struct containing controller information.
+ */
+void endSubscription(struct Controller *controller) {
+    reactor_remove(reactor, controller->subs.source);
+    close(controller->subs.socket);
+    controller->subs.source = NULL;
+    controller->subs.socket = -1;
+    timers_cancel(subscriptions, controller->index);
+}
+
+/**
+ * @brief Reactor handler for a session socket.
+ *
+ * Handles the [SUBS_INFO] packet and ends the handshake.
+ *
+ * @param arg Pointer to the struct containing controller information.
+ * @param events The epoll events that triggered the call.
+ */
+void onSubsInfoReadable(void *arg, uint32_t events) {
+    struct Controller *controller = (struct Controller*)arg;
+    struct sockaddr_in newAddress;
+    socklen_t addressLen = sizeof(newAddress);
+    char buffer[PDUUDP];
+    ssize_t received;
+    bool subscribed = true;
+
+    mtx_lock(&controller->lock);
+    if (controller->subs.socket == -1) {
+        mtx_unlock(&controller->lock);
+        return;
+    }
+
+    /* Receive SUBS_INFO packet */
+    if ((received = recvfrom(controller->subs.socket, buffer, PDUUDP, 0, (struct sockaddr *)&newAddress, &addressLen)) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            /* Keep waiting until the deadline */
+            mtx_unlock(&controller->lock);
+            return;
+        }
+        linfo("Controller: %s [DISCONNECTED]. Reason: Error receiving [SUBS_INFO].", true, controller->name);
+        subscribed = false;
+    } else if (controller->data.status == WAIT_INFO) {
+        memset(buffer + received, 0, PDUUDP - received);
         /* Handle [SUBS_INFO] */
-        handleSubsInfo(srvConf, &newAddress, controller, rnd, situation, newUDPSocket);
+        subscribed = handleSubsInfo(controller->subs.srvConf, &newAddress, controller, buffer, controller->subs.rand, controller->subs.situation, controller->subs.socket);
     }
+    endSubscription(controller);
+    mtx_unlock(&controller->lock);
 
-    /*Close socket*/
-    close(newUDPSocket);
+    if (!subscribed) {
+        disconnectController(controller);
+    }
+}
+
+/**
+ * @brief Reactor handler for the [SUBS_INFO] deadlines.
+ *
+ * Ends the handshakes of the controllers that haven't sent [SUBS_INFO] in the last
+ * SUBS_INFO_TIMEOUT milliseconds and disconnects them.
+ *
+ * @param arg Pointer to the array of controllers.
+ * @param events The epoll events that triggered the call.
+ */
+void onSubsTimeout(void *arg, uint32_t events) {
+    struct Controller *controllers = (struct Controller*)arg;
+    int expired[64];
+    int i, count;
+
+    do {
+        count = timers_expired(subscriptions, expired, 64);
+        for (i = 0; i < count; i++) {
+            struct Controller *controller = &controllers[expired[i]];
+            mtx_lock(&controller->lock);
+            if (controller->subs.socket == -1) {
+                mtx_unlock(&controller->lock);
+                continue;
+            }
+            endSubscription(controller);
+            if (controller->data.status == WAIT_INFO) {
+                mtx_unlock(&controller->lock);
+                /* Handle timeout */
+                linfo("Controller %s hasn't sent [SUBS_INFO] in the last 2 seconds. Disconnecting...",false, controller->name);
+                disconnectController(controller);
+                continue;
+            }
+            mtx_unlock(&controller->lock);
+        }
+    } while (count == 64);
 }
 
 /* Function to set up a new UDP socket and bind to a random port
  *
- * @brief Initializes a UDP socket and binds it to a random port.
+ * @brief Initializes a non-blocking UDP socket and binds it to a random port.
  *        Retrieves the port number assigned by the operating system.
  *
  * @param newAddress Pointer to a sockaddr_in structure to store the socket address information.
@@ -90,7 +176,7 @@ int setupUDPSocket(struct sockaddr_in *newAddress) {
     newAddress->sin_port = 0; 
 
     /* Create UDP socket */
-    if ((newUDPSocket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+    if ((newUDPSocket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
         lerror("Error creating UDP socket.", true);
     }
     /* Bind the socket to the address */
@@ -111,6 +197,7 @@ int setupUDPSocket(struct sockaddr_in *newAddress) {
  * @brief Handles the SUBS_ACK process.
  *
  * This function handles the SUBS_ACK process by sending a SUBS_ACK packet and updating the controller status.
+ * Must be called with the controller lock held.
  *
  * @param controller Pointer to the struct containing controller information.
  * @param srvConf Pointer to the server configuration struct.
@@ -126,73 +213,79 @@ void handleSubsAck(struct Controller *controller, struct Server *srvConf, struct
     sprintf(newPort, "%d", ntohs(newAddress->sin_port));
 
     /* Create and send SUBS_ACK packet */
-    sendUdp(udpSocket, 
-            createUDPPacket(SUBS_ACK, srvConf->mac, rnd, newPort), 
+    sendUdp(udpSocket,
+            SUBS_ACK, srvConf->mac, rnd, newPort,
             addr
     );
     /* Update controller status to WAIT_INFO */
-    mtx_lock(&mutex);
-        linfo("Controller %s [WAIT_INFO]. Sent [SUBS_ACK]. ",true,controller->name);
-        controller->data.status = WAIT_INFO;
-    mtx_unlock(&mutex);
+    linfo("Controller %s [WAIT_INFO]. Sent [SUBS_ACK]. ",true,controller->name);
+    controller->data.status = WAIT_INFO;
 }
 
 
 
 /* Function to handle SUBS_INFO
  *
- * @brief Handles the SUBS_INFO process by receiving and processing the SUBS_INFO packet,
+ * @brief Handles the SUBS_INFO process by processing the received SUBS_INFO packet,
  *        sending the packet responses, and updating the controller status.
+ *        The packet is validated and read in place, a malformed one is rejected like
+ *        one with wrong info. Must be called with the controller lock held.
  *
- * @param subsArgs Pointer to subscription thread arguments.
- * @param newAddress Pointer to a sockaddr_in structure containing the socket address information.
+ * @param srvConf Pointer to the server configuration struct.
+ * @param newAddress Pointer to a sockaddr_in structure containing the controller address.
+ * @param controller Pointer to the struct containing controller information.
+ * @param subsBytes Pointer to the PDUUDP bytes of the received SUBS_INFO packet.
  * @param rnd Random identifier.
+ * @param situation Situation sent in [SUBS_REQ].
  * @param newUDPSocket File descriptor of the UDP socket.
+ *
+ * @return Returns false if the controller has to be disconnected.
  */
-void handleSubsInfo(struct Server *srvConf, struct sockaddr_in *newAddress, struct Controller *controller, char *rnd, char *situation, int newUDPSocket) {
-    char *tcp;
-    char *devices;
-    struct UDPPacket subsPacket;
-
-    /* Receive SUBS_INFO packet */
-    subsPacket = recvUdp(newUDPSocket, newAddress);
-
-    /* Extract TCP and devices information */
-    tcp = strtok(subsPacket.data, ",");
-    devices = strtok(NULL, ",");
+bool handleSubsInfo(struct Server *srvConf, struct sockaddr_in *newAddress, struct Controller *controller, const char *subsBytes, char *rnd, char *situation, int newUDPSocket) {
+    struct UDPView subsPacket;
+    const char *tcp = "";
+    const char *devices = "";
+
+    /* Extract TCP and devices information, the first two tokens separated by commas */
+    if (udpView(&subsPacket, subsBytes)) {
+        tcp = udpData(&subsPacket);
+        tcp += strspn(tcp, ",");
+        devices = tcp + strcspn(tcp, ",");
+        devices += strspn(devices, ",");
+    }
  
     /* Check if SUBS_INFO packet is valid */
-    mtx_lock(&mutex);
-    if (strcmp(subsPacket.mac, controller->mac) == 0 && strcmp(subsPacket.rnd, rnd) == 0 && tcp != NULL && devices != NULL) {
+    if (*tcp != '\0' && *devices != '\0' && strcmp(udpMac(&subsPacket), controller->mac) == 0 && strcmp(udpRnd(&subsPacket), rnd) == 0) {
         char tcpPort[6];
-        mtx_unlock(&mutex);
+        char deviceList[80];
+        size_t length = strcspn(devices, ",");
         sprintf(tcpPort, "%d", srvConf->tcp);
 
         /* Create INFO_ACK packet */
-        sendUdp(newUDPSocket, createUDPPacket(INFO_ACK, srvConf->mac, rnd, tcpPort), newAddress);
+        sendUdp(newUDPSocket, INFO_ACK, srvConf->mac, rnd, tcpPort, newAddress);
         /* Save controller Data and set SUBSCRIBED status */
-        mtx_lock(&mutex);
-            linfo("Controller %s [SUBSCRIBED].", true, controller->name);
-            controller->data.tcp = atoi(tcp);
-            inet_ntop(AF_INET, &(newAddress->sin_addr), controller->data.ip, INET_ADDRSTRLEN);
-            strcpy(controller->data.rand, rnd);
-            strcpy(controller->data.situation, situation);
-            storeDevices(devices, controller->data.devices, ";");
-            controller->data.status = SUBSCRIBED;
-            controller->data.lastPacketTime = time(NULL);
-        mtx_unlock(&mutex);
-    } else {
-        /* Invalid SUBS_INFO packet, update status to DISCONNECTED */
-        linfo("Controller: %s [DISCONNECTED]. Reason: Wrong Info in SUBS_INFO packet.", true, controller->name);
-        /*Send rejection packet*/
-        sendUdp(newUDPSocket, 
-                createUDPPacket(SUBS_REJ, srvConf->mac, "00000000", "Subscription Denied: Wrong Info in SUBS_INFO packet."), 
-                newAddress
-        );
-        mtx_unlock(&mutex);
-
-        disconnectController(controller);
+        linfo("Controller %s [SUBSCRIBED].", true, controller->name);
+        controller->data.tcp = atoi(tcp);
+        inet_ntop(AF_INET, &(newAddress->sin_addr), controller->data.ip, INET_ADDRSTRLEN);
+        strcpy(controller->data.rand, rnd);
+        strcpy(controller->data.situation, situation);
+        /* storeDevices tokenizes its input, copy the devices out of the packet */
+        memcpy(deviceList, devices, length);
+        deviceList[length] = '\0';
+        storeDevices(deviceList, controller->data.devices, ";");
+        controller->data.status = SUBSCRIBED;
+        keepAlive(controller);
+        return true;
     }
+
+    /* Invalid SUBS_INFO packet, update status to DISCONNECTED */
+    linfo("Controller: %s [DISCONNECTED]. Reason: Wrong Info in SUBS_INFO packet.", true, controller->name);
+    /*Send rejection packet*/
+    sendUdp(newUDPSocket,
+            SUBS_REJ, srvConf->mac, "00000000", "Subscription Denied: Wrong Info in SUBS_INFO packet.",
+            newAddress
+    );
+    return false;
 }
 
 /**
@@ -203,38 +296,37 @@ void handleSubsInfo(struct Server *srvConf, struct sockaddr_in *newAddress, stru
  * is successful, it sends a HELLO response back to the controller and updates the controller's status
  * accordingly. If the validation fails, it sends a HELLO_REJ response and disconnects the controller.
  *
- * @param udp_packet The UDPPacket struct containing the UDP packet data.
+ * @param udp_packet The view of the received UDP packet.
  * @param controller The Controller struct containing information about the controller.
  * @param udp_socket The UDP socket descriptor.
  * @param serv_conf The Server struct containing server configuration.
  * @param addr The address of the controller
  */
-void handleHello(struct UDPPacket udp_packet, struct Controller *controller, int udp_socket, struct Server *serv_conf, struct sockaddr_in *addr) {
+void handleHello(const struct UDPView *udp_packet, struct Controller *controller, int udp_socket, struct Server *serv_conf, struct sockaddr_in *addr) {
     /* Check if its SUBS_REJ */
-    if(udp_packet.type == HELLO_REJ){
-        mtx_lock(&mutex);
+    if(udpType(udp_packet) == HELLO_REJ){
         linfo("Received [SUBS_REJ] by %s, Disconnecting....",true, controller->name);
-        mtx_unlock(&mutex);
         disconnectController(controller);
         return;
-    } else if (udp_packet.type != HELLO){
-        mtx_lock(&mutex);
-        sendUdp(udp_socket,
-                createUDPPacket(HELLO_REJ, serv_conf->mac, controller->data.rand, ""),
+    } else if (udpType(udp_packet) != HELLO){
+        mtx_lock(&controller->lock);
+        queueUdp(udp_socket,
+                HELLO_REJ, serv_conf->mac, controller->data.rand, "",
                 addr
         );
-        mtx_unlock(&mutex);
+        mtx_unlock(&controller->lock);
         return;
     }
     /* Check correct packet data */
-    mtx_lock(&mutex);
-    if((strstr(udp_packet.data,controller->data.situation) != NULL) &&
-    (strstr(udp_packet.data,controller->name) != NULL) && 
-    (strcmp(udp_packet.mac, controller->mac) == 0) && 
-    (strcmp(udp_packet.rnd, controller->data.rand) == 0)){
+    mtx_lock(&controller->lock);
+    if(fieldIsDigits(udpRnd(udp_packet), 8) &&
+    (strcmp(udpRnd(udp_packet), controller->data.rand) == 0) && 
+    (strcmp(udpMac(udp_packet), controller->mac) == 0) && 
+    (strstr(udpData(udp_packet),controller->data.situation) != NULL) &&
+    (strstr(udpData(udp_packet),controller->name) != NULL)){
         char data[80];
-        /* Reset last packet time stamp */
-        controller->data.lastPacketTime = time(NULL);
+        /* Reset last packet time stamp and liveness deadline */
+        keepAlive(controller);
 
         /* Get data */
         strcpy(data, controller->name);
@@ -242,23 +334,23 @@ void handleHello(struct UDPPacket udp_packet, struct Controller *controller, int
         strcat(data, controller->data.situation);
 
         /* Send HELLO back */
-        sendUdp(udp_socket,
-                createUDPPacket(HELLO, serv_conf->mac, controller->data.rand, data),
+        queueUdp(udp_socket,
+                HELLO, serv_conf->mac, controller->data.rand, data,
                 addr
         );
         if(controller->data.status == SUBSCRIBED){
             linfo("Controller %s set to [SEND_HELLO] status.",true, controller->name);
             controller->data.status = SEND_HELLO;
         }
-        mtx_unlock(&mutex);
+        mtx_unlock(&controller->lock);
     } else {
         /* Send HELLO_REJ */
-        sendUdp(udp_socket,
-                createUDPPacket(HELLO_REJ, serv_conf->mac, controller->data.rand, ""),
+        queueUdp(udp_socket,
+                HELLO_REJ, serv_conf->mac, controller->data.rand, "",
                 addr
         );
         linfo("Controller %s has sent incorrect HELLO packets, Disconnecting....",true, controller->name);
-        mtx_unlock(&mutex);
+        mtx_unlock(&controller->lock);
         disconnectController(controller);
     }
 }
@@ -269,29 +361,30 @@ void handleHello(struct UDPPacket udp_packet, struct Controller *controller, int
  *
  * This function processes a UDP packet received from a disconnected controller.
  * It checks the packet's identifier and situation. If the packet has the correct identifier
- * and situation, it starts a subscription process by creating a new thread. If not, it rejects
+ * and situation, it starts a non-blocking subscription handshake. If not, it rejects
  * the connection by sending a [SUBS_REJ] packet back to the controller.
  *
- * @param udp_packet The UDPPacket struct containing the UDP packet data.
+ * @param udp_packet The view of the received UDP packet.
  * @param controller The Controller struct containing information about the controller.
  * @param udp_socket The UDP socket descriptor.
  * @param serv_conf The Server struct containing server configuration.
  * @param clienAddr Pointer to the client addr.
  */
-void handleDisconnected(struct UDPPacket *udp_packet, struct Controller *controller, int udp_socket, struct Server *serv_conf, struct sockaddr_in *clienAddr) {
-    char* situation;
-    strtok(udp_packet->data, ","); /* Ignore first name */
-    situation = strtok(NULL, ",");
+void handleDisconnected(const struct UDPView *udp_packet, struct Controller *controller, int udp_socket, struct Server *serv_conf, struct sockaddr_in *clienAddr) {
+    const char *situation = udpData(udp_packet);
+    situation += strspn(situation, ",");
+    situation += strcspn(situation, ","); /* Ignore first name */
+    situation += strspn(situation, ",");
 
     /* Check if packet has correct identifier and situation */
-    if (situation != NULL && (strncmp(udp_packet->rnd,"00000000",8) == 0) && (strlen(situation) == 12)) {
+    if ((strncmp(udpRnd(udp_packet),"00000000",8) == 0) && (strcspn(situation, ",") == 12)) {
         subsProcess(udp_socket, clienAddr, controller, situation, serv_conf);
 
     } else { 
         /* Reject Connection sending a [SUBS_REJ] packet */
-        linfo("Denied connection to: %s. Reason: Wrong Situation or Code format.", false, udp_packet->mac);
-        sendUdp(udp_socket, 
-                createUDPPacket(SUBS_REJ, serv_conf->mac, "00000000", "Subscription Denied: Wrong Situation or Code format."), 
+        linfo("Denied connection to: %s. Reason: Wrong Situation or Code format.", false, udpMac(udp_packet));
+        queueUdp(udp_socket,
+                SUBS_REJ, serv_conf->mac, "00000000", "Subscription Denied: Wrong Situation or Code format.",
                 clienAddr
         );
     }
@@ -309,43 +402,112 @@ void handleDisconnected(struct UDPPacket *udp_packet, struct Controller *control
  */
 void handleUDPConnection(void* udp_args){
     struct subsThreadArgs *args = NULL;
+    struct UDPView packet;
     int controllerIndex = 0;
     args = (struct subsThreadArgs*)udp_args;
     
+    /*Fields are read in place, drop packets whose strings aren't terminated*/
+    if (!udpView(&packet, args->bytes)) {
+        linfo("Discarded malformed UDP packet.", false);
+        return;
+    }
 
     /*Checks if incoming packet has allowed name and mac adress*/
-    mtx_lock(&mutex);
-    if ((controllerIndex = isUDPAllowed(args->packet, args->controller, args->srvConf->numControllers)) != -1) {
+    if ((controllerIndex = isUDPAllowed(&packet, args->controller, args->srvConf->numControllers)) != -1) {
+        struct Controller *controller = &args->controller[controllerIndex];
 
-        if ((args->controller[controllerIndex].data.status == DISCONNECTED)){
-            mtx_unlock(&mutex);
-            handleDisconnected(&args->packet, &args->controller[controllerIndex], args->socket, args->srvConf, &args->addr);
+        mtx_lock(&controller->lock);
+        if ((controller->data.status == DISCONNECTED)){
+            mtx_unlock(&controller->lock);
+            handleDisconnected(&packet, controller, args->socket, args->srvConf, &args->addr);
 
-        } else if (args->controller[controllerIndex].data.status == SUBSCRIBED || args->controller[controllerIndex].data.status == SEND_HELLO){
-            mtx_unlock(&mutex);
-            handleHello(args->packet, &args->controller[controllerIndex], args->socket, args->srvConf, &args->addr);
+        } else if (controller->data.status == SUBSCRIBED || controller->data.status == SEND_HELLO){
+            mtx_unlock(&controller->lock);
+            handleHello(&packet, controller, args->socket, args->srvConf, &args->addr);
 
         } else {
             /* linfo("Denied connection to: %s. Reason: Invalid status.", false, udp_packet.mac); */
-            sendUdp(args->socket, 
-                createUDPPacket(SUBS_REJ, args->srvConf->mac, "00000000", "Subscription Denied: Invalid Status."), 
-                &args->addr
+            queueUdp(args->socket,
+                    SUBS_REJ, args->srvConf->mac, "00000000", "Subscription Denied: Invalid Status.",
+                    &args->addr
             );
-            args->controller[controllerIndex].data.lastPacketTime = 0; /* Reset last packet time */
-            mtx_unlock(&mutex);
+            stopLiveness(controller); /* Reset last packet time */
+            mtx_unlock(&controller->lock);
         }
 
     }else { /* Reject Connection sending a [SUBS_REJ] packet */
-        mtx_unlock(&mutex);
-        linfo("Denied connection: %s. Reason: Not listed in allowed Controllers file.", false, args->packet.mac);
-        sendUdp(args->socket,
-                createUDPPacket(SUBS_REJ, args->srvConf->mac, "00000000", "Subscription Denied: You are not listed in allowed Controllers file."), 
+        linfo("Denied connection: %s. Reason: Not listed in allowed Controllers file.", false, udpMac(&packet));
+        queueUdp(args->socket,
+                SUBS_REJ, args->srvConf->mac, "00000000", "Subscription Denied: You are not listed in allowed Controllers file.",
                 &args->addr
         );
-        mtx_lock(&mutex);
-            args->controller[controllerIndex].data.lastPacketTime = 0; /* Reset last packet time */
-        mtx_unlock(&mutex);
     }
 
     return;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Thread Function to handle a batch of UDP packets.
+ *
+ * This function runs the handleUDPConnection logic for every packet of the batch,
+ * so a burst of datagrams costs a single task submission. HELLO and rejection
+ * replies are queued and flushed with sendmmsg at the end of the batch.
+ *
+ * @param batch Pointer to a struct subsBatch containing the packets.
+ */
+void handleUDPBatch(void* batch) {
+    struct subsBatch *subsBatch = (struct subsBatch*)batch;
+    struct UDPEgress egress;
+    int i;
+
+    /* Replies are queued and sent together with sendmmsg */
+    beginUdpEgress(&egress);
+    for (i = 0; i < subsBatch->count; i++) {
+        handleUDPConnection(&subsBatch->args[i]);
+    }
+    endUdpEgress();
+}
+
+/**
+ * @brief Thread Function to receive and handle UDP packets from a socket.
+ *
+ * Each receiver thread owns one of the sockets bound to the UDP port with
+ * SO_REUSEPORT. The kernel hashes every flow to the same socket, so packets
+ * of a controller are always handled by the same thread, in order and
+ * without going through the thread pool. It returns once its stopping flag
+ * is set, the socket is shut down then to wake it from recvmmsg.
+ *
+ * @param receiver_args Pointer to a struct subsReceiverArgs.
+ * @return 0 once its stopping flag is set.
+ */
+int handleUDPReceiver(void* receiver_args) {
+    struct subsReceiverArgs *args = (struct subsReceiverArgs*)receiver_args;
+    struct UDPReceiver *receiver = args->receiver;
+    struct subsThreadArgs packetArgs;
+    struct UDPEgress egress;
+    int i, received;
+
+    packetArgs.srvConf = args->srvConf;
+    packetArgs.controller = args->controller;
+    packetArgs.socket = args->socket;
+
+    while (!__atomic_load_n(&args->stopping, __ATOMIC_ACQUIRE)) {
+        /* Sleep until the first datagram, then take every pending one */
+        received = recvUdpBatch(args->socket, receiver, true);
+        /* A shut down socket returns an empty datagram without address */
+        if (received == 0 || __atomic_load_n(&args->stopping, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        STATS_ADD(udpBatches, 1);
+
+        beginUdpEgress(&egress);
+        for (i = 0; i < received; i++) {
+            packetArgs.bytes = receiver->buffers + i * PDUUDP;
+            packetArgs.addr = receiver->addrs[i];
+            handleUDPConnection(&packetArgs);
+        }
+        endUdpEgress();
+    }
+
+    return 0;
+}
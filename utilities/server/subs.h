@@ -13,56 +13,110 @@
 
 #include "../commons.h"
 
+/* Milliseconds a controller has to send [SUBS_INFO] after [SUBS_ACK] */
+#define SUBS_INFO_TIMEOUT 2000
+
+/* [SUBS_INFO] deadlines of the subscriptions in progress, indexed by controller index */
+extern timer_heap_t *subscriptions;
+
+/* Event loop of the main thread, it drives the subscription handshakes (server.c) */
+extern reactor_t *reactor;
+
 /*
 Structure for subscription thread arguments
 - struct Server *srvConf;
 - struct Controller *controller; 
 - int *socket;
+- const char *bytes; The received datagram, PDUUDP bytes read in place through a UDPView.
 - char *situation;   
  */
 struct subsThreadArgs {
     struct Server *srvConf;     
     struct Controller *controller;   
     int socket;
-    struct UDPPacket packet;
+    const char *bytes;
     struct sockaddr_in addr;
 };
 
-#include "../commons.h"
+/*
+Structure for a batch of received UDP packets, processed by a single task
+- int count;
+- char *datagrams; count * PDUUDP bytes allocated after args, the datagrams pointed by args.
+- struct subsThreadArgs args[]; Allocated with count elements.
+ */
+struct subsBatch {
+    int count;
+    char *datagrams;
+    struct subsThreadArgs args[1];
+};
+
+/*
+Structure for a UDP receiver thread, owner of one SO_REUSEPORT socket
+- struct Server *srvConf;
+- struct Controller *controller;
+- int socket;
+- struct UDPReceiver *receiver; Buffers used only by this thread.
+- thrd_t thread; The receiver thread, joined by quit().
+- bool stopping; Set before the socket is shut down, the thread returns once it sees it.
+ */
+struct subsReceiverArgs {
+    struct Server *srvConf;
+    struct Controller *controller;
+    int socket;
+    struct UDPReceiver *receiver;
+    thrd_t thread;
+    bool stopping;
+};
 
 /**
- * @brief Function to handle subscription process.
+ * @brief Starts the subscription process for a controller.
  *
- * @param socket The UDP socket for communication with the controller.
+ * Sends [SUBS_ACK] from a new session socket and returns without waiting for [SUBS_INFO],
+ * the reactor finishes the handshake.
+ *
+ * @param socket The UDP socket where [SUBS_REQ] was received.
  * @param addr Pointer to the socket address structure containing controller's address.
  * @param controller Pointer to the struct containing controller information.
  * @param situation Pointer to the situation information.
  * @param srvConf Pointer to the server configuration struct.
- * @return NULL
  */
-void subsProcess(int socket, struct sockaddr_in *addr, struct Controller *controller,  char *situation, struct Server *srvConf);
+void subsProcess(int socket, struct sockaddr_in *addr, struct Controller *controller, const char *situation, struct Server *srvConf);
 
 /**
- * @brief Function to set up a new UDP socket and bind to a random port
- * 
- * @param newAddress Pointer to sockaddr_in structure
- * @return int File descriptor of the UDP socket
+ * @brief Ends the subscription handshake of a controller.
+ *
+ * Must be called from the reactor thread with the controller lock held.
+ *
+ * @param controller Pointer to the struct containing controller information.
  */
-int setupUDPSocket(struct sockaddr_in *newAddress);
+void endSubscription(struct Controller *controller);
+
+/**
+ * @brief Reactor handler for a session socket, handles [SUBS_INFO].
+ *
+ * @param arg Pointer to the struct containing controller information.
+ * @param events The epoll events that triggered the call.
+ */
+void onSubsInfoReadable(void *arg, uint32_t events);
 
 /**
- * @brief Process [SUBS_ACK]
+ * @brief Reactor handler for the [SUBS_INFO] deadlines.
+ *
+ * @param arg Pointer to the array of controllers.
+ * @param events The epoll events that triggered the call.
+ */
+void onSubsTimeout(void *arg, uint32_t events);
+
+/**
+ * @brief Function to set up a new non-blocking UDP socket and bind to a random port
  * 
- * @param subsArgs Pointer to subscription thread arguments
  * @param newAddress Pointer to sockaddr_in structure
- * @param rnd Random identifier
+ * @return int File descriptor of the UDP socket
  */
-void handleSubsAck(struct Controller *controller, struct Server *srvConf, struct sockaddr_in *newAddress, struct sockaddr_in *addr, int udpSocket, char *rnd);
+int setupUDPSocket(struct sockaddr_in *newAddress);
 
 /**
- * @brief Handles the SUBS_ACK process.
- *
- * This function handles the SUBS_ACK process by sending a SUBS_ACK packet and updating the controller status.
+ * @brief Sends [SUBS_ACK] and sets the WAIT_INFO status, with the controller lock held.
  *
  * @param controller Pointer to the struct containing controller information.
  * @param srvConf Pointer to the server configuration struct.
@@ -71,29 +125,43 @@ void handleSubsAck(struct Controller *controller, struct Server *srvConf, struct
  * @param udpSocket The UDP socket for communication.
  * @param rnd Random identifier.
  */
-void handleSubsInfo(struct Server *srvConf, struct sockaddr_in *newAddress, struct Controller *controller, char *rnd, char *situation, int newUDPSocket);
+void handleSubsAck(struct Controller *controller, struct Server *srvConf, struct sockaddr_in *newAddress, struct sockaddr_in *addr, int udpSocket, char *rnd);
+
+/**
+ * @brief Handles a received [SUBS_INFO] packet, with the controller lock held.
+ *
+ * @param srvConf Pointer to the server configuration struct.
+ * @param newAddress Pointer to a sockaddr_in structure containing the controller address.
+ * @param controller Pointer to the struct containing controller information.
+ * @param subsBytes Pointer to the PDUUDP bytes of the received SUBS_INFO packet.
+ * @param rnd Random identifier.
+ * @param situation Situation sent in [SUBS_REQ].
+ * @param newUDPSocket File descriptor of the UDP socket.
+ * @return Returns false if the controller has to be disconnected.
+ */
+bool handleSubsInfo(struct Server *srvConf, struct sockaddr_in *newAddress, struct Controller *controller, const char *subsBytes, char *rnd, char *situation, int newUDPSocket);
 
 /**
  * @brief Function to handle a disconnected controller.
  *
- * @param udp_packet The UDPPacket struct containing the UDP packet data.
+ * @param udp_packet Pointer to the view of the received UDP packet.
  * @param controller The Controller struct containing information about the controller.
  * @param udp_socket The UDP socket descriptor.
  * @param serv_conf The Server struct containing server configuration.
  * @param clienAddr Pointer to the client addr.
  */
-void handleDisconnected(struct UDPPacket *udp_packet, struct Controller *controller, int udp_socket, struct Server *serv_conf, struct sockaddr_in *clienAddr);
+void handleDisconnected(const struct UDPView *udp_packet, struct Controller *controller, int udp_socket, struct Server *serv_conf, struct sockaddr_in *clienAddr);
 
 /**
  * @brief Function to handle HELLO packets.
  *
- * @param udp_packet The UDPPacket struct containing the UDP packet data.
+ * @param udp_packet Pointer to the view of the received UDP packet.
  * @param controller The Controller struct containing information about the controller.
  * @param udp_socket The UDP socket descriptor.
  * @param serv_conf The Server struct containing server configuration.
  * @param addr The address of the controller
  */
-void handleHello(struct UDPPacket udp_packet, struct Controller *controller, int udp_socket, struct Server *serv_conf, struct sockaddr_in *addr);
+void handleHello(const struct UDPView *udp_packet, struct Controller *controller, int udp_socket, struct Server *serv_conf, struct sockaddr_in *addr);
 
 
 /**
@@ -108,4 +176,19 @@ void handleHello(struct UDPPacket udp_packet, struct Controller *controller, int
  */
 void handleUDPConnection(void* udp_args);
 
+/**
+ * @brief Thread Function to handle a batch of UDP packets.
+ *
+ * @param batch Pointer to a struct subsBatch containing the packets.
+ */
+void handleUDPBatch(void* batch);
+
+/**
+ * @brief Thread Function to receive and handle UDP packets from a socket.
+ *
+ * @param receiver_args Pointer to a struct subsReceiverArgs.
+ * @return 0 once its stopping flag is set.
+ */
+int handleUDPReceiver(void* receiver_args);
+
 #endif /* SUBS_FUNCTIONS_H */
\ No newline at end of file
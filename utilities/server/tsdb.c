@@ -0,0 +1,831 @@
+/**
+ * @file tsdb.c
+ * @brief Function implementations for the columnar time-series store.
+ *
+ * The text data files have to be parsed line by line to answer any query.
+ * Instead the rows of each controller are buffered in memory and written as
+ * chunks of columns, compressed by chunk.c, with the time and value range
+ * of the chunk in its header, so a reader can skip the chunks it doesn't
+ * need. The device names are interned once in
+ * TSDB_DEVICES and the rows only store their index.
+ *
+ * A chunk is written when it's full, when its file is closed to open another
+ * one, and by the clock tick once its oldest row has waited TSDB_FLUSH_AGE
+ * milliseconds. Until then the rows are only in the write-ahead log, which
+ * numbers them with their position in the file: the footer of the last
+ * chunk tells where a file ends, and tsdbReplay skips the rows before it.
+ *
+ * tsdbLock only protects which file each slot of the cache holds, the hash
+ * index that finds it and the recently used order of the slots. Every
+ * slot has its own lock for its rows, the encoding and the writes of its
+ * chunks, and the writes of an evicted file and the open of the next one,
+ * so a slow disk only stops the rows of one file. The device dictionary
+ * has a lock of its own too.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "../commons.h"
+
+/* Cache slots, numFiles of them, filename empty when free */
+static struct TSDBFile *files = NULL;
+static int numFiles = 0;
+
+/* Open addressing hash index (linear probing) of the files of the slots, -1 marks empty entries.
+   An entry is slot * 2 for the file a slot holds and slot * 2 + 1 for the file it's evicting. */
+static int *fileIndex = NULL;
+static unsigned int indexMask = 0; /* Index size - 1, the size is a power of two */
+
+/* Every slot from the most to the least recently used, the free ones last */
+static struct TSDBFile *newest = NULL;
+static struct TSDBFile *oldest = NULL;
+
+/* Interned device names, and their indexes + 1 by hash, 0 for free slots, protected by devicesLock */
+static char devices[TSDB_MAX_DEVICES][8];
+static int numDevices = 0;
+static uint16_t deviceSlots[TSDB_MAX_DEVICES * 2];
+static int devicesFd = -1;
+
+/* Scratch buffers of the slots */
+static char *scratch = NULL;
+
+static mtx_t tsdbLock;
+static cnd_t tsdbUnused; /* Signaled when a slot isn't used anymore. */
+static mtx_t devicesLock;
+
+/**
+ * @brief Adds a device name to the hash of interned names.
+ *
+ * @param id Index of the name in devices.
+ */
+void hashDevice(int id) {
+    unsigned int slot = hashKey(devices[id], 8) % (TSDB_MAX_DEVICES * 2);
+
+    while (deviceSlots[slot] != 0) {
+        slot = (slot + 1) % (TSDB_MAX_DEVICES * 2);
+    }
+    deviceSlots[slot] = (uint16_t)(id + 1);
+}
+
+/**
+ * @brief Finds the identifier of a device, interning its name if it's new.
+ *
+ * Must be called with devicesLock held. New names are synced to TSDB_DEVICES
+ * before any chunk can use them.
+ *
+ * @param device Name of the device.
+ *
+ * @return The identifier, or -1 if the dictionary is full or can't be written.
+ */
+int internDevice(const char *device) {
+    char name[8];
+    unsigned int slot;
+
+    memset(name, 0, sizeof(name));
+    strncpy(name, device, sizeof(name) - 1);
+    slot = hashKey(name, 8) % (TSDB_MAX_DEVICES * 2);
+    while (deviceSlots[slot] != 0) {
+        if (memcmp(devices[deviceSlots[slot] - 1], name, 8) == 0) {
+            return deviceSlots[slot] - 1;
+        }
+        slot = (slot + 1) % (TSDB_MAX_DEVICES * 2);
+    }
+    if (numDevices == TSDB_MAX_DEVICES) {
+        return -1;
+    }
+    if (write(devicesFd, name, 8) != 8 || fdatasync(devicesFd) < 0) {
+        return -1;
+    }
+    memcpy(devices[numDevices], name, 8);
+    hashDevice(numDevices);
+    return numDevices++;
+}
+
+/**
+ * @brief Allocates the cache of open time-series files and loads the device dictionary.
+ *
+ * An incomplete entry at the end of the dictionary, from a crash, is removed.
+ *
+ * @param maxFiles Maximum number of time-series files kept open at once.
+ */
+void tsdbInit(int maxFiles) {
+    size_t scratchSize = chunkMaxSize(TSDB_CHUNK_ROWS);
+    unsigned int size = 16;
+    struct stat info;
+    int i;
+
+    /* Each slot can have two names while it evicts a file */
+    while (size < 4 * (unsigned int)maxFiles) {
+        size *= 2;
+    }
+    if ((files = (struct TSDBFile*)calloc(maxFiles, sizeof(struct TSDBFile))) == NULL ||
+        (scratch = (char*)malloc(maxFiles * scratchSize)) == NULL || (fileIndex = (int*)malloc(size * sizeof(int))) == NULL) {
+        lerror("Failed memory allocation for time-series files cache", true);
+    }
+    memset(fileIndex, -1, size * sizeof(int));
+    indexMask = size - 1;
+    for (i = 0; i < maxFiles; i++) {
+        files[i].fd = -1;
+        files[i].scratch = scratch + i * scratchSize;
+        files[i].prev = i > 0 ? &files[i - 1] : NULL;
+        files[i].next = i < maxFiles - 1 ? &files[i + 1] : NULL;
+        mtx_init(&files[i].lock, mtx_plain);
+    }
+    newest = &files[0];
+    oldest = &files[maxFiles - 1];
+    numFiles = maxFiles;
+    mtx_init(&tsdbLock, mtx_plain);
+    cnd_init(&tsdbUnused);
+    mtx_init(&devicesLock, mtx_plain);
+
+    if ((devicesFd = open(TSDB_DEVICES, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644)) < 0 || fstat(devicesFd, &info) < 0) {
+        lerror("Error opening device dictionary %s", true, TSDB_DEVICES);
+    }
+    numDevices = info.st_size / 8 > TSDB_MAX_DEVICES ? TSDB_MAX_DEVICES : info.st_size / 8;
+    if (pread(devicesFd, devices, numDevices * 8, 0) != numDevices * 8) {
+        lerror("Error reading device dictionary %s", true, TSDB_DEVICES);
+    }
+    if (info.st_size != numDevices * 8 && ftruncate(devicesFd, numDevices * 8) < 0) {
+        lerror("Error repairing device dictionary %s", true, TSDB_DEVICES);
+    }
+    for (i = 0; i < numDevices; i++) {
+        hashDevice(i);
+    }
+}
+
+/**
+ * @brief Reads and checks the chunk of a file that starts at an offset.
+ *
+ * Must be called with the file locked, the chunk is left in its scratch.
+ *
+ * @param file The file.
+ * @param offset Where the chunk starts.
+ * @param end Size of the file.
+ * @param header Where the header is stored.
+ *
+ * @return Returns true if the chunk is complete and its checksum matches.
+ */
+bool readChunk(struct TSDBFile *file, uint64_t offset, uint64_t end, struct TSDBChunk *header) {
+    uint32_t footer[2];
+
+    if (end - offset < sizeof(*header) + 8 ||
+        pread(file->fd, header, sizeof(*header), offset) != sizeof(*header) || !checkChunk(header, end - offset) ||
+        pread(file->fd, file->scratch, header->size, offset) != (ssize_t)header->size) {
+        return false;
+    }
+    memcpy(footer, file->scratch + header->size - 8, 8);
+    return footer[0] == header->size && footer[1] == TSDB_MAGIC &&
+        walChecksum(file->scratch + 16, header->size - 8 - 16) == header->checksum;
+}
+
+/**
+ * @brief Finds the sequence number after the last row of a file that was just opened.
+ *
+ * Must be called with the file locked. The footer gives the last chunk. If it
+ * doesn't check out, from a chunk written partially before a crash, the file
+ * is scanned from the start and cut after the last complete chunk.
+ *
+ * @param file The file.
+ */
+void findEnd(struct TSDBFile *file) {
+    struct TSDBChunk header;
+    uint64_t end = lseek(file->fd, 0, SEEK_END), offset = 0;
+    uint32_t footer[2];
+
+    file->nextSeq = 0;
+    if (end == 0) {
+        return;
+    }
+    if (end >= 8 && pread(file->fd, footer, 8, end - 8) == 8 && footer[1] == TSDB_MAGIC &&
+        footer[0] <= end && readChunk(file, end - footer[0], end, &header)) {
+        file->nextSeq = header.firstSeq + header.rows;
+        return;
+    }
+    while (readChunk(file, offset, end, &header)) {
+        file->nextSeq = header.firstSeq + header.rows;
+        offset += header.size;
+    }
+    lwarning("Discarded %lu bytes of an incomplete chunk of %s.", true, (unsigned long)(end - offset), file->filename);
+    if (ftruncate(file->fd, offset) < 0) {
+        lwarning("Failed to repair time-series file %s: %s", true, file->filename, strerror(errno));
+    }
+}
+
+/**
+ * @brief Writes the buffered rows of a file as a chunk.
+ *
+ * Must be called with the file locked. If the write fails the part of the
+ * chunk that was written is cut, so the next ones follow the last complete
+ * chunk, and the rows stay buffered for the next try, keeping nextSeq right.
+ *
+ * @param file The file.
+ *
+ * @return NULL if successful, a msg if the write failed.
+ */
+const char* writeChunk(struct TSDBFile *file) {
+    struct TSDBChunk header;
+    size_t written = 0;
+    ssize_t result;
+    off_t end;
+
+    if (file->buffered.count == 0) {
+        return NULL;
+    }
+    encodeChunk(&file->buffered, file->nextSeq - file->buffered.count, true, file->scratch);
+    memcpy(&header, file->scratch, sizeof(header));
+    header.checksum = walChecksum(file->scratch + 16, header.size - 8 - 16);
+    memcpy(file->scratch, &header, sizeof(header));
+
+    end = lseek(file->fd, 0, SEEK_END);
+    while (written < header.size) {
+        if ((result = write(file->fd, file->scratch + written, header.size - written)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = errno;
+            if (ftruncate(file->fd, end) < 0) {
+                lwarning("Failed to cut incomplete chunk of %s.", true, file->evicted[0] != '\0' ? file->evicted : file->filename);
+            }
+            return strerror(result);
+        }
+        written += result;
+    }
+    STATS_ADD(tsdbRawBytes, rawChunkSize(file->buffered.count, file->buffered.hasText ? TSDB_TEXT | TSDB_TEXT_MAP : 0));
+    STATS_ADD(tsdbChunks, 1);
+    STATS_ADD(tsdbBytes, header.size);
+    file->buffered.count = 0;
+    file->buffered.hasText = false;
+    if (file->unwritable) {
+        mtx_lock(&tsdbLock);
+        file->unwritable = false;
+        mtx_unlock(&tsdbLock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Gets the name of a file of the hash index.
+ *
+ * @param entry The entry, slot * 2, + 1 for the file the slot is evicting.
+ *
+ * @return The name.
+ */
+const char* tsdbEntryName(int entry) {
+    return entry % 2 ? files[entry / 2].evicted : files[entry / 2].filename;
+}
+
+/**
+ * @brief Gets the hash of the name of a file of the hash index.
+ *
+ * @param entry The entry, slot * 2, + 1 for the file the slot is evicting.
+ *
+ * @return The hash.
+ */
+unsigned int tsdbEntryHash(int entry) {
+    return entry % 2 ? files[entry / 2].evictedHash : files[entry / 2].hash;
+}
+
+/**
+ * @brief Finds a file in the hash index.
+ *
+ * Must be called with tsdbLock held.
+ *
+ * @param filename Name of the file.
+ * @param hash Hash of the name.
+ *
+ * @return Position of its entry in fileIndex, or -1 if no slot holds or evicts it.
+ */
+int findTsdbEntry(const char *filename, unsigned int hash) {
+    unsigned int position = hash & indexMask;
+
+    while (fileIndex[position] != -1) {
+        if (tsdbEntryHash(fileIndex[position]) == hash && strcmp(tsdbEntryName(fileIndex[position]), filename) == 0) {
+            return (int)position;
+        }
+        position = (position + 1) & indexMask;
+    }
+    return -1;
+}
+
+/**
+ * @brief Adds a file to the hash index.
+ *
+ * Must be called with tsdbLock held.
+ *
+ * @param entry The entry, slot * 2, + 1 for the file the slot is evicting.
+ */
+void addTsdbEntry(int entry) {
+    unsigned int position = tsdbEntryHash(entry) & indexMask;
+
+    while (fileIndex[position] != -1) {
+        position = (position + 1) & indexMask;
+    }
+    fileIndex[position] = entry;
+}
+
+/**
+ * @brief Removes an entry from the hash index.
+ *
+ * Must be called with tsdbLock held. The entries after it in the probe
+ * sequence are moved back into the hole, so lookups never stop before them.
+ *
+ * @param position Position of the entry in fileIndex.
+ */
+void removeTsdbEntry(unsigned int position) {
+    unsigned int next, home;
+
+    for (next = (position + 1) & indexMask; fileIndex[next] != -1; next = (next + 1) & indexMask) {
+        home = tsdbEntryHash(fileIndex[next]) & indexMask;
+        /* The entry can fill the hole unless its home is between the hole and it */
+        if (((next - home) & indexMask) >= ((next - position) & indexMask)) {
+            fileIndex[position] = fileIndex[next];
+            position = next;
+        }
+    }
+    fileIndex[position] = -1;
+}
+
+/**
+ * @brief Moves a slot to the front or the back of the recently used order.
+ *
+ * Must be called with tsdbLock held.
+ *
+ * @param file The slot.
+ * @param front Whether it becomes the most recently used, or the least.
+ */
+void touchTsdbFile(struct TSDBFile *file, bool front) {
+    if ((front ? newest : oldest) == file) {
+        return;
+    }
+    if (file->prev != NULL) {
+        file->prev->next = file->next;
+    } else {
+        newest = file->next;
+    }
+    if (file->next != NULL) {
+        file->next->prev = file->prev;
+    } else {
+        oldest = file->prev;
+    }
+    if (front) {
+        file->prev = NULL;
+        file->next = newest;
+        newest->prev = file;
+        newest = file;
+    } else {
+        file->next = NULL;
+        file->prev = oldest;
+        oldest->next = file;
+        oldest = file;
+    }
+}
+
+/**
+ * @brief Unlocks a file locked by lockTsdbFile, it can be evicted again.
+ *
+ * @param file The file.
+ */
+void unlockTsdbFile(struct TSDBFile *file) {
+    mtx_unlock(&file->lock);
+    mtx_lock(&tsdbLock);
+    if (--file->users == 0) {
+        cnd_broadcast(&tsdbUnused);
+    }
+    mtx_unlock(&tsdbLock);
+}
+
+/**
+ * @brief Finds the open file of a filename and locks it, or opens it in a free slot.
+ *
+ * The slot is found through the hash index, taken under tsdbLock and then
+ * only its own lock is held, for the rows of the file it held and the
+ * open, lookups of either name wait for them. When every slot is taken the
+ * least recently used file nobody uses is closed, after writing its rows.
+ * If they can't be written the file keeps its slot, skipped by the next
+ * evictions until a write of it succeeds, since the rows are acknowledged
+ * and only the log has them, and another one is tried. If every file is in
+ * use it waits for one.
+ *
+ * @param filename Name of the file.
+ * @param create Whether the file is opened if it isn't in the cache.
+ * @param error Where the msg of a failed open or eviction is stored.
+ *
+ * @return The file, to be released with unlockTsdbFile, or NULL if it isn't open or couldn't be opened.
+ */
+struct TSDBFile* lockTsdbFile(const char *filename, bool create, const char **error) {
+    unsigned int hash = hashKey(filename, sizeof(files[0].filename));
+    struct TSDBFile *slot;
+    const char *evictError;
+    bool stuck;
+    int position;
+
+    mtx_lock(&tsdbLock);
+    for (;;) {
+        if ((position = findTsdbEntry(filename, hash)) != -1) {
+            /* Wait for whoever holds it, the slot may hold another file then */
+            slot = &files[fileIndex[position] / 2];
+            slot->users++;
+            touchTsdbFile(slot, true);
+            mtx_unlock(&tsdbLock);
+            mtx_lock(&slot->lock);
+            if (strcmp(slot->filename, filename) == 0) {
+                return slot;
+            }
+            mtx_unlock(&slot->lock);
+            mtx_lock(&tsdbLock);
+            if (--slot->users == 0) {
+                cnd_broadcast(&tsdbUnused);
+            }
+            continue;
+        }
+        stuck = false;
+        for (slot = oldest; slot != NULL && (slot->users > 0 || slot->unwritable); slot = slot->prev) {
+            stuck = stuck || slot->users == 0;
+        }
+        if (!create || (slot == NULL && stuck)) {
+            mtx_unlock(&tsdbLock);
+            *error = create ? "No time-series file can be closed, their rows can't be written" : NULL;
+            return NULL;
+        }
+        if (slot == NULL) {
+            cnd_wait(&tsdbUnused, &tsdbLock);
+            continue;
+        }
+
+        /* Nobody uses the slot, so its lock is free */
+        slot->evicted[0] = '\0';
+        if (slot->filename[0] != '\0') {
+            strcpy(slot->evicted, slot->filename);
+            slot->evictedHash = slot->hash;
+            fileIndex[findTsdbEntry(slot->filename, slot->hash)] = (int)(slot - files) * 2 + 1;
+        }
+        strcpy(slot->filename, filename);
+        slot->hash = hash;
+        addTsdbEntry((int)(slot - files) * 2);
+        touchTsdbFile(slot, true);
+        slot->users = 1;
+        mtx_lock(&slot->lock);
+        mtx_unlock(&tsdbLock);
+        if (slot->evicted[0] == '\0' || (evictError = writeChunk(slot)) == NULL) {
+            break;
+        }
+
+        /* The slot keeps its file, lookups of the new name try again */
+        lwarning("Failed to write time-series file %s: %s", true, slot->evicted, evictError);
+        mtx_lock(&tsdbLock);
+        removeTsdbEntry(findTsdbEntry(slot->filename, slot->hash));
+        fileIndex[findTsdbEntry(slot->evicted, slot->evictedHash)] = (int)(slot - files) * 2;
+        strcpy(slot->filename, slot->evicted);
+        slot->hash = slot->evictedHash;
+        slot->evicted[0] = '\0';
+        slot->unwritable = true;
+        mtx_unlock(&tsdbLock);
+        unlockTsdbFile(slot);
+        mtx_lock(&tsdbLock);
+    }
+
+    if (slot->evicted[0] != '\0') {
+        close(slot->fd);
+        slot->fd = -1;
+        mtx_lock(&tsdbLock);
+        removeTsdbEntry(findTsdbEntry(slot->evicted, slot->evictedHash));
+        slot->evicted[0] = '\0';
+        mtx_unlock(&tsdbLock);
+    }
+    slot->buffered.count = 0;
+    slot->buffered.hasText = false;
+    if ((slot->fd = open(filename, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+        slot->fd = -1;
+        *error = strerror(errno);
+        mtx_lock(&tsdbLock);
+        removeTsdbEntry(findTsdbEntry(slot->filename, slot->hash));
+        slot->filename[0] = '\0';
+        touchTsdbFile(slot, false);
+        mtx_unlock(&tsdbLock);
+        unlockTsdbFile(slot);
+        return NULL;
+    }
+    findEnd(slot);
+    return slot;
+}
+
+/**
+ * @brief Packs a row for the write-ahead log.
+ *
+ * @param record Where the TSDB_ROW bytes are stored.
+ * @param time Milliseconds since the epoch.
+ * @param op Packet type that carried the value.
+ * @param device Name of the device.
+ * @param value The value.
+ */
+void packRow(char *record, uint64_t time, unsigned char op, const char *device, const char *value) {
+    memcpy(record, &time, 8);
+    record[8] = (char)op;
+    memset(record + 9, 0, 16);
+    strncpy(record + 9, device, 7);
+    strncpy(record + 17, value, 7);
+}
+
+/**
+ * @brief Adds a packed row to the buffered rows of a file.
+ *
+ * Must be called with the file locked. The chunk is written once it's full,
+ * if that fails the row is still added and the chunk written before the
+ * next one.
+ *
+ * @param file The file.
+ * @param record The packed row.
+ *
+ * @return NULL if successful, a msg if the device can't be interned or the full chunk written.
+ */
+const char* addRow(struct TSDBFile *file, const char *record) {
+    char *end;
+    struct TSDBRows *rows = &file->buffered;
+    const char *error;
+    int row, device;
+    double value;
+
+    if (rows->count == TSDB_CHUNK_ROWS && (error = writeChunk(file)) != NULL) {
+        return error;
+    }
+    if ((device = tsdbInternDevice(record + 9)) < 0) {
+        return "Device dictionary full or not writable";
+    }
+    row = rows->count;
+    if (row == 0) {
+        file->firstRow = clock_coarse();
+    }
+    memcpy(&rows->time[row], record, 8);
+    rows->op[row] = (unsigned char)record[8];
+    rows->device[row] = (uint16_t)device;
+    value = strtod(record + 17, &end);
+    if (record[17] != '\0' && *end == '\0' && isfinite(value)) {
+        rows->value[row] = value;
+        rows->text[row][0] = '\0';
+        GORILLA_SET_TEXT(rows->textMap, row, false);
+    } else {
+        rows->value[row] = 0;
+        memcpy(rows->text[row], record + 17, 8);
+        GORILLA_SET_TEXT(rows->textMap, row, true);
+        rows->hasText = true;
+    }
+    rows->count++;
+    file->nextSeq++;
+    STATS_ADD(tsdbRows, 1);
+    if (rows->count == TSDB_CHUNK_ROWS && (error = writeChunk(file)) != NULL) {
+        lwarning("Failed to write time-series file %s: %s", true, file->filename, error);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Appends a row to the time-series file of a controller, through the write-ahead log.
+ *
+ * The row is only buffered, its chunk is written when it's full, when the
+ * file is closed or by tsdbFlushExpired. Its sequence number can't change
+ * until it's added, since the controller lock keeps other rows of the same
+ * file out and a full chunk is written first, and a file closed meanwhile
+ * is reopened where it ended. The row is refused if the full chunk can't
+ * be written.
+ *
+ * @param name Name of the controller.
+ * @param situation Situation of the controller.
+ * @param op Packet type that carried the value.
+ * @param device Name of the device.
+ * @param value The value.
+ *
+ * @return NULL if successful, a msg if failed to open/write/create file.
+ */
+const char* tsdbAppend(const char *name, const char *situation, unsigned char op, const char *device, const char *value) {
+    char filename[50], record[TSDB_ROW];
+    const char *error = NULL;
+    struct TSDBFile *file;
+    uint64_t seq;
+
+    /* Create filename using name and situation */
+    sprintf(filename, "%s-%s.tsdb", name, situation);
+    packRow(record, clock_wall(), op, device, value);
+
+    if ((file = lockTsdbFile(filename, true, &error)) == NULL) {
+        return error;
+    }
+    if (file->buffered.count == TSDB_CHUNK_ROWS && (error = writeChunk(file)) != NULL) {
+        unlockTsdbFile(file);
+        return error;
+    }
+    seq = file->nextSeq;
+    unlockTsdbFile(file);
+
+    if ((error = walAppend(WAL_ROW, filename, seq, record, TSDB_ROW)) != NULL) {
+        return error;
+    }
+
+    if ((file = lockTsdbFile(filename, true, &error)) != NULL) {
+        error = addRow(file, record);
+        unlockTsdbFile(file);
+    }
+    walApplied();
+    return error;
+}
+
+/**
+ * @brief Adds a row of the write-ahead log to its file, unless it's already in a chunk.
+ *
+ * @param filename The time-series file.
+ * @param seq Sequence number of the row.
+ * @param record The row, TSDB_ROW bytes.
+ * @param length Length of record.
+ */
+void tsdbReplay(const char *filename, uint64_t seq, const char *record, size_t length) {
+    const char *error = NULL;
+    struct TSDBFile *file;
+
+    if (length != TSDB_ROW) {
+        return;
+    }
+    if ((file = lockTsdbFile(filename, true, &error)) == NULL) {
+        lerror("Error opening time-series file %s to recover it: %s", true, filename, error);
+    }
+    if (seq >= file->nextSeq) {
+        /* Rows before a gap are written first, their chunk takes its first sequence number from nextSeq */
+        if (seq > file->nextSeq && (error = writeChunk(file)) != NULL) {
+            lerror("Error recovering time-series file %s: %s", true, filename, error);
+        }
+        file->nextSeq = seq;
+        if ((error = addRow(file, record)) != NULL) {
+            lerror("Error recovering time-series file %s: %s", true, filename, error);
+        }
+    }
+    unlockTsdbFile(file);
+}
+
+/**
+ * @brief Finds the identifier of a device, interning its name if it's new.
+ *
+ * @param device Name of the device.
+ *
+ * @return The identifier, or -1 if the dictionary is full or can't be written.
+ */
+int tsdbInternDevice(const char *device) {
+    int id;
+
+    mtx_lock(&devicesLock);
+    id = internDevice(device);
+    mtx_unlock(&devicesLock);
+    return id;
+}
+
+/**
+ * @brief Finds the identifier of a device without interning it.
+ *
+ * @param device Name of the device.
+ *
+ * @return The identifier, or -1 if no row has used the name.
+ */
+int tsdbDevice(const char *device) {
+    char name[8];
+    unsigned int slot;
+    int id = -1;
+
+    memset(name, 0, sizeof(name));
+    strncpy(name, device, sizeof(name) - 1);
+    slot = hashKey(name, 8) % (TSDB_MAX_DEVICES * 2);
+    mtx_lock(&devicesLock);
+    while (deviceSlots[slot] != 0 && id == -1) {
+        if (memcmp(devices[deviceSlots[slot] - 1], name, 8) == 0) {
+            id = deviceSlots[slot] - 1;
+        }
+        slot = (slot + 1) % (TSDB_MAX_DEVICES * 2);
+    }
+    mtx_unlock(&devicesLock);
+    return id;
+}
+
+/**
+ * @brief Takes a consistent view of a time-series file for a reader.
+ *
+ * Chunks are only written with their file locked, so the size taken here
+ * ends after a complete chunk, and the rows still buffered are exactly the
+ * ones after it. The part of the file before that size doesn't change
+ * anymore.
+ *
+ * @param filename Name of the file.
+ * @param fd Descriptor of the file opened by the reader.
+ * @param rows Where the buffered rows are copied, none if the file isn't open.
+ *
+ * @return Bytes of the file holding complete chunks, -1 if it can't be stat.
+ */
+off_t tsdbSnapshot(const char *filename, int fd, struct TSDBRows *rows) {
+    struct TSDBFile *file;
+    struct stat info;
+    const char *error;
+
+    rows->count = 0;
+    rows->hasText = false;
+    if ((file = lockTsdbFile(filename, false, &error)) != NULL) {
+        memcpy(rows, &file->buffered, sizeof(*rows));
+    }
+    if (fstat(fd, &info) < 0) {
+        info.st_size = -1;
+    }
+    if (file != NULL) {
+        unlockTsdbFile(file);
+    }
+    return info.st_size;
+}
+
+/**
+ * @brief Locks the file held by a slot of the cache.
+ *
+ * @param file The slot.
+ *
+ * @return Returns false if the slot is free or its file isn't open.
+ */
+bool lockSlot(struct TSDBFile *file) {
+    mtx_lock(&tsdbLock);
+    if (file->filename[0] == '\0') {
+        mtx_unlock(&tsdbLock);
+        return false;
+    }
+    file->users++;
+    mtx_unlock(&tsdbLock);
+    mtx_lock(&file->lock);
+    if (file->fd == -1) {
+        unlockTsdbFile(file);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes the chunks whose oldest row is older than TSDB_FLUSH_AGE.
+ *
+ * Called from the clock tick.
+ */
+void tsdbFlushExpired() {
+    uint64_t now = clock_coarse();
+    const char *error;
+    int i;
+
+    for (i = 0; i < numFiles; i++) {
+        if (!lockSlot(&files[i])) {
+            continue;
+        }
+        if (files[i].buffered.count > 0 && now - files[i].firstRow >= TSDB_FLUSH_AGE &&
+            (error = writeChunk(&files[i])) != NULL) {
+            lwarning("Failed to write time-series file %s: %s", true, files[i].filename, error);
+        }
+        unlockTsdbFile(&files[i]);
+    }
+}
+
+/**
+ * @brief Writes the buffered rows of every file as a chunk, keeping the files open.
+ *
+ * @return Returns false if some rows couldn't be written, they stay buffered.
+ */
+bool tsdbFlushAll() {
+    const char *error;
+    bool written = true;
+    int i;
+
+    for (i = 0; i < numFiles; i++) {
+        if (!lockSlot(&files[i])) {
+            continue;
+        }
+        if ((error = writeChunk(&files[i])) != NULL) {
+            lwarning("Failed to write time-series file %s: %s", true, files[i].filename, error);
+            written = false;
+        }
+        unlockTsdbFile(&files[i]);
+    }
+    return written;
+}
+
+/**
+ * @brief Writes the buffered rows and closes all the time-series files.
+ *
+ * @return Returns false if some rows couldn't be written, they're dropped.
+ */
+bool tsdbClose() {
+    bool written;
+    int i;
+
+    if (files == NULL) {
+        return true;
+    }
+    written = tsdbFlushAll();
+    for (i = 0; i < numFiles; i++) {
+        if (lockSlot(&files[i])) {
+            close(files[i].fd);
+            files[i].fd = -1;
+            unlockTsdbFile(&files[i]);
+        }
+    }
+    mtx_lock(&devicesLock);
+    close(devicesFd);
+    mtx_unlock(&devicesLock);
+    return written;
+}
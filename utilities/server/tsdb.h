@@ -0,0 +1,135 @@
+/**
+ * @file tsdb.h
+ * @brief Function definitions for the columnar time-series store.
+ *
+ * This file contains the definitions of the binary files where the records
+ * of each controller are stored as chunks of compressed columns.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#ifndef TSDB_H
+#define TSDB_H
+
+#include "../commons.h"
+
+#define DATA_TSDB 1 /* Data-format bit of the time-series files. */
+#define DATA_CSV 2 /* Data-format bit of the text data files. */
+
+#define TSDB_DEVICES "devices.tsdb" /* Dictionary of the interned device names. */
+#define TSDB_MAX_DEVICES 4096 /* Maximum number of distinct device names. */
+#define TSDB_FLUSH_AGE 60000 /* Milliseconds a row waits in memory before the clock tick writes its chunk. */
+#define TSDB_ROW 25 /* Bytes of a row in the write-ahead log. */
+
+/*
+Time-series file, name-situation.tsdb, a sequence of chunks (see chunk.h).
+TSDB_DEVICES holds the device names as char[8] entries, the index of an
+entry is the identifier of the device.
+*/
+
+/**
+ * @brief Represents an open time-series file and the rows of its next chunk.
+ */
+struct TSDBFile {
+    char filename[50]; /**< Name of the file, name-situation.tsdb, empty if the slot is free */
+    char evicted[50]; /**< Name of the file the slot held while its rows are written, empty otherwise */
+    unsigned int hash; /**< Hash of filename */
+    unsigned int evictedHash; /**< Hash of evicted */
+    struct TSDBFile *prev; /**< More recently used slot */
+    struct TSDBFile *next; /**< Less recently used slot */
+    int users; /**< Threads using or waiting for the slot, it isn't evicted until it's 0 */
+    bool unwritable; /**< Its rows couldn't be written to evict it, it isn't evicted until a chunk is written */
+    mtx_t lock; /**< Protects the rest of the fields and the writes of the file */
+    int fd; /**< File descriptor, -1 until the file is opened */
+    uint64_t nextSeq; /**< Sequence number of the next row */
+    uint64_t firstRow; /**< Coarse time the oldest buffered row was added */
+    char *scratch; /**< Where the chunks of the file are built and read */
+    struct TSDBRows buffered; /**< Rows of the next chunk */
+};
+
+/**
+ * @brief Allocates the cache of open time-series files and loads the device dictionary.
+ *
+ * @param maxFiles Maximum number of time-series files kept open at once.
+ */
+void tsdbInit(int maxFiles);
+
+/**
+ * @brief Appends a row to the time-series file of a controller, through the write-ahead log.
+ *
+ * Must be called with the controller data locked, so the rows of a file
+ * are appended one at a time.
+ *
+ * @param name Name of the controller.
+ * @param situation Situation of the controller.
+ * @param op Packet type that carried the value.
+ * @param device Name of the device.
+ * @param value The value.
+ *
+ * @return NULL if successful, a msg if failed to open/write/create file.
+ */
+const char* tsdbAppend(const char *name, const char *situation, unsigned char op, const char *device, const char *value);
+
+/**
+ * @brief Adds a row of the write-ahead log to its file, unless it's already in a chunk.
+ *
+ * @param filename The time-series file.
+ * @param seq Sequence number of the row.
+ * @param record The row, TSDB_ROW bytes.
+ * @param length Length of record.
+ */
+void tsdbReplay(const char *filename, uint64_t seq, const char *record, size_t length);
+
+/**
+ * @brief Finds the identifier of a device, interning its name if it's new.
+ *
+ * Also used by the rollups, which share the dictionary.
+ *
+ * @param device Name of the device.
+ *
+ * @return The identifier, or -1 if the dictionary is full or can't be written.
+ */
+int tsdbInternDevice(const char *device);
+
+/**
+ * @brief Finds the identifier of a device without interning it.
+ *
+ * @param device Name of the device.
+ *
+ * @return The identifier, or -1 if no row has used the name.
+ */
+int tsdbDevice(const char *device);
+
+/**
+ * @brief Takes a consistent view of a time-series file for a reader.
+ *
+ * @param filename Name of the file.
+ * @param fd Descriptor of the file opened by the reader.
+ * @param rows Where the buffered rows are copied, none if the file isn't open.
+ *
+ * @return Bytes of the file holding complete chunks, -1 if it can't be stat.
+ */
+off_t tsdbSnapshot(const char *filename, int fd, struct TSDBRows *rows);
+
+/**
+ * @brief Writes the chunks whose oldest row is older than TSDB_FLUSH_AGE.
+ */
+void tsdbFlushExpired();
+
+/**
+ * @brief Writes the buffered rows of every file as a chunk, keeping the files open.
+ *
+ * @return Returns false if some rows couldn't be written, they stay buffered.
+ */
+bool tsdbFlushAll();
+
+/**
+ * @brief Writes the buffered rows and closes all the time-series files.
+ *
+ * @return Returns false if some rows couldn't be written, they're dropped.
+ */
+bool tsdbClose();
+
+#endif /* TSDB_H */
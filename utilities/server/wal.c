@@ -0,0 +1,457 @@
+/**
+ * @file wal.c
+ * @brief Function implementations for the write-ahead log of the stored data.
+ *
+ * Every data record is appended to the log before it's copied to the buffer
+ * of its data file, and the controller only gets its DATA_ACK once the log
+ * is as durable as WAL-sync requires. Concurrent workers share the writes
+ * and syncs with a group commit: records are copied to a pending buffer and
+ * the first waiting thread that finds no commit in progress writes the whole
+ * buffer at once, while the next records gather behind it.
+ *
+ * Each entry stores the position of its record in the data file, so the
+ * recovery just writes every record back at its place: replaying a record
+ * that already reached its file changes nothing. Rows of the time-series
+ * files store their sequence number instead, and tsdbReplay skips the
+ * ones already in a chunk. The log only holds the
+ * records since the last checkpoint, when the data files are synced and the
+ * log is truncated: at startup after the recovery, by a task the clock tick
+ * submits once it reaches WAL_CHECKPOINT bytes, and on quit(). The data files must be on the
+ * same file system as the log.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "../commons.h"
+
+/* Log file descriptor, -1 until walInit */
+static int walFd = -1;
+static enum WALSync walPolicy = WAL_NONE;
+
+static mtx_t walLock;
+static cnd_t walCommitted; /* Broadcast after every commit, checkpoint and when no record is in flight. */
+
+/* Records waiting for the next commit, and the buffer being written by the current one */
+static char *pending = NULL;
+static char *writing = NULL;
+static size_t pendingUsed = 0;
+
+/* Records are numbered in the order they're appended */
+static uint64_t appended = 0;
+static uint64_t committed = 0;
+
+/* Numbers of the records of the commits that failed since the last checkpoint, and their msgs */
+static uint64_t failedFrom[WAL_FAILURES];
+static uint64_t failedTo[WAL_FAILURES];
+static const char *failedErrors[WAL_FAILURES];
+static int numFailed = 0;
+
+/* First record that fails until the next checkpoint, 0 if none, when a failed commit can't be cut or remembered */
+static uint64_t brokenFrom = 0;
+static const char *brokenError = NULL;
+
+static bool leading = false; /* A thread is writing a commit. */
+static bool checkpointing = false; /* No record can be appended. */
+static bool walDirty = false; /* Written since the last interval sync. */
+static bool ticking = false; /* A sync or checkpoint of the clock tick is queued or running. */
+static int inFlight = 0; /* Records appended and not in their data file buffer yet. */
+static uint64_t walSize = 0; /* Bytes written since the last checkpoint. */
+
+/**
+ * @brief Hashes a buffer (FNV-1a), used for the log entries and the time-series chunks.
+ *
+ * @param bytes The bytes.
+ * @param length Number of bytes.
+ *
+ * @return The checksum.
+ */
+uint32_t walChecksum(const char *bytes, size_t length) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char)bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Writes a buffer to the log.
+ *
+ * @param buffer The bytes.
+ * @param length Number of bytes.
+ *
+ * @return NULL if successful, a msg if the write failed.
+ */
+const char* walWrite(const char *buffer, size_t length) {
+    size_t written = 0;
+    ssize_t result;
+
+    while (written < length) {
+        if ((result = write(walFd, buffer + written, length - written)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return strerror(errno);
+        }
+        written += result;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Writes the pending records as a group commit.
+ *
+ * Must be called with walLock held and no commit in progress. The lock is
+ * released while writing, so other threads keep appending to the other buffer.
+ * If the write fails the log is cut back to its size before the commit, so
+ * the next commits don't follow a partial entry that would stop the recovery.
+ */
+void commitPending() {
+    char *batch = pending;
+    size_t size = pendingUsed;
+    uint64_t first = committed + 1, last = appended, start = walSize;
+    const char *error;
+    bool cut = true;
+
+    leading = true;
+    pending = writing;
+    writing = batch;
+    pendingUsed = 0;
+    mtx_unlock(&walLock);
+
+    STATS_ADD(walCommits, 1);
+    error = walWrite(batch, size);
+    if (error == NULL && walPolicy == WAL_BATCH) {
+        STATS_ADD(walSyncs, 1);
+        if (fdatasync(walFd) < 0) {
+            error = strerror(errno);
+        }
+    }
+
+    if (error != NULL && ftruncate(walFd, start) < 0) {
+        lwarning("Failed to cut incomplete commit of the write-ahead log: %s", true, strerror(errno));
+        cut = false;
+    }
+
+    mtx_lock(&walLock);
+    if (error != NULL && (!cut || numFailed == WAL_FAILURES)) {
+        if (brokenFrom == 0) {
+            brokenFrom = first;
+            brokenError = error;
+        }
+    } else if (error != NULL) {
+        failedFrom[numFailed] = first;
+        failedTo[numFailed] = last;
+        failedErrors[numFailed++] = error;
+    } else {
+        walDirty = true;
+        walSize += size;
+    }
+    committed = last;
+    leading = false;
+    cnd_broadcast(&walCommitted);
+}
+
+/**
+ * @brief Replays the records of the log into the data files and truncates it.
+ *
+ * Stops at the first entry that is incomplete or fails its checksum, the
+ * tail of a write interrupted by a crash.
+ */
+void walRecover() {
+    struct stat info;
+    char *log, *entry, filename[50], current[50] = "";
+    size_t size, position = 0, records = 0;
+    ssize_t result;
+    uint32_t entryLength, checksum;
+    uint64_t offset;
+    uint16_t nameLength;
+    unsigned char kind;
+    int fd = -1;
+
+    if (fstat(walFd, &info) < 0) {
+        lerror("Error reading write-ahead log", true);
+    }
+    if ((size = info.st_size) == 0) {
+        return;
+    }
+    if ((log = (char*)malloc(size)) == NULL) {
+        lerror("Failed memory allocation for write-ahead log recovery", true);
+    }
+    while (position < size) {
+        if ((result = pread(walFd, log + position, size - position, position)) <= 0) {
+            lerror("Error reading write-ahead log", true);
+        }
+        position += result;
+    }
+
+    for (position = 0; position + 8 <= size; position += 8 + entryLength) {
+        memcpy(&entryLength, log + position, 4);
+        memcpy(&checksum, log + position + 4, 4);
+        entry = log + position + 8;
+        if (entryLength < 11 || entryLength > size - position - 8 || walChecksum(entry, entryLength) != checksum) {
+            break;
+        }
+        memcpy(&offset, entry, 8);
+        kind = (unsigned char)entry[8];
+        memcpy(&nameLength, entry + 9, 2);
+        if (nameLength == 0 || nameLength >= sizeof(filename) || 11 + (size_t)nameLength > entryLength) {
+            break;
+        }
+        memcpy(filename, entry + 11, nameLength);
+        filename[nameLength] = '\0';
+        records++;
+
+        if (kind == WAL_ROW) {
+            tsdbReplay(filename, offset, entry + 11 + nameLength, entryLength - 11 - nameLength);
+            continue;
+        }
+        if (strcmp(filename, current) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            if ((fd = open(filename, O_WRONLY | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+                lerror("Error opening data file %s to recover it", true, filename);
+            }
+            strcpy(current, filename);
+        }
+        if (pwrite(fd, entry + 11 + nameLength, entryLength - 11 - nameLength, offset) < 0) {
+            lerror("Error recovering data file %s", true, filename);
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(log);
+
+    if (!tsdbFlushAll()) {
+        lerror("Error writing recovered time-series files", true);
+    }
+    if (position < size) {
+        lwarning("Discarded %lu bytes of an incomplete write-ahead log tail.", true, (unsigned long)(size - position));
+    }
+    if (syncfs(walFd) < 0 || ftruncate(walFd, 0) < 0) {
+        lerror("Error checkpointing write-ahead log", true);
+    }
+    linfo("Recovered %lu data records from the write-ahead log.", true, (unsigned long)records);
+}
+
+/**
+ * @brief Replays the log left by a previous run into the data files and opens it.
+ *
+ * @param path The log file.
+ * @param policy When the log is synced to disk.
+ */
+void walInit(const char *path, enum WALSync policy) {
+    walPolicy = policy;
+    mtx_init(&walLock, mtx_plain);
+    cnd_init(&walCommitted);
+    if ((pending = (char*)malloc(WAL_BUFFER)) == NULL || (writing = (char*)malloc(WAL_BUFFER)) == NULL) {
+        lerror("Failed memory allocation for write-ahead log", true);
+    }
+    if ((walFd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+        lerror("Error opening write-ahead log %s", true, path);
+    }
+    walRecover();
+}
+
+/**
+ * @brief Appends a record to the log, returning once it's as durable as the policy requires.
+ *
+ * The entry is built before taking the lock. The calling thread then waits
+ * for a commit that includes it, writing one itself if none is in progress.
+ *
+ * @param kind How the record is replayed.
+ * @param filename Data file of the record.
+ * @param position Offset of the record in the data file, or sequence number of a row.
+ * @param record The record.
+ * @param length Length of record.
+ *
+ * @return NULL if successful, a msg if the log couldn't be written.
+ */
+const char* walAppend(enum WALKind kind, const char *filename, uint64_t position, const char *record, size_t length) {
+    char entry[256];
+    uint16_t nameLength = (uint16_t)strlen(filename);
+    uint32_t entryLength = 11 + nameLength + length, checksum;
+    uint64_t ticket;
+    const char *error = NULL;
+    int i;
+
+    if (8 + entryLength > sizeof(entry)) {
+        return "Record too long";
+    }
+    memcpy(entry + 8, &position, 8);
+    entry[16] = (char)kind;
+    memcpy(entry + 17, &nameLength, 2);
+    memcpy(entry + 19, filename, nameLength);
+    memcpy(entry + 19 + nameLength, record, length);
+    checksum = walChecksum(entry + 8, entryLength);
+    memcpy(entry, &entryLength, 4);
+    memcpy(entry + 4, &checksum, 4);
+
+    mtx_lock(&walLock);
+    while (checkpointing) {
+        cnd_wait(&walCommitted, &walLock);
+    }
+    if (brokenFrom != 0) {
+        error = brokenError;
+        mtx_unlock(&walLock);
+        return error;
+    }
+    while (pendingUsed + 8 + entryLength > WAL_BUFFER) {
+        if (leading) {
+            cnd_wait(&walCommitted, &walLock);
+        } else {
+            commitPending();
+        }
+    }
+    memcpy(pending + pendingUsed, entry, 8 + entryLength);
+    pendingUsed += 8 + entryLength;
+    ticket = ++appended;
+    inFlight++;
+    STATS_ADD(walRecords, 1);
+
+    while (committed < ticket) {
+        if (leading) {
+            cnd_wait(&walCommitted, &walLock);
+        } else {
+            commitPending();
+        }
+    }
+    /* The failures are kept until the next checkpoint, which waits for this record */
+    for (i = 0; i < numFailed; i++) {
+        if (ticket >= failedFrom[i] && ticket <= failedTo[i]) {
+            error = failedErrors[i];
+        }
+    }
+    if (brokenFrom != 0 && ticket >= brokenFrom) {
+        error = brokenError;
+    }
+    if (error != NULL) {
+        if (--inFlight == 0 && checkpointing) {
+            cnd_broadcast(&walCommitted);
+        }
+    }
+    mtx_unlock(&walLock);
+    return error;
+}
+
+/**
+ * @brief Tells the log that a record appended with walAppend is in its data file buffer.
+ */
+void walApplied() {
+    mtx_lock(&walLock);
+    if (--inFlight == 0 && checkpointing) {
+        cnd_broadcast(&walCommitted);
+    }
+    mtx_unlock(&walLock);
+}
+
+/**
+ * @brief Writes the data files and truncates the log.
+ *
+ * Must be called with walLock held. New records wait until it's done, and
+ * the records in flight are waited for, so every record of the log is in
+ * a data file buffer when they're written. The log is kept if some of
+ * them can't be written, the next checkpoint tries again.
+ */
+void checkpoint() {
+    bool written;
+
+    checkpointing = true;
+    while (inFlight > 0 || leading) {
+        cnd_wait(&walCommitted, &walLock);
+    }
+    written = storageFlushAll();
+    written = tsdbFlushAll() && written;
+    if (!written) {
+        lwarning("Write-ahead log kept, some data records couldn't be written.", true);
+    } else if (syncfs(walFd) < 0 || ftruncate(walFd, 0) < 0) {
+        lwarning("Error checkpointing write-ahead log: %s", true, strerror(errno));
+    } else {
+        STATS_ADD(walCheckpoints, 1);
+        walSize = 0;
+        numFailed = 0;
+        brokenFrom = 0;
+    }
+    checkpointing = false;
+    cnd_broadcast(&walCommitted);
+}
+
+/**
+ * @brief Syncs the log with the interval policy and checkpoints it when it's too large.
+ *
+ * Executed by the thread pool, the syncs would stop the server loop.
+ *
+ * @param arg Unused.
+ */
+void walTickTask(void *arg) {
+    bool sync;
+
+    mtx_lock(&walLock);
+    if (walSize >= WAL_CHECKPOINT || brokenFrom != 0) {
+        checkpoint();
+        ticking = false;
+        mtx_unlock(&walLock);
+        return;
+    }
+    sync = walPolicy == WAL_INTERVAL && walDirty;
+    walDirty = false;
+    mtx_unlock(&walLock);
+
+    if (sync) {
+        STATS_ADD(walSyncs, 1);
+        if (fdatasync(walFd) < 0) {
+            lwarning("Error syncing write-ahead log: %s", true, strerror(errno));
+        }
+    }
+    mtx_lock(&walLock);
+    ticking = false;
+    mtx_unlock(&walLock);
+}
+
+/**
+ * @brief Submits the interval sync or the checkpoint of the log when one is due.
+ *
+ * Called from the clock tick, a tick is skipped while the previous one runs.
+ *
+ * @param pool Thread pool that runs them.
+ */
+void walTick(thread_pool_t *pool) {
+    bool due;
+
+    if (walFd == -1) {
+        return;
+    }
+    mtx_lock(&walLock);
+    due = !ticking && (walSize >= WAL_CHECKPOINT || brokenFrom != 0 || (walPolicy == WAL_INTERVAL && walDirty));
+    ticking = ticking || due;
+    mtx_unlock(&walLock);
+    if (due) {
+        thread_pool_submit(pool, walTickTask, NULL);
+    }
+}
+
+/**
+ * @brief Checkpoints and closes the log, once the data files are written.
+ *
+ * The log is kept if some records weren't written or the data files can't
+ * be synced, so the next start recovers them.
+ *
+ * @param written Whether every buffered record reached its data file.
+ */
+void walClose(bool written) {
+    if (walFd == -1) {
+        return;
+    }
+    mtx_lock(&walLock);
+    if (written && syncfs(walFd) == 0 && ftruncate(walFd, 0) == 0) {
+        STATS_ADD(walCheckpoints, 1);
+    }
+    close(walFd);
+    walFd = -1;
+    mtx_unlock(&walLock);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file wal.h
+ * @brief Function definitions for the write-ahead log of the stored data.
+ *
+ * This file contains the definitions of the log every data record is
+ * appended to before it reaches its data file, and the recovery that
+ * replays it after a crash.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#ifndef WAL_H
+#define WAL_H
+
+#include "../commons.h"
+
+#define WAL_FILE "server.wal" /* Log file if WAL-file is not set. */
+#define WAL_BUFFER 65536 /* Bytes of records waiting for the next group commit. */
+#define WAL_CHECKPOINT (16 * 1024 * 1024) /* Log size in bytes that triggers a checkpoint on the clock tick. */
+#define WAL_FAILURES 16 /* Failed commits remembered until the next checkpoint, after them every record fails. */
+
+/**
+ * @brief When the log is synced to disk.
+ */
+enum WALSync {
+    WAL_NONE, /* Never, records are acknowledged once written to the kernel. */
+    WAL_INTERVAL, /* Once per second on the clock tick, records are acknowledged once written. */
+    WAL_BATCH /* After every group commit, records are acknowledged once synced. */
+};
+
+/**
+ * @brief How a record of the log is replayed.
+ */
+enum WALKind {
+    WAL_BYTES, /* Bytes written at their offset of a data file. */
+    WAL_ROW /* Row of a time-series file, position is its sequence number, see tsdbReplay. */
+};
+
+/*
+Log entry, fields in host byte order:
+- u32 length: Bytes of the entry after the checksum.
+- u32 checksum: FNV-1a of those bytes, a torn tail fails it.
+- u64 position: Offset of the record in its data file, or sequence number of a row.
+- u8 kind: enum WALKind.
+- u16 filename length, the filename, and the record up to the end of the entry.
+*/
+
+/**
+ * @brief Hashes a buffer (FNV-1a), used for the log entries and the time-series chunks.
+ *
+ * @param bytes The bytes.
+ * @param length Number of bytes.
+ *
+ * @return The checksum.
+ */
+uint32_t walChecksum(const char *bytes, size_t length);
+
+/**
+ * @brief Replays the log left by a previous run into the data files and opens it.
+ *
+ * Must be called after tsdbInit and before any data file is opened.
+ *
+ * @param path The log file.
+ * @param policy When the log is synced to disk.
+ */
+void walInit(const char *path, enum WALSync policy);
+
+/**
+ * @brief Appends a record to the log, returning once it's as durable as the policy requires.
+ *
+ * The caller must call walApplied once the record is in the buffer of its data file.
+ *
+ * @param kind How the record is replayed.
+ * @param filename Data file of the record.
+ * @param position Offset of the record in the data file, or sequence number of a row.
+ * @param record The record.
+ * @param length Length of record.
+ *
+ * @return NULL if successful, a msg if the log couldn't be written.
+ */
+const char* walAppend(enum WALKind kind, const char *filename, uint64_t position, const char *record, size_t length);
+
+/**
+ * @brief Tells the log that a record appended with walAppend is in its data file buffer.
+ */
+void walApplied();
+
+/**
+ * @brief Submits the interval sync or the checkpoint of the log when one is due.
+ *
+ * Called from the clock tick, the syncs run on the thread pool.
+ *
+ * @param pool Thread pool that runs them.
+ */
+void walTick(thread_pool_t *pool);
+
+/**
+ * @brief Checkpoints and closes the log, once the data files are written.
+ *
+ * @param written Whether every buffered record reached its data file, the log is kept otherwise.
+ */
+void walClose(bool written);
+
+#endif /* WAL_H */
@@ -0,0 +1,73 @@
+/**
+ * @file stats.c
+ * @brief Methods file for the server runtime statistics.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-23
+ */
+
+#include "commons.h"
+
+/* Global server statistics */
+struct Stats stats;
+
+/**
+ * @brief Divides two counters, returning 0 when the divisor is 0.
+ *
+ * @param dividend The dividend.
+ * @param divisor The divisor.
+ * @return The quotient as a double.
+ */
+double ratio(uint64_t dividend, uint64_t divisor) {
+    return divisor == 0 ? 0.0 : (double)dividend / (double)divisor;
+}
+
+/**
+ * @brief Prints the server statistics.
+ */
+void printStats() {
+    uint64_t recvCalls = STATS_GET(udpRecvCalls);
+    uint64_t recvPackets = STATS_GET(udpRecvPackets);
+    uint64_t sendCalls = STATS_GET(udpSendCalls);
+    uint64_t sendPackets = STATS_GET(udpSendPackets);
+    uint64_t arenaAllocs = STATS_GET(arenaAllocs);
+    uint64_t storageRecords = STATS_GET(storageRecords);
+
+    printf("--STATISTIC---------------------- --VALUE----\n");
+    printf("%-33s %lu\n", "UDP packets received", (unsigned long)recvPackets);
+    printf("%-33s %lu\n", "UDP receive syscalls", (unsigned long)recvCalls);
+    printf("%-33s %.3f\n", "UDP receive syscalls per packet", ratio(recvCalls, recvPackets));
+    printf("%-33s %lu\n", "UDP batches dispatched", (unsigned long)STATS_GET(udpBatches));
+    printf("%-33s %lu\n", "UDP packets sent", (unsigned long)sendPackets);
+    printf("%-33s %lu\n", "UDP send syscalls", (unsigned long)sendCalls);
+    printf("%-33s %.3f\n", "UDP packets sent per syscall", ratio(sendPackets, sendCalls));
+    printf("%-33s %lu\n", "Thread pool tasks executed", (unsigned long)STATS_GET(poolTasks));
+    printf("%-33s %lu\n", "Thread pool tasks stolen", (unsigned long)STATS_GET(poolSteals));
+    printf("%-33s %lu\n", "Thread pool inline arguments", (unsigned long)STATS_GET(poolInline));
+    printf("%-33s %lu\n", "Arena allocations", (unsigned long)arenaAllocs);
+    printf("%-33s %.3f\n", "Arena hit rate", ratio(STATS_GET(arenaHits), arenaAllocs));
+    printf("%-33s %lu\n", "Arena blocks freed remotely", (unsigned long)STATS_GET(arenaRemoteFrees));
+    printf("%-33s %lu\n", "Log lines dropped", (unsigned long)STATS_GET(logDropped));
+    printf("%-33s %lu\n", "Log ring stalls", (unsigned long)STATS_GET(logStalls));
+    printf("%-33s %lu\n", "Data records stored", (unsigned long)storageRecords);
+    printf("%-33s %lu\n", "Data files opened", (unsigned long)STATS_GET(storageOpens));
+    printf("%-33s %lu\n", "Data files evicted", (unsigned long)STATS_GET(storageEvictions));
+    printf("%-33s %.3f\n", "Data records per write syscall", ratio(storageRecords, STATS_GET(storageWrites)));
+    printf("%-33s %lu\n", "Time-series rows stored", (unsigned long)STATS_GET(tsdbRows));
+    printf("%-33s %.3f\n", "Time-series rows per chunk", ratio(STATS_GET(tsdbRows), STATS_GET(tsdbChunks)));
+    printf("%-33s %.3f\n", "Time-series bytes per row", ratio(STATS_GET(tsdbBytes), STATS_GET(tsdbRows)));
+    printf("%-33s %.3f\n", "Time-series compression ratio", ratio(STATS_GET(tsdbRawBytes), STATS_GET(tsdbBytes)));
+    printf("%-33s %.3f\n", "WAL records per group commit", ratio(STATS_GET(walRecords), STATS_GET(walCommits)));
+    printf("%-33s %lu\n", "WAL syncs", (unsigned long)STATS_GET(walSyncs));
+    printf("%-33s %lu\n", "WAL checkpoints", (unsigned long)STATS_GET(walCheckpoints));
+    printf("%-33s %lu\n", "Last-value cache hits", (unsigned long)STATS_GET(cacheHits));
+    printf("%-33s %lu\n", "Last-value cache misses", (unsigned long)STATS_GET(cacheMisses));
+    printf("%-33s %lu\n", "Rollup values aggregated", (unsigned long)STATS_GET(rollupValues));
+    printf("%-33s %lu\n", "Rollup buckets written", (unsigned long)STATS_GET(rollupBuckets));
+    printf("%-33s %.3f\n", "Rollup buckets per write syscall", ratio(STATS_GET(rollupBuckets), STATS_GET(rollupWrites)));
+    printf("%-33s %lu\n", "Rollup queries", (unsigned long)STATS_GET(rollupQueries));
+    printf("%-33s %lu\n", "History queries", (unsigned long)STATS_GET(historyQueries));
+    printf("%-33s %.3f\n", "History chunks read per query", ratio(STATS_GET(historyChunks), STATS_GET(historyQueries)));
+    printf("%-33s %lu\n", "History records printed", (unsigned long)STATS_GET(historyRows));
+}
@@ -0,0 +1,72 @@
+/**
+ * @file stats.h
+ * @brief Header file for the server runtime statistics.
+ *
+ * This header file contains the counters updated by the server hot paths
+ * and the function to print them from the server console.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-23
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include "commons.h"
+
+/**
+ * @brief Counters updated concurrently with STATS_ADD.
+ */
+struct Stats {
+    uint64_t udpRecvCalls; /* recvmmsg syscalls that returned datagrams. */
+    uint64_t udpRecvPackets; /* Datagrams received. */
+    uint64_t udpBatches; /* Batches submitted to the thread pool or handled by a receiver thread. */
+    uint64_t udpSendCalls; /* sendto and sendmmsg syscalls. */
+    uint64_t udpSendPackets; /* Datagrams sent. */
+    uint64_t poolTasks; /* Tasks executed by the thread pool workers. */
+    uint64_t poolSteals; /* Tasks taken from the queue of another worker. */
+    uint64_t poolInline; /* Tasks submitted with their argument copied inline. */
+    uint64_t arenaAllocs; /* Task arguments allocated with arena_alloc. */
+    uint64_t arenaHits; /* Allocations served with a recycled block. */
+    uint64_t arenaRemoteFrees; /* Blocks returned to the arena of another thread. */
+    uint64_t logDropped; /* Log lines discarded because the ring of their thread was full. */
+    uint64_t logStalls; /* Times a thread waited for room in its log ring. */
+    uint64_t storageRecords; /* Records appended to the data files. */
+    uint64_t storageOpens; /* Data files opened. */
+    uint64_t storageEvictions; /* Data files closed to open another one. */
+    uint64_t storageWrites; /* write syscalls on the data files. */
+    uint64_t tsdbRows; /* Rows added to the time-series files. */
+    uint64_t tsdbChunks; /* Chunks written to the time-series files. */
+    uint64_t tsdbBytes; /* Bytes of those chunks. */
+    uint64_t tsdbRawBytes; /* Bytes those chunks would take uncompressed. */
+    uint64_t walRecords; /* Records appended to the write-ahead log. */
+    uint64_t walCommits; /* Group commits, each one a write syscall. */
+    uint64_t walSyncs; /* fdatasync calls on the write-ahead log. */
+    uint64_t walCheckpoints; /* Times the write-ahead log was truncated after syncing the data files. */
+    uint64_t cacheHits; /* Gets answered with the last value of the device. */
+    uint64_t cacheMisses; /* Gets with a maximum age sent to the controller. */
+    uint64_t rollupValues; /* Values added to the rollup buckets. */
+    uint64_t rollupBuckets; /* Buckets written to the rollup files. */
+    uint64_t rollupWrites; /* write syscalls on the rollup files. */
+    uint64_t rollupQueries; /* Rollup commands executed. */
+    uint64_t historyQueries; /* History commands executed. */
+    uint64_t historyChunks; /* Chunks decoded by those commands. */
+    uint64_t historyRows; /* Records printed by those commands. */
+};
+
+/* Global server statistics */
+extern struct Stats stats;
+
+/* Atomically adds n to a Stats counter */
+#define STATS_ADD(counter, n) __atomic_fetch_add(&stats.counter, (n), __ATOMIC_RELAXED)
+
+/* Atomically reads a Stats counter */
+#define STATS_GET(counter) __atomic_load_n(&stats.counter, __ATOMIC_RELAXED)
+
+/**
+ * @brief Prints the server statistics.
+ */
+void printStats();
+
+#endif /* STATS_H_ */
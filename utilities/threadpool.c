@@ -5,9 +5,19 @@
  * This c file contains functions implementations related to the management
  * of a thread pool for concurrent task execution.
  * 
+ * Every worker owns a bounded lock-free queue (Vyukov's sequence slots), so
+ * submitting and taking a task costs a couple of atomic operations instead of
+ * a mutex round trip. Tasks submitted with the same hint land on the same
+ * worker, keeping the state they touch in one core cache, and idle workers
+ * steal from the others so a busy worker doesn't hold back the rest. Idle
+ * workers poll the queues a few times and then park on a condition variable,
+ * which submitters only signal when some worker is actually parked.
+ * Small arguments travel inside the task itself and bigger ones come from
+ * the arena allocator, so running a task never goes through malloc.
+ * 
  * @author Eric Bitria Ribes
- * @version 0.2
- * @date 2024-3-24
+ * @version 0.4
+ * @date 2024-4-25
  */
 
 #include "commons.h"
@@ -16,128 +26,428 @@
 #define POISON_PILL NULL
 
 /**
- * @brief Worker function for thread pool.
+ * @brief Initializes an empty task queue.
+ * 
+ * @param queue Pointer to the task queue.
+ */
+void task_queue_init(task_queue_t *queue) {
+    size_t i;
+    for (i = 0; i < MAX_QUEUE_SIZE; i++) {
+        queue->slots[i].sequence = i;
+    }
+    queue->tail = queue->head = 0;
+}
+
+/**
+ * @brief Pushes a task to the queue without blocking.
+ * 
+ * A producer claims the tail position with a compare and swap when its slot
+ * is free, writes the task and then publishes it advancing the slot sequence.
+ * 
+ * @param queue Pointer to the task queue.
+ * @param task The task to push.
+ * 
+ * @return Returns false if the queue is full.
+ */
+bool task_queue_push(task_queue_t *queue, task_t task) {
+    task_slot_t *slot;
+    size_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+
+    while (1) {
+        size_t sequence;
+        long diff;
+
+        slot = &queue->slots[pos & (MAX_QUEUE_SIZE - 1)];
+        sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        diff = (long)sequence - (long)pos;
+        if (diff == 0) {
+            /* Slot free, try to claim the position */
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Slot still holds the task of the previous lap */
+            return false;
+        } else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->task = task;
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @brief Pops a task from the queue without blocking.
+ * 
+ * A consumer claims the head position with a compare and swap when its slot
+ * has been published, reads the task and then frees the slot for the next lap.
+ * 
+ * @param queue Pointer to the task queue.
+ * @param task Pointer where the popped task will be stored.
+ * 
+ * @return Returns false if the queue is empty.
+ */
+bool task_queue_pop(task_queue_t *queue, task_t *task) {
+    task_slot_t *slot;
+    size_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+
+    while (1) {
+        size_t sequence;
+        long diff;
+
+        slot = &queue->slots[pos & (MAX_QUEUE_SIZE - 1)];
+        sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        diff = (long)sequence - (long)(pos + 1);
+        if (diff == 0) {
+            /* Task published, try to claim the position */
+            if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Nothing published yet */
+            return false;
+        } else {
+            pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    *task = slot->task;
+    __atomic_store_n(&slot->sequence, pos + MAX_QUEUE_SIZE, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Worker running in the calling thread, NULL outside of the pool */
+static __thread worker_t *currentWorker = NULL;
+
+/**
+ * @brief Pops a task from the local queue or steals one from another worker.
+ *
+ * Victims are visited starting from the next worker, so idle workers don't
+ * all hit the same queue.
  *
+ * @param self Pointer to the calling worker.
+ * @param task Pointer where the task will be stored.
+ *
+ * @return Returns false if every queue is empty.
+ */
+bool thread_pool_find(worker_t *self, task_t *task) {
+    thread_pool_t *pool = self->pool;
+    int i;
+
+    if (task_queue_pop(&self->queue, task)) {
+        return true;
+    }
+    for (i = 1; i < pool->size; i++) {
+        if (task_queue_pop(&pool->workers[(self->id + i) % pool->size].queue, task)) {
+            STATS_ADD(poolSteals, 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Takes the next task, parking the worker while every queue is empty.
+ * 
+ * The worker announces itself in sleepers before the last check of the queues,
+ * so a submitter either sees it and wakes it up, or the worker sees the task.
+ * 
+ * @param self Pointer to the calling worker.
+ * @param task Pointer where the task will be stored.
+ */
+void thread_pool_take(worker_t *self, task_t *task) {
+    thread_pool_t *pool = self->pool;
+    int spins;
+
+    while (1) {
+        for (spins = 0; spins < WORKER_SPINS; spins++) {
+            if (thread_pool_find(self, task)) {
+                return;
+            }
+        }
+
+        mtx_lock(&pool->lock);
+        self->parked = 1;
+        __atomic_fetch_add(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (thread_pool_find(self, task)) {
+            self->parked = 0;
+            __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+            mtx_unlock(&pool->lock);
+            return;
+        }
+        while (self->parked) {
+            cnd_wait(&self->wake, &pool->lock);
+        }
+        __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        mtx_unlock(&pool->lock);
+    }
+}
+
+/**
+ * @brief Wakes up the owner of a queue if parked, otherwise any parked worker.
+ * 
+ * @param pool Pointer to the thread pool structure.
+ * @param target Pointer to the worker whose queue received a task.
+ */
+void thread_pool_wake(thread_pool_t *pool, worker_t *target) {
+    int i;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
+    mtx_lock(&pool->lock);
+    /* A busy owner will take the task later, let an idle worker steal it */
+    for (i = 0; !target->parked && i < pool->size; i++) {
+        if (pool->workers[i].parked) {
+            target = &pool->workers[i];
+        }
+    }
+    if (target->parked) {
+        target->parked = 0;
+        cnd_signal(&target->wake);
+    }
+    mtx_unlock(&pool->lock);
+}
+
+/**
+ * @brief Pushes a task to the queue of a worker and wakes up a worker to run it.
+ * 
+ * If the queue is full the task goes to the next worker, yielding the
+ * processor after every full round.
+ * 
+ * @param pool Pointer to the thread pool structure.
+ * @param target Position of the worker.
+ * @param task The task to push.
+ */
+void thread_pool_push(thread_pool_t *pool, int target, task_t task) {
+    int tries = 0;
+
+    while (!task_queue_push(&pool->workers[target].queue, task)) {
+        target = (target + 1) % pool->size;
+        if (++tries % pool->size == 0) {
+            thrd_yield();
+        }
+    }
+    thread_pool_wake(pool, &pool->workers[target]);
+}
+
+/**
+ * @brief Worker function for thread pool.
+ * 
  * This function represents the worker routine that each thread in the
  * thread pool executes. It continuously waits for tasks to be available
- * in the task queue, executes them, and then waits for the next task.
- * If a posion pill task is encountered the worker exits.
+ * in its queue (or steals them from other workers), executes them, and
+ * then waits for the next task. If a posion pill task is encountered the
+ * worker exits.
  * 
- * @param arg Pointer to the thread pool structure.
+ * @param arg Pointer to the worker structure.
  */
 int worker(void *arg) {
-    thread_pool_t *pool = (thread_pool_t*)arg;
+    worker_t *self = (worker_t*)arg;
+    currentWorker = self;
     while (1) {
         task_t task;
-        mtx_lock(&pool->lock);
-        while (pool->count == 0) {
-            cnd_wait(&pool->not_empty, &pool->lock);
-        }
-        task = pool->tasks[pool->head];
+        thread_pool_take(self, &task);
         if (task.function == POISON_PILL) {
-            mtx_unlock(&pool->lock);
             break;
         }
-        pool->head = (pool->head + 1) % MAX_QUEUE_SIZE;
-        pool->count--;
-        cnd_signal(&pool->not_full);
-        mtx_unlock(&pool->lock);
 
-        (task.function)(task.argument);
-        free(task.argument);
+        if (task.argument != NULL) {
+            (task.function)(task.argument);
+            arena_free(task.argument);
+        } else {
+            (task.function)(task.payload);
+        }
+        STATS_ADD(poolTasks, 1);
     }
     return 0;
 }
 
 /**
  * @brief Creates a new thread pool.
- *
+ * 
  * This function dynamically allocates memory for a new thread pool
- * structure, initializes its attributes, and creates worker threads
- * to handle tasks submitted to the pool.
+ * structure and its workers, initializes their attributes, and creates
+ * the worker threads to handle tasks submitted to the pool.
+ * 
+ * @param threads Number of worker threads, 0 to start one per online processor.
  * 
  * @return Returns a pointer to the newly created thread pool.
  */
-thread_pool_t* thread_pool_create() {
+thread_pool_t* thread_pool_create(int threads) {
     int i;
     thread_pool_t *pool = NULL;
     pool = (thread_pool_t*)malloc(sizeof(thread_pool_t));
     if ( pool == NULL) {
         lerror("Failed to allocate memory for thread pool",true);
     }
-    pool->head = pool->tail = pool->count = pool->shutdown = 0;
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    pool->size = threads < 1 ? 1 : (threads > MAX_THREADS ? MAX_THREADS : threads);
+    pool->workers = (worker_t*)malloc(pool->size * sizeof(worker_t));
+    if (pool->workers == NULL) {
+        lerror("Failed to allocate memory for thread pool",true);
+    }
+    pool->next = 0;
+    pool->sleepers = pool->shutdown = 0;
     mtx_init(&pool->lock, mtx_plain);
-    cnd_init(&pool->not_empty);
-    cnd_init(&pool->not_full);
 
-    for (i = 0; i < MAX_THREADS; i++) {
-        if(thrd_create(&pool->threads[i], worker, (void*)pool) != thrd_success){
+    for (i = 0; i < pool->size; i++) {
+        task_queue_init(&pool->workers[i].queue);
+        cnd_init(&pool->workers[i].wake);
+        pool->workers[i].parked = 0;
+        pool->workers[i].id = i;
+        pool->workers[i].pool = pool;
+    }
+    for (i = 0; i < pool->size; i++) {
+        if(thrd_create(&pool->workers[i].thread, worker, (void*)&pool->workers[i]) != thrd_success){
             lerror("Unexpected error while creating worker thread num: %i",true,i);
         }
     }
     return pool;
 }
 
+/**
+ * @brief Gets the hint of a task submitted without one.
+ * 
+ * @param pool Pointer to the thread pool.
+ * 
+ * @return Returns the calling worker, or the next worker in round robin
+ * when called from outside the pool.
+ */
+unsigned int thread_pool_hint(thread_pool_t *pool) {
+    if (currentWorker != NULL && currentWorker->pool == pool) {
+        return (unsigned int)currentWorker->id;
+    }
+    return __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+}
+
 /**
  * @brief Submits a task to the thread pool.
- *
- * This function adds a new task to the task queue of the specified
- * thread pool. If the queue is full, it waits until space becomes
- * available. Once the task is added, it signals the worker threads
- * that a new task is available for execution.
+ * 
+ * This function adds a new task to the queue of the calling worker, or
+ * of the next worker in round robin when called from outside the pool.
+ * Once the task is added, it wakes up a parked worker if there is one.
  * 
  * @param pool Pointer to the thread pool.
  * @param function Pointer to the function representing the task.
- * @param argument Pointer to the argument for the task function.
+ * @param argument Pointer to the argument for the task function, allocated with arena_alloc.
+ * It is freed after the task runs.
  */
 void thread_pool_submit(thread_pool_t *pool, void (*function)(void*), void *argument) {
-    mtx_lock(&pool->lock);
-    while (pool->count == MAX_QUEUE_SIZE) {
-        cnd_wait(&pool->not_full, &pool->lock);
+    thread_pool_submit_to(pool, thread_pool_hint(pool), function, argument);
+}
+
+/**
+ * @brief Submits a task to the thread pool copying its argument into the task.
+ * 
+ * Same as thread_pool_submit, but the caller keeps ownership of the argument.
+ * 
+ * @param pool Pointer to the thread pool.
+ * @param function Pointer to the function representing the task.
+ * @param payload Pointer to the argument for the task function, it can be reused right away.
+ * @param size Size in bytes of the argument, up to TASK_PAYLOAD to avoid any allocation.
+ */
+void thread_pool_submit_inline(thread_pool_t *pool, void (*function)(void*), const void *payload, size_t size) {
+    thread_pool_submit_inline_to(pool, thread_pool_hint(pool), function, payload, size);
+}
+
+/**
+ * @brief Submits a task to the local queue of the worker selected by a hint.
+ * 
+ * Tasks submitted with the same hint run on the same worker unless it is
+ * busy and an idle worker steals them.
+ * 
+ * @param pool Pointer to the thread pool.
+ * @param hint Any number, the worker is hint modulo the pool size.
+ * @param function Pointer to the function representing the task.
+ * @param argument Pointer to the argument for the task function.
+ */
+void thread_pool_submit_to(thread_pool_t *pool, unsigned int hint, void (*function)(void*), void *argument) {
+    task_t task;
+    if (__atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) {
+        return;
     }
-    if (pool->shutdown) {
-        mtx_unlock(&pool->lock);
+    task.function = function;
+    task.argument = argument;
+    thread_pool_push(pool, (int)(hint % (unsigned int)pool->size), task);
+}
+
+/**
+ * @brief Submits a task to the worker selected by a hint copying its argument into the task.
+ * 
+ * Arguments up to TASK_PAYLOAD bytes are stored in the task itself and the
+ * worker runs the function on its copy. Bigger ones are copied to a block
+ * of the arena allocator.
+ * 
+ * @param pool Pointer to the thread pool.
+ * @param hint Any number, the worker is hint modulo the pool size.
+ * @param function Pointer to the function representing the task.
+ * @param payload Pointer to the argument for the task function, it can be reused right away.
+ * @param size Size in bytes of the argument, up to TASK_PAYLOAD to avoid any allocation.
+ */
+void thread_pool_submit_inline_to(thread_pool_t *pool, unsigned int hint, void (*function)(void*), const void *payload, size_t size) {
+    task_t task;
+    if (__atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) {
         return;
     }
-    pool->tasks[pool->tail].function = function;
-    pool->tasks[pool->tail].argument = argument;
-    pool->tail = (pool->tail + 1) % MAX_QUEUE_SIZE;
-    pool->count++;
-    cnd_signal(&pool->not_empty);
-    mtx_unlock(&pool->lock);
+    task.function = function;
+    if (size <= sizeof(task.payload)) {
+        task.argument = NULL;
+        memcpy(task.payload, payload, size);
+        STATS_ADD(poolInline, 1);
+    } else {
+        task.argument = arena_alloc(size);
+        memcpy(task.argument, payload, size);
+    }
+    thread_pool_push(pool, (int)(hint % (unsigned int)pool->size), task);
 }
 
 
 /**
  * @brief Shuts down the thread pool.
- *
+ * 
  * This function initiates the shutdown process for the thread pool.
- * It sets the shutdown flag, broadcasts to all worker threads that
- * they should exit, waits for all threads to join, and then frees
- * the resources associated with the thread pool.
+ * It sets the shutdown flag, sends a poison pill to every worker thread,
+ * waits for all threads to join, and then frees the resources associated
+ * with the thread pool.
  * 
  * @param pool Pointer to the thread pool to be shut down.
  */
 void thread_pool_shutdown(thread_pool_t *pool) {
     int i;
+    task_t pill;
 
-    for (i = 0; i < MAX_THREADS; i++) {
-        thread_pool_submit(pool, POISON_PILL, POISON_PILL);
-    }
+    __atomic_store_n(&pool->shutdown, 1, __ATOMIC_RELEASE);
 
+    pill.function = POISON_PILL;
+    pill.argument = POISON_PILL;
+    for (i = 0; i < pool->size; i++) {
+        thread_pool_push(pool, i, pill);
+    }
+    /* Wake up every parked worker to take a pill */
     mtx_lock(&pool->lock);
-    pool->shutdown = 1;
+    for (i = 0; i < pool->size; i++) {
+        if (pool->workers[i].parked) {
+            pool->workers[i].parked = 0;
+            cnd_signal(&pool->workers[i].wake);
+        }
+    }
     mtx_unlock(&pool->lock);
 
-    for (i = 0; i < MAX_THREADS; i++) {
-        thrd_join(pool->threads[i], NULL);
+    for (i = 0; i < pool->size; i++) {
+        thrd_join(pool->workers[i].thread, NULL);
     }
 
-    mtx_lock(&pool->lock);
-    cnd_destroy(&pool->not_empty);
-    cnd_destroy(&pool->not_full);
-    mtx_unlock(&pool->lock);
-
+    for (i = 0; i < pool->size; i++) {
+        cnd_destroy(&pool->workers[i].wake);
+    }
     mtx_destroy(&pool->lock);
+    free(pool->workers);
     free(pool);
-}
\ No newline at end of file
+}
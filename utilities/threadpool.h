@@ -6,8 +6,8 @@
  * related to the management of a thread pool for concurrent task execution.
  * 
  * @author Eric Bitria Ribes
- * @version 0.1
- * @date 2024-3-22
+ * @version 0.3
+ * @date 2024-4-25
  */
 
 #ifndef THREAD_POOL_H_
@@ -15,47 +15,152 @@
 
 #include "commons.h"
 
-#define MAX_THREADS 5 /* Maximum number of worker threads in the thread pool. */
-#define MAX_QUEUE_SIZE 100 /* Maximum size of the task queue in the thread pool. */
+#define MAX_THREADS 256 /* Maximum number of worker threads in the thread pool. */
+#define MAX_QUEUE_SIZE 128 /* Maximum size of each worker task queue, must be a power of two. */
+#define WORKER_SPINS 256 /* Empty polls of the queues before a worker parks. */
+#define CACHE_LINE 64 /* Size in bytes of a cache line, used to avoid false sharing. */
+#define TASK_PAYLOAD 48 /* Size in bytes of the arguments stored inline in a task, multiple of 8. */
 
 /**
  * @brief Represents a task to be executed by the thread pool.
  */
 typedef struct {
     void (*function)(void*); /* Pointer to the function to be executed. */
-    void *argument; /* Pointer to the argument for the function. */
+    void *argument; /* Pointer to the argument allocated with arena_alloc, NULL if it's stored in payload. */
+    uint64_t payload[TASK_PAYLOAD / 8]; /* Argument copied into the task, aligned to 8 bytes. */
 } task_t;
 
 /**
- * @brief Represents a thread pool for managing concurrent tasks.
+ * @brief Represents a slot of the task queue.
+ * 
+ * The sequence tells the slot state for a position pos of the queue:
+ * pos means free to be written, pos + 1 means ready to be read.
+ */
+typedef struct {
+    size_t sequence; /* Sequence number of the slot. */
+    task_t task; /* Task stored in the slot. */
+} task_slot_t;
+
+/**
+ * @brief Represents a bounded lock-free multi-producer multi-consumer task queue.
+ */
+typedef struct {
+    task_slot_t slots[MAX_QUEUE_SIZE]; /* Array to store tasks in the queue. */
+    char pad0[CACHE_LINE];
+    size_t tail; /* Next position to write, updated by producers. */
+    char pad1[CACHE_LINE - sizeof(size_t)];
+    size_t head; /* Next position to read, updated by consumers. */
+    char pad2[CACHE_LINE - sizeof(size_t)];
+} task_queue_t;
+
+struct thread_pool;
+
+/**
+ * @brief Represents a worker thread and its local task queue.
  */
 typedef struct {
-    task_t tasks[MAX_QUEUE_SIZE]; /* Array to store tasks in the queue. */
-    int head, tail, count; /* Indices and count for task queue management. */
-    mtx_t lock; /* Mutex for controlling access to shared data. */
-    cnd_t not_empty, not_full; /* Condition variables for synchronization. */
+    task_queue_t queue; /* Local task queue, other workers steal from it when idle. */
+    cnd_t wake; /* Condition variable where the worker waits while parked. */
+    int parked; /* Flag set while the worker waits on wake, protected by the pool lock. */
+    int id; /* Position of the worker in the pool. */
+    thrd_t thread; /* Worker thread. */
+    struct thread_pool *pool; /* Pool the worker belongs to. */
+} worker_t;
+
+/**
+ * @brief Represents a work-stealing thread pool for managing concurrent tasks.
+ */
+typedef struct thread_pool {
+    worker_t *workers; /* Array of size workers. */
+    int size; /* Number of worker threads. */
+    unsigned int next; /* Round robin counter for tasks submitted without a hint. */
+    int sleepers; /* Number of workers parked or about to park. */
+    mtx_t lock; /* Mutex used only to park and wake up workers. */
     int shutdown; /* Flag to indicate if the thread pool is being shut down. */
-    thrd_t threads[MAX_THREADS]; /* Array to store worker threads. */
 } thread_pool_t;
 
 /* Function declarations */
 
+/**
+ * @brief Initializes an empty task queue.
+ * 
+ * @param queue Pointer to the task queue.
+ */
+void task_queue_init(task_queue_t *queue);
+
+/**
+ * @brief Pushes a task to the queue without blocking.
+ * 
+ * @param queue Pointer to the task queue.
+ * @param task The task to push.
+ * 
+ * @return Returns false if the queue is full.
+ */
+bool task_queue_push(task_queue_t *queue, task_t task);
+
+/**
+ * @brief Pops a task from the queue without blocking.
+ * 
+ * @param queue Pointer to the task queue.
+ * @param task Pointer where the popped task will be stored.
+ * 
+ * @return Returns false if the queue is empty.
+ */
+bool task_queue_pop(task_queue_t *queue, task_t *task);
+
 /**
  * @brief Creates a new thread pool.
  * 
+ * @param threads Number of worker threads, 0 to start one per online processor.
+ * 
  * @return Returns a pointer to the newly created thread pool.
  */
-thread_pool_t* thread_pool_create();
+thread_pool_t* thread_pool_create(int threads);
 
 /**
  * @brief Submits a task to the thread pool.
  * 
  * @param pool Pointer to the thread pool.
  * @param function Pointer to the function representing the task.
- * @param argument Pointer to the argument for the task function.
+ * @param argument Pointer to the argument for the task function, allocated with arena_alloc.
+ * It is freed after the task runs.
  */
 void thread_pool_submit(thread_pool_t *pool, void (*function)(void*), void *argument);
 
+/**
+ * @brief Submits a task to the thread pool copying its argument into the task.
+ * 
+ * @param pool Pointer to the thread pool.
+ * @param function Pointer to the function representing the task.
+ * @param payload Pointer to the argument for the task function, it can be reused right away.
+ * @param size Size in bytes of the argument, up to TASK_PAYLOAD to avoid any allocation.
+ */
+void thread_pool_submit_inline(thread_pool_t *pool, void (*function)(void*), const void *payload, size_t size);
+
+/**
+ * @brief Submits a task to the local queue of the worker selected by a hint.
+ * 
+ * Tasks submitted with the same hint run on the same worker unless it is
+ * busy and an idle worker steals them.
+ * 
+ * @param pool Pointer to the thread pool.
+ * @param hint Any number, the worker is hint modulo the pool size.
+ * @param function Pointer to the function representing the task.
+ * @param argument Pointer to the argument for the task function, allocated with arena_alloc.
+ */
+void thread_pool_submit_to(thread_pool_t *pool, unsigned int hint, void (*function)(void*), void *argument);
+
+/**
+ * @brief Submits a task to the worker selected by a hint copying its argument into the task.
+ * 
+ * @param pool Pointer to the thread pool.
+ * @param hint Any number, the worker is hint modulo the pool size.
+ * @param function Pointer to the function representing the task.
+ * @param payload Pointer to the argument for the task function, it can be reused right away.
+ * @param size Size in bytes of the argument, up to TASK_PAYLOAD to avoid any allocation.
+ */
+void thread_pool_submit_inline_to(thread_pool_t *pool, unsigned int hint, void (*function)(void*), const void *payload, size_t size);
+
 /**
  * @brief Shuts down the thread pool.
  * 
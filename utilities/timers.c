@@ -0,0 +1,233 @@
+/**
+ * @file timers.c
+ * @brief Methods file for the deadline timers.
+ *
+ * This c file contains functions implementations related to a min-heap of
+ * deadlines. Arming, re-arming and cancelling a timer costs O(log n) and
+ * only expired entries are visited, so checking thousands of deadlines
+ * doesn't require scanning all of them. The earliest deadline is mirrored
+ * in a timer file descriptor to wake up the reactor exactly when needed.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-21
+ */
+
+#include "commons.h"
+
+/**
+ * @brief Gets the current monotonic time.
+ *
+ * @return Returns the milliseconds elapsed since an arbitrary fixed point.
+ */
+uint64_t timers_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Arms the timer file descriptor at the earliest deadline.
+ *
+ * Must be called with the lock held. Disarms it if the heap is empty.
+ *
+ * @param timers Pointer to the timers.
+ */
+void timers_sync(timer_heap_t *timers) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (timers->size > 0) {
+        uint64_t deadline = timers->heap[0].deadline;
+        spec.it_value.tv_sec = deadline / 1000;
+        spec.it_value.tv_nsec = (deadline % 1000) * 1000000L;
+        /* A zero value would disarm the timer */
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            spec.it_value.tv_nsec = 1;
+        }
+    }
+    if (timerfd_settime(timers->fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        lerror("Error arming timer file descriptor", true);
+    }
+}
+
+/**
+ * @brief Places an entry in a heap slot, updating its position.
+ *
+ * @param timers Pointer to the timers.
+ * @param slot Heap slot.
+ * @param entry Entry to store.
+ */
+void timers_place(timer_heap_t *timers, int slot, timer_entry_t entry) {
+    timers->heap[slot] = entry;
+    timers->position[entry.id] = slot;
+}
+
+/**
+ * @brief Restores the heap order moving the entry of a slot up or down.
+ *
+ * @param timers Pointer to the timers.
+ * @param slot Heap slot whose deadline has changed.
+ */
+void timers_fix(timer_heap_t *timers, int slot) {
+    timer_entry_t entry = timers->heap[slot];
+
+    /* Sift up */
+    while (slot > 0 && timers->heap[(slot - 1) / 2].deadline > entry.deadline) {
+        timers_place(timers, slot, timers->heap[(slot - 1) / 2]);
+        slot = (slot - 1) / 2;
+    }
+    /* Sift down */
+    while (2 * slot + 1 < timers->size) {
+        int child = 2 * slot + 1;
+        if (child + 1 < timers->size && timers->heap[child + 1].deadline < timers->heap[child].deadline) {
+            child++;
+        }
+        if (timers->heap[child].deadline >= entry.deadline) {
+            break;
+        }
+        timers_place(timers, slot, timers->heap[child]);
+        slot = child;
+    }
+    timers_place(timers, slot, entry);
+}
+
+/**
+ * @brief Removes the entry stored in a heap slot.
+ *
+ * @param timers Pointer to the timers.
+ * @param slot Heap slot to remove.
+ */
+void timers_remove(timer_heap_t *timers, int slot) {
+    timers->position[timers->heap[slot].id] = -1;
+    timers->size--;
+    if (slot != timers->size) {
+        timers_place(timers, slot, timers->heap[timers->size]);
+        timers_fix(timers, slot);
+    }
+}
+
+/**
+ * @brief Creates a new set of timers.
+ *
+ * This function allocates the heap and the position index for the given
+ * number of ids and creates the one-shot timer file descriptor.
+ *
+ * @param capacity Number of ids, valid ids go from 0 to capacity - 1.
+ *
+ * @return Returns a pointer to the newly created timers.
+ */
+timer_heap_t* timers_create(int capacity) {
+    int i;
+    timer_heap_t *timers = (timer_heap_t*)malloc(sizeof(timer_heap_t));
+    if (timers == NULL) {
+        lerror("Failed to allocate memory for timers", true);
+    }
+    timers->heap = (timer_entry_t*)malloc(capacity * sizeof(timer_entry_t));
+    timers->position = (int*)malloc(capacity * sizeof(int));
+    if (timers->heap == NULL || timers->position == NULL) {
+        lerror("Failed to allocate memory for timers", true);
+    }
+    for (i = 0; i < capacity; i++) {
+        timers->position[i] = -1;
+    }
+    timers->size = 0;
+    timers->capacity = capacity;
+    mtx_init(&timers->lock, mtx_plain);
+    if ((timers->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+        lerror("Error creating timer file descriptor", true);
+    }
+    return timers;
+}
+
+/**
+ * @brief Arms or re-arms the timer of an id.
+ *
+ * If the id already has a deadline it is replaced. The timer file descriptor
+ * is only updated when the earliest deadline changes.
+ *
+ * @param timers Pointer to the timers.
+ * @param id The timer identifier.
+ * @param deadline Expiration time in milliseconds.
+ */
+void timers_arm(timer_heap_t *timers, int id, uint64_t deadline) {
+    uint64_t earliest;
+    int slot;
+
+    mtx_lock(&timers->lock);
+    earliest = timers->size > 0 ? timers->heap[0].deadline : 0;
+    if ((slot = timers->position[id]) == -1) {
+        slot = timers->size++;
+    }
+    timers->heap[slot].deadline = deadline;
+    timers->heap[slot].id = id;
+    timers->position[id] = slot;
+    timers_fix(timers, slot);
+    if (timers->heap[0].deadline != earliest) {
+        timers_sync(timers);
+    }
+    mtx_unlock(&timers->lock);
+}
+
+/**
+ * @brief Cancels the timer of an id, if armed.
+ *
+ * @param timers Pointer to the timers.
+ * @param id The timer identifier.
+ */
+void timers_cancel(timer_heap_t *timers, int id) {
+    int slot;
+
+    mtx_lock(&timers->lock);
+    if ((slot = timers->position[id]) != -1) {
+        timers_remove(timers, slot);
+        if (slot == 0) {
+            timers_sync(timers);
+        }
+    }
+    mtx_unlock(&timers->lock);
+}
+
+/**
+ * @brief Pops the expired timers.
+ *
+ * This function consumes the timer file descriptor expiration, removes every
+ * entry whose deadline has passed (up to max) and re-arms the descriptor at
+ * the next deadline.
+ *
+ * @param timers Pointer to the timers.
+ * @param ids Array where the expired ids will be stored.
+ * @param max Size of the ids array.
+ *
+ * @return Returns the number of expired ids stored.
+ */
+int timers_expired(timer_heap_t *timers, int *ids, int max) {
+    uint64_t expirations, now = timers_now();
+    int count = 0;
+
+    if (read(timers->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        lerror("Error reading timer file descriptor", true);
+    }
+
+    mtx_lock(&timers->lock);
+    while (count < max && timers->size > 0 && timers->heap[0].deadline <= now) {
+        ids[count++] = timers->heap[0].id;
+        timers_remove(timers, 0);
+    }
+    timers_sync(timers);
+    mtx_unlock(&timers->lock);
+
+    return count;
+}
+
+/**
+ * @brief Destroys the timers.
+ *
+ * @param timers Pointer to the timers.
+ */
+void timers_destroy(timer_heap_t *timers) {
+    close(timers->fd);
+    mtx_destroy(&timers->lock);
+    free(timers->heap);
+    free(timers->position);
+    free(timers);
+}
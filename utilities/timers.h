@@ -0,0 +1,89 @@
+/**
+ * @file timers.h
+ * @brief Header file for the deadline timers.
+ *
+ * This header file contains declarations for functions and structures
+ * related to a min-heap of deadlines indexed by id, backed by a one-shot
+ * timer file descriptor that the reactor can wait on.
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-21
+ */
+
+#ifndef TIMERS_H_
+#define TIMERS_H_
+
+#include "commons.h"
+
+/**
+ * @brief Represents a deadline stored in the heap.
+ */
+typedef struct {
+    uint64_t deadline; /* Expiration time in milliseconds (see timers_now). */
+    int id; /* Identifier of the timer owner. */
+} timer_entry_t;
+
+/**
+ * @brief Represents a set of timers, at most one per id.
+ */
+typedef struct {
+    timer_entry_t *heap; /* Binary min-heap ordered by deadline. */
+    int *position; /* Heap position of each id, -1 if not armed. */
+    int size, capacity; /* Armed timers and maximum number of ids. */
+    mtx_t lock; /* Mutex for controlling access to the heap. */
+    int fd; /* Timer file descriptor armed at the earliest deadline. */
+} timer_heap_t;
+
+/**
+ * @brief Gets the current monotonic time.
+ *
+ * @return Returns the milliseconds elapsed since an arbitrary fixed point.
+ */
+uint64_t timers_now();
+
+/**
+ * @brief Creates a new set of timers.
+ *
+ * @param capacity Number of ids, valid ids go from 0 to capacity - 1.
+ *
+ * @return Returns a pointer to the newly created timers.
+ */
+timer_heap_t* timers_create(int capacity);
+
+/**
+ * @brief Arms or re-arms the timer of an id.
+ *
+ * @param timers Pointer to the timers.
+ * @param id The timer identifier.
+ * @param deadline Expiration time in milliseconds.
+ */
+void timers_arm(timer_heap_t *timers, int id, uint64_t deadline);
+
+/**
+ * @brief Cancels the timer of an id, if armed.
+ *
+ * @param timers Pointer to the timers.
+ * @param id The timer identifier.
+ */
+void timers_cancel(timer_heap_t *timers, int id);
+
+/**
+ * @brief Pops the expired timers.
+ *
+ * @param timers Pointer to the timers.
+ * @param ids Array where the expired ids will be stored.
+ * @param max Size of the ids array.
+ *
+ * @return Returns the number of expired ids stored.
+ */
+int timers_expired(timer_heap_t *timers, int *ids, int max);
+
+/**
+ * @brief Destroys the timers.
+ *
+ * @param timers Pointer to the timers.
+ */
+void timers_destroy(timer_heap_t *timers);
+
+#endif /* TIMERS_H_ */
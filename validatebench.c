@@ -0,0 +1,179 @@
+/**
+ * @file validatebench.c
+ * @brief Benchmark of the PDU field validation kernels.
+ *
+ * Times the format checks of validate.c and the same checks made with the
+ * libc string functions, on HELLO packets that are well formed and that
+ * aren't, and checks that both give the same answers. The kernels are only
+ * worth it with the optimized build of the Makefile.
+ *
+ * Usage: ./validatebench
+ *
+ * @author Eric Bitria Ribes
+ * @version 0.1
+ * @date 2024-4-30
+ */
+
+#include "utilities/commons.h"
+
+#define BENCH_TIME 0.3 /* Seconds each measurement runs for at least. */
+#define BENCH_PACKETS 4 /* Packets checked by every measurement. */
+#define BENCH_ROUNDS 1000 /* Rounds over the packets between two reads of the clock. */
+
+/* Offsets of the fields of a UDP PDU */
+#define MAC_OFFSET 1
+#define RND_OFFSET 14
+#define DATA_OFFSET 23
+
+/* Packets with room for a whole vector after them, as the receive buffers */
+char packets[BENCH_PACKETS][PDUUDP + FIELD_READABLE];
+
+/* Answers added up, so the checks can't be optimized away */
+volatile unsigned long matches = 0;
+
+/**
+ * @brief Represents a check made with a kernel and with libc.
+ */
+struct benchCheck {
+    const char *name; /**< What is checked */
+    bool (*kernel)(const char *packet); /**< The check with validate.c */
+    bool (*libc)(const char *packet); /**< The check with the libc string functions */
+};
+
+/**
+ * @brief Gets a monotonic time.
+ *
+ * @return Seconds since an arbitrary point.
+ */
+double now() {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Checks the identifier format of a packet with fieldIsDigits.
+ *
+ * @param packet The packet.
+ *
+ * @return Returns true if it matches.
+ */
+bool digitsKernel(const char *packet) {
+    return fieldIsDigits(packet + RND_OFFSET, 8);
+}
+
+/**
+ * @brief Checks the identifier format of a packet with strlen and strspn.
+ *
+ * @param packet The packet.
+ *
+ * @return Returns true if it matches.
+ */
+bool digitsLibc(const char *packet) {
+    return strlen(packet + RND_OFFSET) == 8 && strspn(packet + RND_OFFSET, "0123456789") == 8;
+}
+
+/**
+ * @brief Checks the MAC format of a packet with fieldIsHex.
+ *
+ * @param packet The packet.
+ *
+ * @return Returns true if it matches.
+ */
+bool hexKernel(const char *packet) {
+    return fieldIsHex(packet + MAC_OFFSET, 12);
+}
+
+/**
+ * @brief Checks the MAC format of a packet with strlen and strspn.
+ *
+ * @param packet The packet.
+ *
+ * @return Returns true if it matches.
+ */
+bool hexLibc(const char *packet) {
+    return strlen(packet + MAC_OFFSET) == 12 && strspn(packet + MAC_OFFSET, "0123456789ABCDEFabcdef") == 12;
+}
+
+/**
+ * @brief Encodes a HELLO packet.
+ *
+ * @param packet Where it's encoded, zeroed first.
+ * @param mac MAC field.
+ * @param rnd Identifier field.
+ * @param data Data field.
+ */
+void encodePacket(char *packet, const char *mac, const char *rnd, const char *data) {
+    memset(packet, 0, PDUUDP + FIELD_READABLE);
+    packet[0] = HELLO;
+    strcpy(packet + MAC_OFFSET, mac);
+    strcpy(packet + RND_OFFSET, rnd);
+    strcpy(packet + DATA_OFFSET, data);
+}
+
+/**
+ * @brief Measures a check on every packet.
+ *
+ * @param check The check.
+ *
+ * @return Nanoseconds per call.
+ */
+double benchCheck(bool (*check)(const char *packet)) {
+    unsigned long found = 0;
+    double start, elapsed;
+    long rounds;
+    int r, i;
+
+    for (rounds = 0, start = now(); (elapsed = now() - start) < BENCH_TIME; rounds += BENCH_ROUNDS) {
+        for (r = 0; r < BENCH_ROUNDS; r++) {
+            for (i = 0; i < BENCH_PACKETS; i++) {
+                found += check(packets[i]);
+            }
+        }
+    }
+    matches += found;
+    return elapsed * 1e9 / (rounds * BENCH_PACKETS);
+}
+
+/**
+ * @brief Main function of the benchmark.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ *
+ * @return Returns EXIT_FAILURE if a kernel and libc disagree on a packet.
+ */
+int main(int argc, char *argv[]) {
+    struct benchCheck checks[] = {
+        {"Identifier is digits", digitsKernel, digitsLibc},
+        {"MAC is hexadecimal", hexKernel, hexLibc}
+    };
+    int numChecks = sizeof(checks) / sizeof(checks[0]), c, i;
+    double kernel, libc;
+
+    encodePacket(packets[0], "AE45F3123BAA", "48213577", "CTRL-001,B00L01R02A03");
+    encodePacket(packets[1], "AE45F3123BAB", "48213578", "CTRL-002,B00L01R02A04");
+    encodePacket(packets[2], "AE45F3123BA", "4821357", "CTRL-001");
+    encodePacket(packets[3], "AE45F3123BAA", "48213577", "7000,B00L01R02A03,CTRL-001");
+    /* Garbage after the terminators, as a peer may send */
+    memset(packets[2] + MAC_OFFSET + 12, 'X', 1);
+    memset(packets[2] + RND_OFFSET + 8, 'X', 1);
+
+    for (c = 0; c < numChecks; c++) {
+        for (i = 0; i < BENCH_PACKETS; i++) {
+            if (checks[c].kernel(packets[i]) != checks[c].libc(packets[i])) {
+                fprintf(stderr, "%s differs from libc on packet %d.\n", checks[c].name, i);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    printf("%-32s %12s %12s %8s\n", "Check", "Kernel ns", "Libc ns", "Speedup");
+    for (c = 0; c < numChecks; c++) {
+        kernel = benchCheck(checks[c].kernel);
+        libc = benchCheck(checks[c].libc);
+        printf("%-32s %12.2f %12.2f %8.2f\n", checks[c].name, kernel, libc, libc / kernel);
+    }
+    return EXIT_SUCCESS;
+}